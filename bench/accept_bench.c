@@ -0,0 +1,130 @@
+// Measures accepted connections per second on loopback, with 1, 2, 4 and 8 event queues, each on
+// its own thread with an acceptor for the same port. Client threads connect and reset connections
+// as fast as they can, and each run ends once every connection has been accepted. Accept throughput
+// only scales up to the number of CPUs, which clients share with the queues.
+
+#include "event_acceptor.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define CONNECTION_COUNT 40000
+#define CLIENT_THREAD_COUNT 4
+#define MAX_QUEUE_COUNT 8
+
+static atomic_size_t accepted_count;
+static struct sockaddr_in server_address;
+
+static void accept_function(
+    int fd,
+    const struct sockaddr* address,
+    socklen_t address_size,
+    void* userdata
+) {
+    (void)address;
+    (void)address_size;
+    (void)userdata;
+
+    close(fd);
+    atomic_fetch_add_explicit(&accepted_count, 1, memory_order_relaxed);
+}
+
+static void* run_queue(void* userdata) {
+    EventQueue* queue = userdata;
+
+    while (atomic_load_explicit(&accepted_count, memory_order_relaxed) < CONNECTION_COUNT) {
+        event_queue_wait_timeout(queue, 10000);
+    }
+
+    return NULL;
+}
+
+static void* run_client(void* userdata) {
+    (void)userdata;
+
+    // Resetting connections, instead of closing them, leaves no ports in TIME_WAIT.
+    struct linger linger = { .l_onoff = 1, .l_linger = 0 };
+
+    for (size_t i = 0; i < CONNECTION_COUNT / CLIENT_THREAD_COUNT; i++) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        assert(fd >= 0);
+
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+
+        int status = connect(fd, (const struct sockaddr*)&server_address, sizeof(server_address));
+        assert(status == 0);
+
+        close(fd);
+    }
+
+    return NULL;
+}
+
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static void run(size_t queue_count) {
+    EventQueue queues[MAX_QUEUE_COUNT];
+    IoEventId acceptors[MAX_QUEUE_COUNT];
+
+    server_address = (struct sockaddr_in){
+        .sin_family = AF_INET,
+        .sin_port = 0,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+
+    for (size_t i = 0; i < queue_count; i++) {
+        queues[i] = event_queue_new();
+
+        bool is_listening = event_queue_add_acceptor(
+            &queues[i], (struct sockaddr*)&server_address, sizeof(server_address),
+            accept_function, NULL, &acceptors[i]);
+        assert(is_listening);
+    }
+
+    atomic_store(&accepted_count, 0);
+    double start = now_seconds();
+
+    pthread_t queue_threads[MAX_QUEUE_COUNT];
+    for (size_t i = 0; i < queue_count; i++) {
+        pthread_create(&queue_threads[i], NULL, run_queue, &queues[i]);
+    }
+
+    pthread_t client_threads[CLIENT_THREAD_COUNT];
+    for (size_t i = 0; i < CLIENT_THREAD_COUNT; i++) {
+        pthread_create(&client_threads[i], NULL, run_client, NULL);
+    }
+
+    for (size_t i = 0; i < CLIENT_THREAD_COUNT; i++) {
+        pthread_join(client_threads[i], NULL);
+    }
+
+    for (size_t i = 0; i < queue_count; i++) {
+        pthread_join(queue_threads[i], NULL);
+    }
+
+    double elapsed = now_seconds() - start;
+
+    printf("%zu queue(s) %10.0f accepts/s\n", queue_count, CONNECTION_COUNT / elapsed);
+
+    for (size_t i = 0; i < queue_count; i++) {
+        event_queue_remove_io_event(&queues[i], acceptors[i]);
+        event_queue_free(&queues[i]);
+    }
+}
+
+int main(void) {
+    printf("%ld CPU(s)\n", sysconf(_SC_NPROCESSORS_ONLN));
+
+    for (size_t queue_count = 1; queue_count <= MAX_QUEUE_COUNT; queue_count *= 2) {
+        run(queue_count);
+    }
+}
@@ -0,0 +1,148 @@
+// Compares receiving small UDP datagrams on loopback with one `recvfrom` per datagram, from an
+// ordinary I/O event, against batched `recvmmsg` through a datagram socket. Each round, a burst of
+// datagrams is sent, outside the timed section, then the queue is polled until all have been
+// received.
+
+#define _GNU_SOURCE // For `sendmmsg`
+#include "event_datagram.h"
+#include <assert.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define DATAGRAM_SIZE 64
+#define BURST_SIZE 128
+#define ROUND_COUNT 20000
+
+static size_t received_count;
+
+static void recvfrom_function(int fd, EventIoFlag flag, void* userdata) {
+    (void)flag;
+    (void)userdata;
+
+    unsigned char data[DATAGRAM_SIZE];
+    struct sockaddr_storage address;
+
+    while (true) {
+        socklen_t address_size = sizeof(address);
+        ssize_t size = recvfrom(
+            fd, data, sizeof(data), 0, (struct sockaddr*)&address, &address_size);
+
+        if (size < 0) {
+            return;
+        }
+
+        received_count += 1;
+    }
+}
+
+static void datagram_function(
+    EventDatagramSocket* socket,
+    const EventDatagram* datagrams,
+    size_t count,
+    void* userdata
+) {
+    (void)socket;
+    (void)datagrams;
+    (void)userdata;
+
+    received_count += count;
+}
+
+static int open_udp_socket(struct sockaddr_in* address) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    assert(fd >= 0);
+
+    *address = (struct sockaddr_in){
+        .sin_family = AF_INET,
+        .sin_port = 0,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+
+    socklen_t address_size = sizeof(*address);
+    bind(fd, (const struct sockaddr*)address, sizeof(*address));
+    getsockname(fd, (struct sockaddr*)address, &address_size);
+
+    return fd;
+}
+
+// Send a burst of datagrams with as few system calls as possible, so sending costs little.
+static void send_burst(int fd, const struct sockaddr_in* address) {
+    static unsigned char data[DATAGRAM_SIZE];
+    struct iovec iovecs[BURST_SIZE];
+    struct mmsghdr messages[BURST_SIZE];
+
+    for (size_t i = 0; i < BURST_SIZE; i++) {
+        iovecs[i] = (struct iovec){ .iov_base = data, .iov_len = sizeof(data) };
+        messages[i] = (struct mmsghdr){
+            .msg_hdr = {
+                .msg_name = (void*)address,
+                .msg_namelen = sizeof(*address),
+                .msg_iov = &iovecs[i],
+                .msg_iovlen = 1,
+            },
+        };
+    }
+
+    size_t sent = 0;
+    while (sent < BURST_SIZE) {
+        int count = sendmmsg(fd, &messages[sent], BURST_SIZE - sent, 0);
+        assert(count > 0);
+        sent += (size_t)count;
+    }
+}
+
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static void run(const char* name, bool is_batched) {
+    EventQueue queue = event_queue_new();
+
+    struct sockaddr_in receiver_address;
+    struct sockaddr_in sender_address;
+    int receiver = open_udp_socket(&receiver_address);
+    int sender = open_udp_socket(&sender_address);
+
+    EventDatagramSocket* socket = NULL;
+    if (is_batched) {
+        socket = event_datagram_socket_new(&queue, receiver, EVENT_DATAGRAM_DEFAULT_BATCH_SIZE,
+            EVENT_DATAGRAM_DEFAULT_MAX_SIZE, datagram_function, NULL);
+    } else {
+        event_queue_add_io_event(&queue, receiver, event_io_flag_read, recvfrom_function, NULL);
+    }
+
+    received_count = 0;
+    double elapsed = 0.0;
+
+    for (size_t round = 0; round < ROUND_COUNT; round++) {
+        send_burst(sender, &receiver_address);
+        size_t expected = (round + 1) * BURST_SIZE;
+
+        double start = now_seconds();
+        while (received_count < expected) {
+            event_queue_poll(&queue);
+        }
+        elapsed += now_seconds() - start;
+    }
+
+    printf("%-9s %8.1f ns/datagram %10.0f datagrams/s\n",
+        name, elapsed * 1e9 / (double)received_count, (double)received_count / elapsed);
+
+    if (socket != NULL) {
+        event_datagram_socket_free(socket);
+    }
+
+    event_queue_free(&queue);
+    close(receiver);
+    close(sender);
+}
+
+int main(void) {
+    run("recvfrom", false);
+    run("recvmmsg", true);
+}
@@ -0,0 +1,109 @@
+// Compares timer heap kinds on a million timers, with timeouts drawn from distributions seen in
+// servers. Each run fills the heap, then repeatedly takes the earliest timer, advances the time to
+// its deadline and inserts a new timer (the "hold" model), as a busy event queue does.
+
+#include "timer_heap.h"
+#include <stdio.h>
+#include <time.h>
+#include <math.h>
+
+#define TIMER_COUNT 1000000
+#define HOLD_COUNT 4000000
+
+typedef uint64_t (*TimeoutFunction)(uint64_t* state);
+
+static uint64_t next_random(uint64_t* state) {
+    // xorshift64*
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+// A uniformly distributed value in [0, 1).
+static double next_unit(uint64_t* state) {
+    return (double)(next_random(state) >> 11) / (double)(1ULL << 53);
+}
+
+// Request timeouts, up to a second.
+static uint64_t uniform_timeout(uint64_t* state) {
+    return next_random(state) % 1000000;
+}
+
+// Timers which usually fire soon, with a long tail, averaging 50ms.
+static uint64_t exponential_timeout(uint64_t* state) {
+    return (uint64_t)(-log(1.0 - next_unit(state)) * 50000.0);
+}
+
+// Mostly retransmission timers of 1-10ms, and some idle timeouts of 30-120s.
+static uint64_t bimodal_timeout(uint64_t* state) {
+    if (next_random(state) % 10 != 0) {
+        return 1000 + next_random(state) % 9000;
+    } else {
+        return 30000000 + next_random(state) % 90000000;
+    }
+}
+
+// The same keepalive timeout for every connection.
+static uint64_t fixed_timeout(uint64_t* state) {
+    (void)state;
+    return 30000000;
+}
+
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static void run(const char* name, TimeoutFunction timeout, TimerHeapKind kind) {
+    TimerHeap heap = timer_heap_new();
+    timer_heap_set_kind(&heap, kind);
+    timer_heap_reserve(&heap, TIMER_COUNT);
+
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    uint64_t now = 0;
+
+    double fill_start = now_seconds();
+    for (uint32_t i = 0; i < TIMER_COUNT; i++) {
+        timer_heap_insert(&heap, (Timer){ .id = i, .deadline = now + timeout(&state) });
+    }
+    double fill_end = now_seconds();
+
+    Timer timer;
+    for (uint32_t i = 0; i < HOLD_COUNT; i++) {
+        timer_heap_take(&heap, &timer);
+        now = timer.deadline;
+
+        timer.deadline = now + timeout(&state);
+        timer_heap_insert(&heap, timer);
+    }
+    double hold_end = now_seconds();
+
+    printf(
+        "%-12s %-7s %8.1f ns/insert %8.1f ns/take+insert\n",
+        name,
+        (kind == timer_heap_kind_radix) ? "radix" : "binary",
+        (fill_end - fill_start) * 1e9 / TIMER_COUNT,
+        (hold_end - fill_end) * 1e9 / HOLD_COUNT);
+
+    timer_heap_free(&heap);
+}
+
+int main(void) {
+    struct {
+        const char* name;
+        TimeoutFunction timeout;
+    } distributions[] = {
+        { "uniform", uniform_timeout },
+        { "exponential", exponential_timeout },
+        { "bimodal", bimodal_timeout },
+        { "fixed", fixed_timeout },
+    };
+
+    size_t distribution_count = sizeof(distributions) / sizeof(distributions[0]);
+    for (size_t i = 0; i < distribution_count; i++) {
+        run(distributions[i].name, distributions[i].timeout, timer_heap_kind_binary);
+        run(distributions[i].name, distributions[i].timeout, timer_heap_kind_radix);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef EVENTQUEUE_EVENT_ACCEPTOR_H
+#define EVENTQUEUE_EVENT_ACCEPTOR_H
+
+// Listening sockets spread across event queues. With one queue per thread, each queue adds an
+// acceptor for the same address; every acceptor has its own socket with `SO_REUSEPORT` set, and the
+// kernel spreads incoming connections across them by hashing the connection's addresses. Each
+// connection is accepted, and handled, on the queue which owns its socket, with no hand-off between
+// threads and no lock shared between acceptors.
+//
+// Connections waiting in an acceptor's socket when it's removed are reset, so remove acceptors only
+// when shutting down, or when connections can be retried.
+
+#include "eventqueue.h"
+#include <stdbool.h>
+#include <sys/socket.h>
+
+// A function called with each accepted connection, on the queue of the acceptor which accepted it.
+// `fd` is non-blocking and close-on-exec, and the function takes ownership of it. `address` is the
+// peer's address, of `address_size` bytes, valid only for the duration of the call.
+typedef void (*EventAcceptFunction)(
+    int fd,
+    const struct sockaddr* address,
+    socklen_t address_size,
+    void* userdata
+);
+
+// Listen for connections at `address`, of `address_size` bytes, on a new stream socket with
+// `SO_REUSEPORT` set, registered on `queue` as a read I/O event whose ID is written to `out`. When
+// readable, connections are accepted until none are left waiting, calling
+// `function(fd, address, address_size, userdata)` for each. If accepting fails for lack of fds or
+// memory, the socket isn't watched for 100 ms, rather than the queue being woken by it over and
+// over, and connections wait in its backlog meanwhile. `address` is updated with the address bound,
+// so that when it asks for port 0, the port chosen can be passed on to the acceptors of other
+// queues. Remove the acceptor with `event_queue_remove_io_event`, which also closes its socket.
+// Returns false, with `errno` set, if the socket can't be created, or to `ENOMEM` if the queue is
+// in real-time mode and has no room for its I/O event.
+bool event_queue_add_acceptor(
+    EventQueue* queue,
+    struct sockaddr* address,
+    socklen_t address_size,
+    EventAcceptFunction function,
+    void* userdata,
+    IoEventId* out
+);
+
+#endif // EVENTQUEUE_EVENT_ACCEPTOR_H
@@ -0,0 +1,32 @@
+#ifndef EVENTQUEUE_EVENT_ADMIN_H
+#define EVENTQUEUE_EVENT_ADMIN_H
+
+// An admin endpoint for live load gauges. The queue listens on a unix domain socket, as an ordinary
+// I/O event, and writes its counters (see `event_queue_get_stats`) in the Prometheus text format to
+// each client which connects, then closes the connection. For example:
+//
+//     socat - UNIX-CONNECT:/run/myservice/admin.sock
+//
+// Serving a client reads the counters and formats them; the queue's hot paths only ever increment
+// counters, whether or not an endpoint is served.
+
+#include "eventqueue.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// The largest size, in bytes, of the gauges written by `event_queue_format_stats`.
+#define EVENT_ADMIN_MAX_STATS_SIZE 2048
+
+// Listen for admin clients on a unix domain socket at `path`, which must not already exist. The
+// socket is registered as an I/O event whose ID is written to `out`; remove it with
+// `event_queue_remove_io_event` to stop serving, which also closes the socket and unlinks `path`.
+// Returns false, with `errno` set, if the socket can't be created, or to `ENOMEM` if the queue is
+// in real-time mode and has no room for its I/O event.
+bool event_queue_serve_admin(EventQueue* queue, const char* path, IoEventId* out);
+
+// Write the queue's counters to `buffer` in the Prometheus text format, as served by
+// `event_queue_serve_admin`. Returns the length written, excluding the terminating NUL, which is
+// less than `EVENT_ADMIN_MAX_STATS_SIZE` if `size` is at least that.
+size_t event_queue_format_stats(const EventQueue* queue, char* buffer, size_t size);
+
+#endif // EVENTQUEUE_EVENT_ADMIN_H
@@ -0,0 +1,45 @@
+#ifndef EVENTQUEUE_EVENT_CHANNEL_H
+#define EVENTQUEUE_EVENT_CHANNEL_H
+
+// Channels for passing messages between event queues on different threads. Each channel is a
+// bounded lock-free ring with a single producer (any one thread) and a single consumer (the
+// destination queue). All channels into a queue share one eventfd doorbell, which is only
+// signalled when a channel goes from empty to non-empty.
+
+#include "eventqueue.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// The largest number of messages passed to a single call of an `EventChannelFunction`.
+#define EVENT_CHANNEL_BATCH_SIZE 64
+
+// A function called by the destination queue with a batch of received messages, in send order.
+// `messages` is only valid for the duration of the call.
+typedef void (*EventChannelFunction)(void* userdata, void** messages, size_t count);
+
+typedef struct EventChannel EventChannel;
+
+// Create a channel which delivers messages to `function(userdata, messages, count)` on the
+// `destination` queue. `capacity` is rounded up to a power of two. Must be called on the
+// destination queue's thread, before the channel's producer starts sending. While any channel to a
+// queue exists, `event_queue_wait` on it waits for messages. Returns NULL, with `errno` set to
+// `ENOMEM`, if the destination is in real-time mode and has no room for the I/O event which the
+// first channel to it adds.
+EventChannel* event_channel_new(
+    EventQueue* destination,
+    size_t capacity,
+    EventChannelFunction function,
+    void* userdata
+);
+
+// Send `message` through the channel. May be called from any one thread at a time. Returns false
+// without sending if the channel is full.
+bool event_channel_send(EventChannel* channel, void* message);
+
+// Free a channel. Messages which have not been received are discarded. Must be called on the
+// destination queue's thread, once the producer has stopped sending. May be called from within the
+// function of any channel, including this one, in which case the channel is freed once the
+// function returns. Channels which have not been freed are freed along with their destination.
+void event_channel_free(EventChannel* channel);
+
+#endif // EVENTQUEUE_EVENT_CHANNEL_H
@@ -0,0 +1,43 @@
+#ifndef EVENTQUEUE_EVENT_CLOCK_H
+#define EVENTQUEUE_EVENT_CLOCK_H
+
+// Clocks used by event queues to schedule timers. Each queue has its own clock, which is either
+// the system's monotonic clock, or a virtual clock which only moves when the queue waits for it.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct EventClock {
+    // Get the current time of the clock, in microseconds.
+    uint64_t (*now_us)(void* context);
+
+    // Block until the clock reaches `deadline_us`. Returns immediately if it already has.
+    void (*sleep_until)(void* context, uint64_t deadline_us);
+
+    // Whether the clock is detached from wall time. An event queue never blocks waiting for I/O on
+    // behalf of a virtual clock, so that waiting for a timer jumps straight to its deadline.
+    bool is_virtual;
+
+    // Passed to `now_us` and `sleep_until`.
+    void* context;
+} EventClock;
+
+// A clock whose time only changes when advanced or slept on. Useful to run simulations of timer
+// traffic faster than real time, and deterministically.
+typedef struct VirtualClock {
+    uint64_t now_us;
+} VirtualClock;
+
+// Get the system monotonic clock. Event queues use this by default.
+EventClock event_clock_real(void);
+
+// Create a virtual clock, starting at `start_us`.
+VirtualClock virtual_clock_new(uint64_t start_us);
+
+// Move a virtual clock forward by `delta_us`.
+void virtual_clock_advance(VirtualClock* clock, uint64_t delta_us);
+
+// Get an `EventClock` which reads `clock`. `clock` must outlive every queue using it.
+EventClock event_clock_virtual(VirtualClock* clock);
+
+#endif // EVENTQUEUE_EVENT_CLOCK_H
@@ -0,0 +1,86 @@
+#ifndef EVENTQUEUE_EVENT_DATAGRAM_H
+#define EVENTQUEUE_EVENT_DATAGRAM_H
+
+// Batched datagram I/O over non-blocking sockets, such as UDP sockets. When readable, a socket is
+// drained with `recvmmsg` into a preallocated batch of buffers, and each batch is handed to a
+// function in one call. Datagrams sent are copied into a preallocated ring, and flushed with
+// `sendmmsg` just before the queue blocks, so that those sent by every callback in an iteration
+// leave together. Neither receiving nor sending allocates.
+
+#include "eventqueue.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/socket.h>
+
+// The default number of datagrams received with one `recvmmsg`, and queued to be sent.
+#define EVENT_DATAGRAM_DEFAULT_BATCH_SIZE 64
+
+// The default size of the buffer of each datagram. Larger datagrams are truncated when received,
+// and refused when sent.
+#define EVENT_DATAGRAM_DEFAULT_MAX_SIZE 2048
+
+// A datagram received, valid only for the duration of the call it's passed to.
+typedef struct EventDatagram {
+    const unsigned char* data;
+    size_t size;
+
+    // The sender's address.
+    const struct sockaddr* address;
+    socklen_t address_size;
+
+    // Whether the datagram was larger than the buffer, and cut short to `size` bytes.
+    bool is_truncated;
+} EventDatagram;
+
+typedef struct EventDatagramSocket EventDatagramSocket;
+
+// A function called with the `count` datagrams, at least one, received in one batch, in the order
+// they arrived.
+typedef void (*EventDatagramFunction)(
+    EventDatagramSocket* socket,
+    const EventDatagram* datagrams,
+    size_t count,
+    void* userdata
+);
+
+// Create a datagram socket over `fd`, which must be non-blocking. Up to `batch_size` datagrams of
+// up to `max_size` bytes each are received at a time, and queued to be sent. Received datagrams are
+// passed to `function(socket, datagrams, count, userdata)`. The socket doesn't take ownership of
+// `fd`. Errors receiving, such as ICMP errors reported on connected sockets, are ignored. Returns
+// NULL, with `errno` set to `ENOMEM`, if the queue is in real-time mode and has no room for the
+// socket's I/O event or hook, or to `EEXIST` if `fd` already has an I/O event.
+EventDatagramSocket* event_datagram_socket_new(
+    EventQueue* queue,
+    int fd,
+    size_t batch_size,
+    size_t max_size,
+    EventDatagramFunction function,
+    void* userdata
+);
+
+// Copy `size` bytes from `data` into a datagram queued to be sent to `address`, of `address_size`
+// bytes, or, if `address` is NULL, to the socket's connected peer. Queued datagrams are sent before
+// the queue next blocks, or sooner if the queue fills. Returns false, queueing nothing, if `size`
+// is more than the socket's maximum size, or if the queue is full and the socket can't take more;
+// like the network, callers should then drop the datagram, or retry later. A datagram which the
+// kernel refuses when sent, for example because its address is unreachable, is dropped.
+bool event_datagram_socket_send(
+    EventDatagramSocket* socket,
+    const void* data,
+    size_t size,
+    const struct sockaddr* address,
+    socklen_t address_size
+);
+
+// Send queued datagrams now, rather than before the queue blocks. Any the socket can't take yet are
+// sent once it's writable.
+void event_datagram_socket_flush(EventDatagramSocket* socket);
+
+// Get the number of datagrams queued to be sent.
+size_t event_datagram_socket_queued_count(const EventDatagramSocket* socket);
+
+// Free a datagram socket, discarding queued datagrams. The fd isn't closed. May be called from
+// within the socket's own function.
+void event_datagram_socket_free(EventDatagramSocket* socket);
+
+#endif // EVENTQUEUE_EVENT_DATAGRAM_H
@@ -0,0 +1,101 @@
+#ifndef EVENTQUEUE_EVENT_PIPELINE_H
+#define EVENTQUEUE_EVENT_PIPELINE_H
+
+// Staged pipelines. Items pushed into a pipeline pass through its stages in order, each stage
+// taking them from a bounded ring and handing its results to the next stage's. A stage is run, on
+// its queue, once per batch of items, rather than once per item, and is only run while the next
+// stage has room, so a stage which falls behind holds back the stages before it, and eventually the
+// source.
+//
+// Stages may run on different queues, on different threads. Each ring has one producer (the stage
+// before, or the source) and one consumer, and neither locks. Waking a stage on the same queue
+// triggers an event; waking one on another queue sends a message through an `EventChannel`, and
+// like other channels, keeps that queue waiting for messages while the pipeline exists.
+
+#include "eventqueue.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct EventPipeline EventPipeline;
+
+// The ID of a stage of a pipeline. Stages are numbered from 0, in order.
+typedef struct EventStageId {
+    uint32_t id;
+} EventStageId;
+
+// A function called with a batch of `count` items, at least one, in the order they were pushed.
+// Results are handed to the next stage with `event_pipeline_emit`. Returns the number of items
+// consumed, from the front of `items`: when emitting fails because the next stage is full, the
+// function should return the number consumed so far, and is passed the rest again once the next
+// stage has room. `items` is only valid for the duration of the call.
+typedef size_t (*EventStageFunction)(
+    EventPipeline* pipeline,
+    EventStageId stage,
+    void** items,
+    size_t count,
+    void* userdata
+);
+
+// Counters describing a stage. See `event_pipeline_get_stage_stats`.
+typedef struct EventStageStats {
+    const char* name;
+
+    // Items consumed by the stage, and the calls of its function which consumed them.
+    uint64_t item_count;
+    uint64_t batch_count;
+
+    // Times the stage was held back because the next stage was full.
+    uint64_t blocked_count;
+
+    // Items waiting for the stage, and how many it has room for.
+    size_t depth;
+    size_t capacity;
+} EventStageStats;
+
+// Create an empty pipeline, which items are pushed into from the `source` queue's thread. If
+// `ready` isn't NULL, `ready(userdata)` is called on the `source` queue when the first stage has
+// room again after `event_pipeline_push` failed. Returns NULL, with `errno` set to `ENOMEM`, if
+// `source` is in real-time mode and has no room for the event which calls `ready`.
+EventPipeline* event_pipeline_new(EventQueue* source, EventHookFunction ready, void* userdata);
+
+// Add a stage after the last, run on `queue`. Items wait for the stage in a ring with room for
+// `capacity` items, rounded up to a power of two, and are passed to
+// `function(pipeline, stage, items, count, userdata)` at most `batch_size` at a time. `name` is
+// copied, and reported in the stage's counters. Stages must be added before items are pushed, and
+// before the threads of their queues start using the pipeline. Returns an ID of
+// `EVENT_QUEUE_INVALID_ID`, with `errno` set to `ENOMEM`, adding nothing, if a queue is in
+// real-time mode and has no room for the stage's event or channels.
+EventStageId event_pipeline_add_stage(
+    EventPipeline* pipeline,
+    EventQueue* queue,
+    const char* name,
+    size_t capacity,
+    size_t batch_size,
+    EventStageFunction function,
+    void* userdata
+);
+
+// Push `item` into the first stage. Must be called on the source queue's thread. Returns false
+// without pushing if the first stage is full, or, with `errno` set to `ENOMEM`, if the first stage
+// is on the source queue, which is in real-time mode and has no room to run it.
+bool event_pipeline_push(EventPipeline* pipeline, void* item);
+
+// Hand `item` from `stage` to the stage after it. Must be called from within `stage`'s function.
+// Returns false without handing it on if the next stage is full, or if `stage` is the last, or as
+// `event_pipeline_push` if the next stage's queue has no room to run it.
+bool event_pipeline_emit(EventPipeline* pipeline, EventStageId stage, void* item);
+
+// Read a stage's counters. May be called from any thread; counters read while the pipeline is
+// running may each be from a slightly different moment.
+void event_pipeline_get_stage_stats(
+    const EventPipeline* pipeline,
+    EventStageId stage,
+    EventStageStats* out
+);
+
+// Free a pipeline, discarding items waiting in it. Must be called once no thread is running its
+// stages or pushing into it, on the thread which created it.
+void event_pipeline_free(EventPipeline* pipeline);
+
+#endif // EVENTQUEUE_EVENT_PIPELINE_H
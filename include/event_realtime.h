@@ -0,0 +1,51 @@
+#ifndef EVENTQUEUE_EVENT_REALTIME_H
+#define EVENTQUEUE_EVENT_REALTIME_H
+
+// Real-time mode, for loops which need deterministic latency. Entering it pins the calling thread
+// to a CPU, gives it a real-time scheduling priority, locks the process's memory, and faults in the
+// queue's tables up to their reserved capacity (see `event_queue_reserve`). While in real-time
+// mode, adding timers, events, I/O events and hooks, and triggering events, never allocates: when
+// the reserved capacity is used up, they fail instead (see `EVENT_QUEUE_INVALID_ID`). Events which
+// don't coalesce keep their pending triggers in storage reserved by `event_queue_set_event_limit`.
+//
+// Parts of the library which allocate as they go (work, fibers, channels, streams, file watches and
+// process events) should be set up before entering real-time mode.
+
+#include "eventqueue.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// The amount of stack prefaulted by `event_queue_enter_realtime`, unless otherwise configured.
+#define EVENT_REALTIME_DEFAULT_STACK_SIZE (256 * 1024)
+
+typedef struct EventRealtimeConfig {
+    // The CPU to pin the calling thread to, or -1 to leave its affinity unchanged.
+    int cpu;
+
+    // The `SCHED_FIFO` priority to give the calling thread (1 to 99), or 0 to leave its scheduling
+    // unchanged.
+    int priority;
+
+    // Whether to lock all current and future memory of the process into RAM, with `mlockall`.
+    bool lock_memory;
+
+    // The amount of the calling thread's stack to fault in, in bytes.
+    size_t stack_size;
+} EventRealtimeConfig;
+
+// A configuration which pins to no CPU, keeps the thread's scheduling, but locks memory and
+// prefaults `EVENT_REALTIME_DEFAULT_STACK_SIZE` of stack.
+EventRealtimeConfig event_realtime_config_default(void);
+
+// Apply `config` to the calling thread, which must be the one running the queue, prefault the
+// queue's tables, and enter real-time mode. Returns false, with `errno` set, if a step fails (e.g.
+// `EPERM` without `CAP_SYS_NICE` or `CAP_IPC_LOCK`), in which case the queue isn't in real-time
+// mode, but steps which succeeded aren't undone. Fails with `EINVAL`, before any step, if the queue
+// uses `timer_heap_kind_radix` (see `event_queue_set_timer_kind`).
+bool event_queue_enter_realtime(EventQueue* queue, const EventRealtimeConfig* config);
+
+// Leave real-time mode, so that tables grow as needed again. The thread's affinity, scheduling and
+// memory locking are left as they are.
+void event_queue_leave_realtime(EventQueue* queue);
+
+#endif // EVENTQUEUE_EVENT_REALTIME_H
@@ -0,0 +1,103 @@
+#ifndef EVENTQUEUE_EVENT_STREAM_H
+#define EVENTQUEUE_EVENT_STREAM_H
+
+// Buffered streams over non-blocking file descriptors. Data read from the fd is handed to a
+// function in pooled, reference-counted buffers without copying. Data written is queued as a list
+// of buffers, and flushed with `writev` whenever the fd is writable. High and low watermarks on the
+// amount of queued data let writers apply backpressure.
+
+#include "eventqueue.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// The default size of the buffers data is read into.
+#define EVENT_STREAM_DEFAULT_READ_BUFFER_SIZE (16 * 1024)
+
+// The default amount of queued output at which writes report backpressure.
+#define EVENT_STREAM_DEFAULT_HIGH_WATERMARK (64 * 1024)
+
+// The default amount of queued output at which a stream reports it has drained.
+#define EVENT_STREAM_DEFAULT_LOW_WATERMARK (16 * 1024)
+
+typedef struct EventBufferPool EventBufferPool;
+
+// A reference-counted buffer of bytes.
+typedef struct EventBuffer {
+    // The number of holders of the buffer. See `event_buffer_retain` and `event_buffer_release`.
+    size_t refcount;
+
+    // The number of bytes of `data` in use.
+    size_t size;
+
+    // The number of bytes `data` can hold.
+    size_t capacity;
+
+    // The pool the buffer returns to when released, if any.
+    EventBufferPool* pool;
+
+    unsigned char data[];
+} EventBuffer;
+
+typedef struct EventStream EventStream;
+
+typedef struct EventStreamCallbacks {
+    // Called with data read from the stream, in `buffer->data`. The stream releases `buffer` once
+    // this returns, so retain it to keep it for longer.
+    void (*on_read)(EventStream* stream, EventBuffer* buffer, void* userdata);
+
+    // Called when queued output falls to the low watermark, after it had reached the high
+    // watermark. May be NULL.
+    void (*on_drain)(EventStream* stream, void* userdata);
+
+    // Called when the end of the stream is reached (`error` is 0), or reading or writing fails
+    // (`error` is the errno value). Nothing more is read or written afterwards.
+    void (*on_close)(EventStream* stream, int error, void* userdata);
+} EventStreamCallbacks;
+
+// Create a buffer which is not pooled, able to hold `capacity` bytes, with a reference count of 1.
+EventBuffer* event_buffer_new(size_t capacity);
+
+// Add a reference to `buffer`.
+void event_buffer_retain(EventBuffer* buffer);
+
+// Remove a reference to `buffer`. When none remain, it returns to its pool, or is freed.
+void event_buffer_release(EventBuffer* buffer);
+
+// Create a stream reading from and writing to `fd`, which must be non-blocking. `callbacks` is
+// copied. The stream doesn't take ownership of `fd`. Applications should ignore `SIGPIPE`, so that
+// writes to a closed socket or pipe are reported to `on_close` instead. Returns NULL, with `errno`
+// set to `ENOMEM`, if the queue is in real-time mode and has no room for the stream's I/O event, or
+// to `EEXIST` if `fd` already has an I/O event.
+EventStream* event_stream_new(
+    EventQueue* queue,
+    int fd,
+    const EventStreamCallbacks* callbacks,
+    void* userdata
+);
+
+// Set the amount of queued output, in bytes, at which writes start to report backpressure
+// (`high`), and after which the stream reports it has drained (`low`).
+void event_stream_set_watermarks(EventStream* stream, size_t low, size_t high);
+
+// Get an empty buffer from the stream's pool, with a reference count of 1. Its capacity is the
+// stream's read buffer size.
+EventBuffer* event_stream_get_buffer(EventStream* stream);
+
+// Queue `buffer->data[0..buffer->size]` to be written, without copying. The stream retains the
+// buffer until it is written. Returns false if the amount of queued output has reached the high
+// watermark, in which case the caller should stop writing until `on_drain` is called. The data is
+// queued either way.
+bool event_stream_write(EventStream* stream, EventBuffer* buffer);
+
+// Copy `size` bytes from `data` into a buffer, and queue it to be written. See
+// `event_stream_write`.
+bool event_stream_write_copy(EventStream* stream, const void* data, size_t size);
+
+// Get the number of bytes queued to be written.
+size_t event_stream_queued_bytes(const EventStream* stream);
+
+// Free a stream, discarding queued output. The fd isn't closed. May be called from within the
+// stream's own callbacks.
+void event_stream_free(EventStream* stream);
+
+#endif // EVENTQUEUE_EVENT_STREAM_H
@@ -0,0 +1,51 @@
+#ifndef EVENTQUEUE_EVENT_TRACE_H
+#define EVENTQUEUE_EVENT_TRACE_H
+
+// Recording and replay of event queue traffic. A recording is a compact binary log of the timers,
+// events and I/O events added and removed, the events triggered, and everything dispatched, each
+// with the time of the queue's clock. Replaying a log reproduces the same sequence of calls against
+// a fresh queue on a virtual clock, as fast as possible.
+
+#include "eventqueue.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Statistics gathered by `event_trace_replay`.
+typedef struct EventTraceReport {
+    // Number of records read from the log.
+    uint64_t record_count;
+
+    // Number of records which were calls to the queue (adds, removes and triggers).
+    uint64_t call_count;
+
+    // Number of dispatches in the log.
+    uint64_t recorded_dispatch_count;
+
+    // Number of dispatches made by the replay.
+    uint64_t replayed_dispatch_count;
+
+    // Virtual time covered by the log, in microseconds.
+    uint64_t virtual_duration_us;
+
+    // Wall time taken by the replay, in nanoseconds.
+    uint64_t elapsed_ns;
+} EventTraceReport;
+
+// Start recording the calls to, and dispatches of, `queue` to `file`. Replaces any recording in
+// progress. Records are buffered by `file`.
+void event_queue_start_recording(EventQueue* queue, FILE* file);
+
+// Stop recording, and flush `file`. The file isn't closed.
+void event_queue_stop_recording(EventQueue* queue);
+
+// Replay the log in `file` against a fresh event queue, as fast as possible, and store statistics
+// in `report`. Timer, event and I/O event functions do nothing but count, and I/O readiness is
+// reproduced with pipes. Calls referring to things created before the recording started are
+// skipped. Returns false if `file` isn't a valid log.
+bool event_trace_replay(FILE* file, EventTraceReport* report);
+
+// Write a human-readable summary of `report`, including throughput, to `file`.
+void event_trace_print_report(const EventTraceReport* report, FILE* file);
+
+#endif // EVENTQUEUE_EVENT_TRACE_H
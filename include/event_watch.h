@@ -0,0 +1,49 @@
+#ifndef EVENTQUEUE_EVENT_WATCH_H
+#define EVENTQUEUE_EVENT_WATCH_H
+
+// File-change events. All watches on a queue share one inotify fd, which is registered as an I/O
+// event while any watch exists. Changes read together are coalesced, so a burst of writes to a file
+// results in one call per watch, with the kinds of change OR'd together.
+
+#include "eventqueue.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// A kind of change to a watched path.
+typedef enum FileWatchFlag {
+    // The file's contents were written to, or a file within the watched directory changed.
+    file_watch_flag_modified = (1 << 0),
+
+    // The file's metadata (permissions, timestamps, etc.) changed.
+    file_watch_flag_attributes = (1 << 1),
+
+    // The file was deleted or moved away. The watch reports nothing further: to follow a file
+    // which is replaced by renaming over it, watch the directory containing it instead.
+    file_watch_flag_removed = (1 << 2),
+} FileWatchFlag;
+
+// A function called when a watched path changes. `path` is the path given to
+// `event_queue_add_file_watch`, and `changes` is one or more FileWatchFlag values OR'd together.
+typedef void (*FileWatchFunction)(const char* path, uint32_t changes, void* userdata);
+
+// The ID of a file watch. Used to remove it.
+typedef struct FileWatchId {
+    uint32_t id;
+} FileWatchId;
+
+// Call `function(path, changes, userdata)` when the file or directory at `path` changes. The ID of
+// the watch is written to `out`. Returns false, with `errno` set, if `path` can't be watched, or to
+// `ENOMEM` if the queue is in real-time mode and has no room for the I/O event of its first watch.
+bool event_queue_add_file_watch(
+    EventQueue* queue,
+    const char* path,
+    FileWatchFunction function,
+    void* userdata,
+    FileWatchId* out
+);
+
+// Remove a file watch. Its function will not be called afterwards. May be called from within any
+// file watch's function.
+void event_queue_remove_file_watch(EventQueue* queue, FileWatchId id);
+
+#endif // EVENTQUEUE_EVENT_WATCH_H
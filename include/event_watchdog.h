@@ -0,0 +1,66 @@
+#ifndef EVENTQUEUE_EVENT_WATCHDOG_H
+#define EVENTQUEUE_EVENT_WATCHDOG_H
+
+// A watchdog thread which reports callbacks that run for too long. While a timer, event, I/O event
+// or task function runs, the queue publishes which one it is and when it started; the watchdog
+// checks this heartbeat several times per threshold, and reports each call which exceeds it once.
+
+#include "eventqueue.h"
+#include <pthread.h>
+#include <stdint.h>
+
+// A kind of function called by an event queue.
+typedef enum EventCallbackKind {
+    // A `TimerFunction`. The ID is a `TimerId`.
+    event_callback_kind_timer,
+
+    // An `EventFunction` or `EventBatchFunction`. The ID is an `EventId`.
+    event_callback_kind_event,
+
+    // An `EventIoFunction`. The ID is that of an `IoEventId`.
+    event_callback_kind_io_event,
+
+    // An `EventTaskFunction`. The ID is a `HookId`.
+    event_callback_kind_task,
+} EventCallbackKind;
+
+// A function of any type. Cast to the type given by the `EventCallbackKind` before calling.
+typedef void (*EventGenericFunction)(void);
+
+// A callback which has been running for longer than the watchdog's threshold.
+typedef struct EventStall {
+    EventCallbackKind kind;
+
+    // The function which is running.
+    EventGenericFunction function;
+
+    // The ID the function was registered with.
+    uint32_t id;
+
+    // How long the function has been running for, in microseconds of the system monotonic clock.
+    uint64_t running_us;
+
+    // The thread running the event queue. Send it a signal, with a handler which calls
+    // `backtrace`, to sample its stack.
+    pthread_t thread;
+} EventStall;
+
+// A function called on the watchdog thread when a stall is detected. Must be thread-safe.
+typedef void (*EventStallFunction)(const EventStall* stall, void* userdata);
+
+// Start a watchdog thread which calls `function(stall, userdata)` when a function called by the
+// queue runs for longer than `threshold_us`. Must be called on the thread which runs the queue, and
+// not from within any of the queue's functions. Replaces any watchdog already running.
+void event_queue_start_watchdog(
+    EventQueue* queue,
+    uint64_t threshold_us,
+    EventStallFunction function,
+    void* userdata
+);
+
+// Stop the queue's watchdog thread, if running. Waits for a call of its function to return. Must
+// not be called from within any of the queue's functions. The watchdog is stopped when the queue is
+// freed.
+void event_queue_stop_watchdog(EventQueue* queue);
+
+#endif // EVENTQUEUE_EVENT_WATCHDOG_H
@@ -2,8 +2,11 @@
 #define EVENT_QUEUE_H
 
 #include "timer_heap.h"
+#include "event_clock.h"
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
 
 // If the period of a timer is `UINT64_MAX` (approx. 500,000 years), it is considered aperiodic.
 #define TIMER_APERIODIC UINT64_MAX
@@ -15,8 +18,8 @@ typedef enum EventIoFlag {
     // Data is available to read on a device/stream without blocking.
     event_io_flag_read = (1 << 0),
 
-    // It is possible to write data to a device/stream without blocking. Unimplemented.
-    // event_io_flag_write = (1 << 1),
+    // It is possible to write data to a device/stream without blocking.
+    event_io_flag_write = (1 << 1),
 
     // An error occured in the device/stream. Unimplemented.
     // event_io_flag_error = (1 << 2),
@@ -27,33 +30,204 @@ typedef enum EventIoFlag {
 
 // A function called by an I/O event. `userdata` is the value given to `event_queue_add_io_event`,
 // `fd` is the corresponding file descriptor, and `flag` is the kind of event which triggered this call.
+// If several kinds of event occur at once, the function is called once for each.
 typedef void (*EventIoFunction)(int fd, EventIoFlag flag, void* userdata);
 
 // A function called by an internal event. `userdata` is provided when registering the event,
 // `eventdata` is passed when triggering the event.
 typedef void (*EventFunction)(void* userdata, void* eventdata);
 
+// A function called by a batch event. `userdata` is provided when registering the event, and
+// `eventdata` holds the `count` values passed to each trigger since the last call, in trigger
+// order. `eventdata` is only valid for the duration of the call.
+typedef void (*EventBatchFunction)(void* userdata, void** eventdata, size_t count);
+
+// A function which releases the `eventdata` of a trigger which is discarded instead of dispatched.
+// `userdata` is the event's. See `event_queue_set_event_destroy_function`.
+typedef void (*EventDestroyFunction)(void* userdata, void* eventdata);
+
+// A function called when a child process exits. `status` is as reported by `waitpid`, to be
+// inspected with `WIFEXITED`, `WEXITSTATUS` and related macros.
+typedef void (*ProcessExitFunction)(pid_t pid, int status, void* userdata);
+
+// A function run on a worker thread by `event_queue_submit_work`.
+typedef void (*WorkFunction)(void* userdata);
+
+// A function run on the event queue's thread once the associated `WorkFunction` has returned.
+typedef void (*WorkDoneFunction)(void* userdata);
+
+// A function called by a prepare or check hook. See `event_queue_add_prepare_hook`.
+typedef void (*EventHookFunction)(void* userdata);
+
+// A function called by an idle callback, which should return within `budget_us` microseconds. See
+// `event_queue_add_idle_callback`.
+typedef void (*EventIdleFunction)(void* userdata, uint64_t budget_us);
+
+// Whether a task has more work to do. See `EventTaskFunction`.
+typedef enum EventTaskStatus {
+    // The task is called again, in a later step.
+    event_task_status_more,
+
+    // The task is finished, and removed.
+    event_task_status_done,
+} EventTaskStatus;
+
+// A function called by a task to do one step of its work, which should return within `budget_us`
+// microseconds. See `event_queue_add_task`.
+typedef EventTaskStatus (*EventTaskFunction)(void* userdata, uint64_t budget_us);
+
+// What happens to a trigger which would take an event, or the queue, past its limit of pending
+// triggers. See `event_queue_set_event_limit` and `event_queue_set_pending_limit`.
+typedef enum EventOverflowPolicy {
+    // The trigger is refused, and `event_queue_trigger_event` returns false.
+    event_overflow_policy_reject,
+
+    // The oldest pending trigger (of the event, or, for the queue's limit, of any event) is dropped
+    // to make room.
+    event_overflow_policy_drop_oldest,
+
+    // The trigger is dropped, but `event_queue_trigger_event` still returns true.
+    event_overflow_policy_drop_newest,
+} EventOverflowPolicy;
+
+// A function called when the queue becomes overloaded (`is_overloaded` is true) or recovers.
+// `lag_us` is how late the timer or event being dispatched was. See
+// `event_queue_set_overload_function`.
+typedef void (*EventOverloadFunction)(bool is_overloaded, uint64_t lag_us, void* userdata);
+
 // The ID of a registered event. Used to remove and trigger events.
 typedef struct EventId {
     uint32_t id;
 } EventId;
 
-// The ID of a registered I/O event. Used to remove I/O events.
+// The ID of a registered I/O event. Used to modify and remove I/O events.
 typedef struct IoEventId {
     uint32_t id;
+    int fd;
 } IoEventId;
 
+// The ID of a registered hook, idle callback or task. Used to remove them.
+typedef struct HookId {
+    uint32_t id;
+} HookId;
+
 // Internal event information
 typedef struct Event Event;
 
 // Internal I/O event information
 typedef struct IoEvent IoEvent;
 
+// Internal hook information
+typedef struct Hook Hook;
+
+// Internal worker thread pool
+typedef struct WorkPool WorkPool;
+
+// Internal pool of fiber stacks
+typedef struct FiberPool FiberPool;
+
+// Internal receiving side of channels to this queue
+typedef struct ChannelHub ChannelHub;
+
+// Internal trace log writer
+typedef struct TraceRecorder TraceRecorder;
+
+// Internal inotify fd shared by file watches
+typedef struct FileWatcher FileWatcher;
+
+// Internal slow-callback watchdog thread
+typedef struct Watchdog Watchdog;
+
+// The total time, in microseconds, given to idle callbacks each time the queue is idle, unless
+// otherwise configured.
+#define EVENT_QUEUE_DEFAULT_IDLE_BUDGET_US 1000
+
+// The time, in microseconds, given to task steps each time the queue runs them, unless otherwise
+// configured.
+#define EVENT_QUEUE_DEFAULT_TASK_BUDGET_US 1000
+
+// The number of worker threads used by `event_queue_submit_work`, unless otherwise configured.
+#define EVENT_QUEUE_DEFAULT_WORK_THREADS 4
+
+// The ID returned by functions which add timers, events, I/O events and hooks when they can't,
+// which only happens in real-time mode (see `event_realtime.h`), or for an I/O event on an fd which
+// already has one. Never used by a valid ID.
+#define EVENT_QUEUE_INVALID_ID UINT32_MAX
+
+// The expiry of a trigger which never expires. See `event_queue_trigger_event_at`.
+#define EVENT_QUEUE_NO_EXPIRY UINT64_MAX
+
+// Tables with fewer entries than this are never shrunk automatically. See
+// `event_queue_set_auto_shrink`.
+#define EVENT_QUEUE_AUTO_SHRINK_MIN_CAPACITY 64
+
+// The size and memory use of one of an event queue's internal tables.
+typedef struct EventQueueTableUsage {
+    // The number of entries in use, and allocated.
+    size_t size;
+    size_t capacity;
+
+    // The bytes occupied by entries in use, and allocated in total.
+    size_t bytes_used;
+    size_t bytes_allocated;
+} EventQueueTableUsage;
+
+// The memory use of an event queue's internal tables. See `event_queue_get_memory_usage`.
+typedef struct EventQueueMemoryUsage {
+    EventQueueTableUsage timers;
+
+    // Includes the buffers of batch events and event waiters.
+    EventQueueTableUsage events;
+
+    // Includes the `pollfd` of each I/O event.
+    EventQueueTableUsage io_events;
+
+    // Indexed by fd. Its size is the highest registered fd, plus one.
+    EventQueueTableUsage io_fd_indices;
+
+    EventQueueTableUsage hooks;
+} EventQueueMemoryUsage;
+
+// Counters describing an event queue's load. See `event_queue_get_stats`. Times are measured by the
+// queue's clock.
+typedef struct EventQueueStats {
+    // Timers waiting to fire, and triggers of events waiting to be dispatched, including delayed
+    // triggers which aren't yet due. Triggers collapsed into one call count once, and those
+    // delivered as a batch count individually.
+    size_t timer_count;
+    size_t pending_event_count;
+
+    // Triggers dropped, or refused, because of pending-trigger limits.
+    uint64_t dropped_event_count;
+    uint64_t rejected_event_count;
+
+    // Triggers discarded because they expired before being dispatched.
+    uint64_t expired_event_count;
+
+    // How late the most recently dispatched timer or event was. Only measured while an overload
+    // function is set.
+    uint64_t lag_us;
+
+    // Registered I/O events.
+    size_t io_event_count;
+
+    // The number of polls which found I/O events ready, and the total number found ready by them.
+    uint64_t io_wakeup_count;
+    uint64_t io_ready_count;
+
+    // Time since the queue was created (or its clock set), and how much of it was spent blocked
+    // waiting for timers or I/O. The rest was spent in callbacks and the queue itself.
+    uint64_t elapsed_us;
+    uint64_t blocked_us;
+} EventQueueStats;
+
 // An event queue.
 typedef struct EventQueue {
     uint32_t next_timer_id;
+    uint32_t next_timer_group_id;
     uint32_t next_event_id;
     uint32_t next_io_event_id;
+    EventClock clock;
     TimerHeap timers;
     Event* events;
     size_t events_size;
@@ -62,11 +236,78 @@ typedef struct EventQueue {
     IoEvent* io_events;
     size_t io_events_size;
     size_t io_events_capacity;
+    size_t* io_fd_indices;
+    size_t io_fd_indices_capacity;
+    size_t io_events_removed_count;
+    bool is_dispatching_io;
+    uint32_t next_hook_id;
+    Hook* hooks;
+    size_t hooks_size;
+    size_t hooks_capacity;
+    bool is_running_hooks;
+    uint64_t idle_budget_us;
+    size_t next_idle_hook;
+    uint64_t task_budget_us;
+    uint64_t task_max_lateness_us;
+    size_t next_task_hook;
+    WorkPool* work_pool;
+    size_t work_thread_count;
+    IoEventId work_io_event;
+    bool is_watching_work;
+    FiberPool* fiber_pool;
+    ChannelHub* channel_hub;
+    TraceRecorder* recorder;
+    FileWatcher* file_watcher;
+    Watchdog* watchdog;
+    bool is_auto_shrinking;
+    bool is_realtime;
+    int backend_fd;
+    int backend_timer_fd;
+    uint64_t backend_timer_deadline;
+    bool is_backend_timer_armed;
+    size_t reserved_timers;
+    size_t reserved_events;
+    size_t reserved_io_events;
+    size_t scheduled_event_count;
+    size_t pending_event_count;
+    size_t internal_pending_event_count;
+    size_t pending_event_limit;
+    EventOverflowPolicy pending_overflow_policy;
+    uint64_t dropped_event_count;
+    uint64_t rejected_event_count;
+    uint64_t expired_event_count;
+    size_t delayed_event_count;
+    EventOverloadFunction overload_callback;
+    void* overload_userdata;
+    uint64_t overload_threshold_us;
+    uint64_t lag_us;
+    bool is_overloaded;
+    uint64_t io_wakeup_count;
+    uint64_t io_ready_count;
+    uint64_t created_us;
+    uint64_t blocked_us;
 } EventQueue;
 
-// Create a new event queue with no registered timers or events.
+// Create a new event queue with no registered timers or events, using the system monotonic clock.
 EventQueue event_queue_new(void);
 
+// Replace the clock used by the event queue to schedule timers. Must be called before any timers
+// are added or events triggered. See `event_clock.h`.
+void event_queue_set_clock(EventQueue* queue, EventClock clock);
+
+// Choose how the event queue orders its timers and triggered events. Defaults to
+// `timer_heap_kind_binary`. `timer_heap_kind_radix` makes adding and dispatching timers take
+// constant amortized time, however many there are. It relies on no timer being due before the last
+// one dispatched, which holds unless a group is rescheduled earlier than that; such timers are then
+// all due, and run in the order they were added. Its buckets grow as timers move between them, so
+// it can't be used in real-time mode. May be called at any time. Returns false, with `errno` set to
+// `EINVAL`, without changing the kind, if asked for `timer_heap_kind_radix` in real-time mode. See
+// `timer_heap.h`.
+bool event_queue_set_timer_kind(EventQueue* queue, TimerHeapKind kind);
+
+// Get the current time of the event queue's clock, in microseconds.
+uint64_t event_queue_now_us(const EventQueue* queue);
+
 // Add a one-shot timer to the event queue. `function(userdata)` will be called after `delay_us`
 // time has passed.
 TimerId event_queue_add_timer(
@@ -90,19 +331,121 @@ TimerId event_queue_add_periodic_timer(
 // called afterwards.
 void event_queue_remove_timer(EventQueue* queue, TimerId id);
 
+// Create a group of timers, which can be cancelled or rescheduled together. See
+// `event_queue_add_grouped_timer`.
+TimerGroupId event_queue_add_timer_group(EventQueue* queue);
+
+// Like `event_queue_add_periodic_timer`, but the timer belongs to `group`. Pass `TIMER_APERIODIC`
+// as `period_us` for a one-shot timer.
+TimerId event_queue_add_grouped_timer(
+    EventQueue* queue,
+    TimerGroupId group,
+    uint64_t delay_us,
+    uint64_t period_us,
+    TimerFunction function,
+    void* userdata
+);
+
+// Remove every timer in `group`. Takes a single pass over all timers, however many are removed. The
+// group may still be used afterwards. Does nothing for a group ID of 0, which isn't a group.
+void event_queue_cancel_group(EventQueue* queue, TimerGroupId group);
+
+// Move the deadline of every timer in `group` by `delta_us`: later if positive, earlier if
+// negative. Takes a single pass over all timers. Periodic timers continue at their period from the
+// new deadline. Does nothing for a group ID of 0.
+void event_queue_reschedule_group(EventQueue* queue, TimerGroupId group, int64_t delta_us);
+
 // Register an event with the event queue. See `event_queue_trigger_event`.
 EventId event_queue_add_event(EventQueue* queue, EventFunction function, void* userdata);
 
+// Register an event whose pending triggers collapse into one call. However many times the event is
+// triggered before it is processed, `function(userdata, eventdata)` is called once, with the
+// `eventdata` of the most recent trigger.
+EventId event_queue_add_collapsing_event(
+    EventQueue* queue,
+    EventFunction function,
+    void* userdata
+);
+
+// Register an event whose pending triggers are delivered together. However many times the event is
+// triggered before it is processed, `function(userdata, eventdata, count)` is called once, with the
+// `eventdata` of every pending trigger.
+EventId event_queue_add_batch_event(
+    EventQueue* queue,
+    EventBatchFunction function,
+    void* userdata
+);
+
 // Remove an event from the event queue. Unprocessed triggered events of this ID will not be
 // called. Future triggers for this ID will be ignored.
 void event_queue_remove_event(EventQueue* queue, EventId id);
 
 // Trigger an event with the given `id`. Will result in a call of `function(userdata, eventdata)`
-// given the event's function and userdata. (See `event_queue_add_event`).
-void event_queue_trigger_event(EventQueue* queue, EventId id, void* eventdata);
+// given the event's function and userdata. (See `event_queue_add_event`). Returns false if there is
+// no event with the given `id`, if a pending-trigger limit with the reject policy refuses it, or,
+// in real-time mode, if the trigger doesn't fit in the reserved capacity.
+bool event_queue_trigger_event(EventQueue* queue, EventId id, void* eventdata);
+
+// Trigger an event, as `event_queue_trigger_event`, but not before the queue's clock (see
+// `event_queue_now_us`) reaches `not_before_us`. Until then the trigger waits in the timer queue,
+// and isn't pending, so isn't counted against pending-trigger limits; they're applied when it
+// becomes due. If the trigger is still pending once the clock reaches `expires_us`, it's discarded
+// without calling the event's function. Pass `EVENT_QUEUE_NO_EXPIRY` for a trigger which never
+// expires. Returns false if there is no event with the given `id`, or, for a delayed trigger in
+// real-time mode, if it doesn't fit in the reserved timer capacity.
+bool event_queue_trigger_event_at(
+    EventQueue* queue,
+    EventId id,
+    void* eventdata,
+    uint64_t not_before_us,
+    uint64_t expires_us
+);
+
+// Set a function to release the `eventdata` of an event's triggers which are accepted but never
+// dispatched: those which expire, are dropped by a limit, are replaced in a collapsing event, or
+// are still pending when the event is removed or the queue freed. It must not call into the queue.
+// Pass NULL to stop.
+void event_queue_set_event_destroy_function(
+    EventQueue* queue,
+    EventId id,
+    EventDestroyFunction function
+);
+
+// Limit the number of pending triggers of an event to `limit`, with `policy` deciding what happens
+// to triggers beyond it. A limit of 0 removes it. Triggers collapsed into one call count once. For
+// events which don't coalesce, storage for `limit` triggers is allocated up front, so triggers
+// within the limit never allocate, even in real-time mode.
+void event_queue_set_event_limit(
+    EventQueue* queue,
+    EventId id,
+    size_t limit,
+    EventOverflowPolicy policy
+);
+
+// Limit the total number of pending triggers of all events to `limit`, with `policy` deciding what
+// happens to triggers beyond it. A limit of 0 removes it. An event's own limit applies first.
+// Dropping the oldest trigger of any event takes time proportional to the number of events. Events
+// the library adds for itself, such as those of pipelines, are neither limited nor counted.
+void event_queue_set_pending_limit(EventQueue* queue, size_t limit, EventOverflowPolicy policy);
+
+// Get the number of triggers of an event which were dropped, or refused, because of limits.
+uint64_t event_queue_get_event_drop_count(const EventQueue* queue, EventId id);
+
+// Call `function(true, lag_us, userdata)` when a timer or event is dispatched more than
+// `threshold_us` late, and `function(false, lag_us, userdata)` when one is next dispatched less
+// than half that late. Measuring lag reads the clock once per dispatch. Pass NULL to stop.
+void event_queue_set_overload_function(
+    EventQueue* queue,
+    uint64_t threshold_us,
+    EventOverloadFunction function,
+    void* userdata
+);
 
 // Given a `mask` (one or more EventIoFlag values OR'd together) and a file descriptor (`fd`),
-// trigger a call to `function(fd, flag, userdata)` when a corresponding I/O event occurs.
+// trigger a call to `function(fd, flag, userdata)` when a corresponding I/O event occurs. Only one
+// I/O event may be registered per file descriptor at a time. Adding, modifying and removing I/O
+// events takes constant time. Returns an ID of `EVENT_QUEUE_INVALID_ID`, with `errno` set to
+// `EEXIST` if `fd` already has an I/O event, or to `ENOMEM` if it doesn't fit in real-time mode.
 IoEventId event_queue_add_io_event(
     EventQueue* queue,
     int fd,
@@ -111,15 +454,130 @@ IoEventId event_queue_add_io_event(
     void* userdata
 );
 
-// Remove an I/O event (identified by `id`) from the event queue. Associated functions
+// Replace the mask of EventIoFlag values of an I/O event (identified by `id`).
+void event_queue_modify_io_event(EventQueue* queue, IoEventId id, uint32_t mask);
+
+// Remove an I/O event (identified by `id`) from the event queue. The associated function will not
+// be called afterwards. May be called from within any I/O event's function.
 void event_queue_remove_io_event(EventQueue* queue, IoEventId id);
 
+// Call `function(pid, status, userdata)` once, when the child process `pid` exits, after reaping
+// it. The process is watched through a pidfd, registered as an I/O event whose ID is written to
+// `out`; remove it with `event_queue_remove_io_event` to stop watching (the child is then left for
+// the caller to reap). Returns false, with `errno` set, if a pidfd can't be opened for `pid`, e.g.
+// because it doesn't exist or the kernel predates pidfds (Linux 5.3), or to `ENOMEM` if the queue
+// is in real-time mode and has no room for the I/O event.
+bool event_queue_add_process_event(
+    EventQueue* queue,
+    pid_t pid,
+    ProcessExitFunction function,
+    void* userdata,
+    IoEventId* out
+);
+
+// Register `function(userdata)` to be called each time `event_queue_wait` is about to block, for
+// example to flush output batched by other callbacks.
+HookId event_queue_add_prepare_hook(EventQueue* queue, EventHookFunction function, void* userdata);
+
+// Register `function(userdata)` to be called each time `event_queue_wait` wakes up after blocking.
+HookId event_queue_add_check_hook(EventQueue* queue, EventHookFunction function, void* userdata);
+
+// Register `function(userdata, budget_us)` to be called when `event_queue_wait` would block with no
+// I/O ready, for low-priority work. Idle callbacks share a budget of time each time the queue is
+// idle, and are called in turn until it is used up or the next timer is due. Idle callbacks alone
+// are not something to wait for: with nothing else registered, `event_queue_wait` returns false.
+HookId event_queue_add_idle_callback(EventQueue* queue, EventIdleFunction function, void* userdata);
+
+// Register `function(userdata, budget_us)` as a task: long-running work split into steps, which is
+// called repeatedly until it returns `event_task_status_done`. While tasks remain, the queue
+// doesn't block; instead, each `event_queue_wait` handles ready I/O, then calls task steps in turn
+// for up to the task budget. Steps stop before the next timer is due, or later than it by at most
+// the configured lateness, so timers are never delayed by more than that, provided steps return
+// within their `budget_us`. See `event_queue_set_task_budget`.
+HookId event_queue_add_task(EventQueue* queue, EventTaskFunction function, void* userdata);
+
+// Remove a hook, idle callback or task. May be called from within any hook or task.
+void event_queue_remove_hook(EventQueue* queue, HookId id);
+
+// Set the time shared by idle callbacks each time the queue is idle. Defaults to
+// `EVENT_QUEUE_DEFAULT_IDLE_BUDGET_US`.
+void event_queue_set_idle_budget(EventQueue* queue, uint64_t budget_us);
+
+// Set the time, in microseconds, given to task steps each time the queue runs them, and how late
+// they may make the next timer. `budget_us` must be non-zero. Defaults to
+// `EVENT_QUEUE_DEFAULT_TASK_BUDGET_US`, and a lateness of 0, so that steps stop at the next
+// deadline.
+void event_queue_set_task_budget(EventQueue* queue, uint64_t budget_us, uint64_t max_lateness_us);
+
+// Run `work(userdata)` on a worker thread, then call `done(userdata)` from `event_queue_wait` once
+// it has finished. `done` may be NULL. Worker threads are started by the first call, and there are
+// at most `work_thread_count` of them (see `event_queue_set_work_thread_count`). While submitted
+// work is outstanding, `event_queue_wait` waits for it to complete. Returns false, without
+// submitting, with `errno` set to `ENOMEM`, if the queue is in real-time mode and has no room for
+// the I/O event which watches for completions.
+bool event_queue_submit_work(
+    EventQueue* queue,
+    WorkFunction work,
+    WorkDoneFunction done,
+    void* userdata
+);
+
+// Set the number of worker threads used by `event_queue_submit_work`. Has no effect once work has
+// been submitted. Defaults to `EVENT_QUEUE_DEFAULT_WORK_THREADS`.
+void event_queue_set_work_thread_count(EventQueue* queue, size_t thread_count);
+
+// Store the queue's load counters in `out`. Counters are updated as the queue runs, so this takes
+// constant time.
+void event_queue_get_stats(const EventQueue* queue, EventQueueStats* out);
+
+// Store the size and memory use of each of the queue's internal tables in `out`.
+void event_queue_get_memory_usage(const EventQueue* queue, EventQueueMemoryUsage* out);
+
+// Grow the queue's tables so that `timers` timers and triggered events, `events` events and
+// `io_events` I/O events (on fds below `io_events`) fit without reallocating. Shrinking never
+// reduces a table below the reserved size. Reserving 0 clears a previous reservation.
+void event_queue_reserve(EventQueue* queue, size_t timers, size_t events, size_t io_events);
+
+// Reduce the capacity of the queue's tables to what is in use, or reserved. Must not be called from
+// within any of the queue's functions.
+void event_queue_shrink_to_fit(EventQueue* queue);
+
+// Enable or disable automatic shrinking. When enabled, each call of `event_queue_wait` halves the
+// capacity of the timer, event and I/O event tables which are at most a quarter full, down to
+// `EVENT_QUEUE_AUTO_SHRINK_MIN_CAPACITY` or the reserved size. The gap between growing when full
+// and shrinking when a quarter full avoids reallocating back and forth. Disabled by default.
+void event_queue_set_auto_shrink(EventQueue* queue, bool is_enabled);
+
+// If there are timers or triggered events waiting to be processed, store the earliest deadline
+// among them in `out` and return true. Otherwise, return false.
+bool event_queue_next_deadline(const EventQueue* queue, uint64_t* out);
+
 // If there are no events to wait for, return false immediately. Otherwise, wait until the next
 // event can be processed, process it, and return true.
 bool event_queue_wait(EventQueue* queue);
 
+// Like `event_queue_wait`, but blocks for at most `timeout_us`. Returns as soon as a timer or event
+// has been processed, I/O has been handled, or the timeout has passed. Returns true if anything was
+// processed, and false on timeout or if there is nothing to wait for.
+bool event_queue_wait_timeout(EventQueue* queue, uint64_t timeout_us);
+
+// Without blocking, process the timers and events which are due and the I/O which is ready, then
+// call prepare hooks, since the caller is about to block. Timers and events which become due while
+// processing are left for the next call. Returns true if anything was processed. Idle callbacks and
+// check hooks aren't called.
+bool event_queue_poll(EventQueue* queue);
+
+// Get a file descriptor which is readable whenever the queue has timers or events due, or I/O
+// ready, for embedding the queue in another event loop: wait for the fd to be readable, then call
+// `event_queue_poll`. The fd is an epoll fd watching the queue's I/O events and a timerfd armed for
+// its earliest timer, or straight away while tasks remain. It is created by the first call, and
+// closed when the queue is freed. With a virtual clock, timers only make the fd readable if they
+// were due when the queue was last called, so call `event_queue_poll` after advancing the clock.
+int event_queue_get_fd(EventQueue* queue);
+
 // Free all resources owned by the event queue. No timers or events will be called, and all IDs
-// become invalid.
+// become invalid. Stops any recording (see `event_trace.h`). Waits for running work to finish. Work
+// which has not started is discarded, and no `done` functions are called.
 void event_queue_free(EventQueue* queue);
 
 #endif // EVENT_QUEUE_H
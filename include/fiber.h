@@ -0,0 +1,43 @@
+#ifndef EVENTQUEUE_FIBER_H
+#define EVENTQUEUE_FIBER_H
+
+// Fibers: functions which run on their own stack, and can suspend themselves until a timer,
+// I/O event or internal event resumes them. This allows sequential code to wait without blocking
+// the event queue. Fibers only run from within `event_queue_wait`, on the queue's thread.
+
+#include "eventqueue.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// The size of each fiber's stack, in bytes. Rounded up to a whole number of pages.
+#define FIBER_STACK_SIZE (64 * 1024)
+
+// The function run by a fiber. The fiber finishes when it returns.
+typedef void (*FiberFunction)(void* userdata);
+
+// Start a fiber which runs `function(userdata)` from the next `event_queue_wait`. Stacks of
+// finished fibers are reused by later ones. Fibers which haven't finished when the queue is freed
+// are discarded without being resumed. Returns false, with `errno` set to `ENOMEM`, if the queue is
+// in real-time mode and has no room for the fiber's first timer.
+bool fiber_spawn(EventQueue* queue, FiberFunction function, void* userdata);
+
+// Suspend the calling fiber for `delay_us` microseconds. Must be called from a fiber, as must all
+// functions below. Returns false immediately, without suspending, with `errno` set to `ENOMEM`, if
+// the queue is in real-time mode and has no room for the timer which would resume the fiber.
+bool fiber_sleep_us(uint64_t delay_us);
+
+// Suspend the calling fiber until `fd` has data available to read without blocking. Returns false
+// like `fiber_sleep_us` if there is no room for the I/O event, or, with `errno` set to `EEXIST`, if
+// `fd` already has an I/O event.
+bool fiber_wait_readable(int fd);
+
+// Suspend the calling fiber until the event `id` is next dispatched, and store the `eventdata` it
+// is dispatched with in `eventdata`. Returns false immediately if there is no such event. A fiber
+// waiting on an event which is removed is never resumed.
+bool fiber_wait_event(EventId id, void** eventdata);
+
+// Suspend the calling fiber, allowing other timers, events and fibers to run, then resume it.
+// Returns false like `fiber_sleep_us`.
+bool fiber_yield(void);
+
+#endif // EVENTQUEUE_FIBER_H
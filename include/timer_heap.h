@@ -11,13 +11,25 @@ typedef struct TimerId {
     uint32_t id;
 } TimerId;
 
+typedef struct TimerGroupId {
+    uint32_t id;
+} TimerGroupId;
+
 typedef struct Timer {
     // Whether this timer is for an event firing, and not a timer.
     bool is_event;
 
+    // For events, whether this is a delayed trigger, not pending until its deadline, rather than
+    // the event's dispatch. Its `userdata` is then the trigger's `eventdata`, and `period` its
+    // expiry.
+    bool is_delayed_trigger;
+
     // The ID of the timer. For events, the ID of the event.
     uint32_t id;
 
+    // The ID of the group the timer belongs to, or 0 if none. Always 0 for events.
+    uint32_t group;
+
     // When the timer should be fired next. For events, its the scheduled deadline of the event.
     uint64_t deadline;
 
@@ -31,17 +43,45 @@ typedef struct Timer {
     void* userdata;
 } Timer;
 
+// How a `TimerHeap` orders its timers. Either way, `data` holds every timer, in no particular
+// order.
+typedef enum TimerHeapKind {
+    // A binary heap. Inserting and taking timers takes O(log n) time.
+    timer_heap_kind_binary,
+
+    // A radix heap, which relies on timers being taken in deadline order, and never inserted with a
+    // deadline earlier than the last one taken (any which are, are ordered as if due at that time).
+    // Inserting takes O(1) time, and taking O(1) amortized time, since each timer moves between at
+    // most 64 buckets, towards the front, over its lifetime.
+    timer_heap_kind_radix,
+} TimerHeapKind;
+
+// Internal radix heap buckets.
+typedef struct TimerRadix TimerRadix;
+
 typedef struct TimerHeap {
     Timer* data;
     size_t size;
     size_t capacity;
+    TimerHeapKind kind;
+
+    // NULL unless `kind` is `timer_heap_kind_radix`.
+    TimerRadix* radix;
 } TimerHeap;
 
 TimerHeap timer_heap_new(void);
+void timer_heap_set_kind(TimerHeap* heap, TimerHeapKind kind);
 void timer_heap_insert(TimerHeap* heap, Timer timer);
 const Timer* timer_heap_find(const TimerHeap* heap);
 bool timer_heap_take(TimerHeap* heap, Timer* out);
 void timer_heap_remove_id(TimerHeap* heap, TimerId id);
+size_t timer_heap_remove_group(TimerHeap* heap, TimerGroupId group);
+size_t timer_heap_remove_delayed_triggers(TimerHeap* heap, uint32_t event_id);
+void timer_heap_shift_group(TimerHeap* heap, TimerGroupId group, int64_t delta);
+void timer_heap_reserve(TimerHeap* heap, size_t capacity);
+void timer_heap_shrink(TimerHeap* heap, size_t capacity);
+size_t timer_heap_entry_size(const TimerHeap* heap);
+void timer_heap_prefault(TimerHeap* heap);
 void timer_heap_free(TimerHeap* heap);
 
 #endif // EVENTQUEUE_TIMER_HEAP_H
@@ -0,0 +1,11 @@
+#ifndef EVENTQUEUE_CHANNEL_HUB_H
+#define EVENTQUEUE_CHANNEL_HUB_H
+
+// The receiving side of all channels to an event queue.
+
+#include "eventqueue.h"
+
+// Free every channel to `queue`, and the doorbell they share.
+void channel_hub_free(ChannelHub* hub);
+
+#endif // EVENTQUEUE_CHANNEL_HUB_H
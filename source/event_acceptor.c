@@ -0,0 +1,183 @@
+#define _GNU_SOURCE // For `accept4`
+#include "event_acceptor.h"
+#include "eventqueue_internal.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// How long to stop accepting for when out of fds or memory.
+#define ACCEPT_RETRY_DELAY_US 100000
+
+// A listening socket. Owned by its I/O event.
+typedef struct Acceptor {
+    EventQueue* queue;
+    IoEventId io_event;
+    EventAcceptFunction callback;
+    void* userdata;
+    int fd;
+
+    // Destroying is deferred while the function is running, so it can remove the acceptor without
+    // the loop accepting from a closed fd.
+    bool is_in_callback;
+    bool is_removed;
+
+    // Set while the socket isn't watched, after running out of fds or memory, until the timer
+    // watches it again.
+    bool is_paused;
+    TimerId retry_timer;
+} Acceptor;
+
+static void free_acceptor_unchecked(Acceptor* acceptor) {
+    if (acceptor->is_paused) {
+        event_queue_remove_timer(acceptor->queue, acceptor->retry_timer);
+    }
+
+    close(acceptor->fd);
+    free(acceptor);
+}
+
+static void destroy_acceptor(void* userdata) {
+    Acceptor* acceptor = userdata;
+
+    if (acceptor->is_in_callback) {
+        acceptor->is_removed = true;
+    } else {
+        free_acceptor_unchecked(acceptor);
+    }
+}
+
+// Whether `accept4` failed because of the connection it was accepting, so the next one may still
+// be accepted. Linux passes on a connection's pending network errors this way.
+static bool is_connection_error(int error) {
+    switch (error) {
+        case EINTR:
+        case ECONNABORTED:
+        case EPROTO:
+        case ENETDOWN:
+        case ENOPROTOOPT:
+        case EHOSTDOWN:
+        case ENONET:
+        case EHOSTUNREACH:
+        case EOPNOTSUPP:
+        case ENETUNREACH:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+// Whether `accept4` failed because the process or system is out of fds or memory.
+static bool is_resource_error(int error) {
+    return error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM;
+}
+
+static void resume_accepting(void* userdata) {
+    Acceptor* acceptor = userdata;
+    acceptor->is_paused = false;
+    event_queue_modify_io_event(acceptor->queue, acceptor->io_event, event_io_flag_read);
+}
+
+// Stop watching the socket for a while. It stays readable until a connection is accepted, so the
+// queue would otherwise call the acceptor again straight away, until resources are freed.
+static void pause_accepting(Acceptor* acceptor) {
+    acceptor->retry_timer = event_queue_add_timer(
+        acceptor->queue, ACCEPT_RETRY_DELAY_US, resume_accepting, acceptor);
+
+    if (acceptor->retry_timer.id == EVENT_QUEUE_INVALID_ID) {
+        return; // In real-time mode, without room. Keeps watching instead.
+    }
+
+    acceptor->is_paused = true;
+    event_queue_modify_io_event(acceptor->queue, acceptor->io_event, 0);
+}
+
+// Accept every waiting connection. If out of fds or memory, stops, and tries again after
+// `ACCEPT_RETRY_DELAY_US`.
+static void on_acceptor_readable(int fd, EventIoFlag flag, void* userdata) {
+    (void)flag;
+    Acceptor* acceptor = userdata;
+
+    while (true) {
+        struct sockaddr_storage address;
+        socklen_t address_size = sizeof(address);
+
+        int client = accept4(
+            fd, (struct sockaddr*)&address, &address_size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (client >= 0) {
+            acceptor->is_in_callback = true;
+            (*acceptor->callback)(
+                client, (const struct sockaddr*)&address, address_size, acceptor->userdata);
+            acceptor->is_in_callback = false;
+
+            if (acceptor->is_removed) {
+                free_acceptor_unchecked(acceptor);
+                return;
+            }
+        } else if (is_resource_error(errno)) {
+            pause_accepting(acceptor);
+            return;
+        } else if (!is_connection_error(errno)) {
+            return; // EAGAIN once every waiting connection is accepted.
+        }
+    }
+}
+
+bool event_queue_add_acceptor(
+    EventQueue* queue,
+    struct sockaddr* address,
+    socklen_t address_size,
+    EventAcceptFunction function,
+    void* userdata,
+    IoEventId* out
+) {
+    int fd = socket(address->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    int enable = 1;
+    bool is_listening =
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) == 0
+        && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == 0
+        && bind(fd, address, address_size) == 0
+        && listen(fd, SOMAXCONN) == 0
+        && getsockname(fd, address, &address_size) == 0;
+
+    if (!is_listening) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return false;
+    }
+
+    Acceptor* acceptor = malloc(sizeof(Acceptor));
+    if (acceptor == NULL) abort();
+
+    *acceptor = (Acceptor){
+        .queue = queue,
+        .io_event = { .id = EVENT_QUEUE_INVALID_ID, .fd = fd },
+        .callback = function,
+        .userdata = userdata,
+        .fd = fd,
+        .is_in_callback = false,
+        .is_removed = false,
+        .is_paused = false,
+        .retry_timer = { .id = EVENT_QUEUE_INVALID_ID },
+    };
+
+    IoEventId id = event_queue_add_owned_io_event(
+        queue, fd, event_io_flag_read, on_acceptor_readable, destroy_acceptor, acceptor);
+
+    if (id.id == EVENT_QUEUE_INVALID_ID) {
+        int error = errno;
+        destroy_acceptor(acceptor); // Not owned by the queue, since it wasn't added.
+        errno = error;
+        return false;
+    }
+
+    acceptor->io_event = id;
+    *out = id;
+    return true;
+}
@@ -0,0 +1,199 @@
+#define _GNU_SOURCE // For `accept4`
+#include "event_admin.h"
+#include "eventqueue_internal.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define LISTEN_BACKLOG 16
+
+// A listening admin socket. Owned by its I/O event.
+typedef struct AdminEndpoint {
+    EventQueue* queue;
+    int fd;
+    struct sockaddr_un address;
+} AdminEndpoint;
+
+static void destroy_admin_endpoint(void* userdata) {
+    AdminEndpoint* endpoint = userdata;
+
+    close(endpoint->fd);
+    unlink(endpoint->address.sun_path);
+    free(endpoint);
+}
+
+// Append a metric, with its help text and type, to `buffer` at `*length`.
+static void append_metric(
+    char* buffer,
+    size_t size,
+    size_t* length,
+    const char* name,
+    const char* type,
+    const char* help,
+    const char* value
+) {
+    if (*length >= size) {
+        return;
+    }
+
+    int written = snprintf(
+        &buffer[*length], size - *length,
+        "# HELP %s %s\n# TYPE %s %s\n%s %s\n",
+        name, help, name, type, name, value);
+
+    if (written > 0) {
+        *length += (size_t)written;
+    }
+}
+
+static void append_count(
+    char* buffer,
+    size_t size,
+    size_t* length,
+    const char* name,
+    const char* type,
+    const char* help,
+    uint64_t count
+) {
+    char value[24];
+    snprintf(value, sizeof(value), "%" PRIu64, count);
+    append_metric(buffer, size, length, name, type, help, value);
+}
+
+static void append_seconds(
+    char* buffer,
+    size_t size,
+    size_t* length,
+    const char* name,
+    const char* help,
+    uint64_t microseconds
+) {
+    char value[32];
+    snprintf(value, sizeof(value), "%" PRIu64 ".%06" PRIu64,
+        microseconds / 1000000, microseconds % 1000000);
+    append_metric(buffer, size, length, name, "counter", help, value);
+}
+
+size_t event_queue_format_stats(const EventQueue* queue, char* buffer, size_t size) {
+    EventQueueStats stats;
+    event_queue_get_stats(queue, &stats);
+
+    uint64_t busy_us = (stats.elapsed_us > stats.blocked_us)
+        ? (stats.elapsed_us - stats.blocked_us)
+        : 0;
+
+    size_t length = 0;
+    if (size > 0) {
+        buffer[0] = '\0';
+    }
+
+    append_count(buffer, size, &length, "eventqueue_timers", "gauge",
+        "Timers waiting to fire.", stats.timer_count);
+    append_count(buffer, size, &length, "eventqueue_pending_events", "gauge",
+        "Triggered events waiting to be dispatched.", stats.pending_event_count);
+    append_count(buffer, size, &length, "eventqueue_dropped_events_total", "counter",
+        "Event triggers dropped because of pending-trigger limits.", stats.dropped_event_count);
+    append_count(buffer, size, &length, "eventqueue_rejected_events_total", "counter",
+        "Event triggers refused because of pending-trigger limits.", stats.rejected_event_count);
+    append_count(buffer, size, &length, "eventqueue_expired_events_total", "counter",
+        "Event triggers discarded because they expired before being dispatched.",
+        stats.expired_event_count);
+    append_count(buffer, size, &length, "eventqueue_io_events", "gauge",
+        "Registered I/O events.", stats.io_event_count);
+    append_count(buffer, size, &length, "eventqueue_io_wakeups_total", "counter",
+        "Polls which found I/O events ready.", stats.io_wakeup_count);
+    append_count(buffer, size, &length, "eventqueue_io_ready_total", "counter",
+        "I/O events found ready, over all polls. Divide by wakeups for ready fds per wakeup.",
+        stats.io_ready_count);
+    append_seconds(buffer, size, &length, "eventqueue_blocked_seconds_total",
+        "Time spent blocked waiting for timers or I/O.", stats.blocked_us);
+    append_seconds(buffer, size, &length, "eventqueue_busy_seconds_total",
+        "Time spent running callbacks and the queue itself.", busy_us);
+
+    return (length < size) ? length : (size > 0 ? size - 1 : 0);
+}
+
+// Serve each waiting client, then close its connection. Clients aren't read from, and the gauges
+// fit in a socket's send buffer, so nothing is kept between calls.
+static void on_admin_client(int fd, EventIoFlag flag, void* userdata) {
+    (void)flag;
+    AdminEndpoint* endpoint = userdata;
+
+    char buffer[EVENT_ADMIN_MAX_STATS_SIZE];
+    size_t length = 0;
+    bool is_formatted = false;
+
+    while (true) {
+        int client = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client < 0) {
+            return; // EAGAIN once every waiting client is served.
+        }
+
+        // All clients accepted together get the same snapshot.
+        if (!is_formatted) {
+            length = event_queue_format_stats(endpoint->queue, buffer, sizeof(buffer));
+            is_formatted = true;
+        }
+
+        ssize_t status = send(client, buffer, length, MSG_NOSIGNAL);
+        (void)status; // A client which went away, or stopped reading, misses out.
+
+        close(client);
+    }
+}
+
+bool event_queue_serve_admin(EventQueue* queue, const char* path, IoEventId* out) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    if (bind(fd, (const struct sockaddr*)&address, sizeof(address)) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return false;
+    }
+
+    if (listen(fd, LISTEN_BACKLOG) != 0) {
+        int error = errno;
+        close(fd);
+        unlink(path);
+        errno = error;
+        return false;
+    }
+
+    AdminEndpoint* endpoint = malloc(sizeof(AdminEndpoint));
+    if (endpoint == NULL) abort();
+
+    *endpoint = (AdminEndpoint){
+        .queue = queue,
+        .fd = fd,
+        .address = address,
+    };
+
+    IoEventId id = event_queue_add_owned_io_event(
+        queue, fd, event_io_flag_read, on_admin_client, destroy_admin_endpoint, endpoint);
+
+    if (id.id == EVENT_QUEUE_INVALID_ID) {
+        int error = errno;
+        destroy_admin_endpoint(endpoint); // Not owned by the queue, since it wasn't added.
+        errno = error;
+        return false;
+    }
+
+    *out = id;
+    return true;
+}
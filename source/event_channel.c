@@ -0,0 +1,312 @@
+#include "event_channel.h"
+#include "channel_hub.h"
+#include <errno.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// Keeps the producer's and consumer's indices on separate cache lines.
+#define CACHE_LINE_SIZE 64
+
+struct EventChannel {
+    ChannelHub* hub;
+    EventChannelFunction callback;
+    void* userdata;
+
+    void** messages;
+    size_t mask;
+
+    // The doorbell of the destination queue. Copied here so the producer doesn't touch the hub.
+    int doorbell_fd;
+
+    // Set when freed while the hub is delivering messages. Freed once it's done.
+    bool is_removed;
+
+    // The index of the next message to receive. Written by the consumer.
+    alignas(CACHE_LINE_SIZE) atomic_size_t head;
+
+    // The index of the next message to send. Written by the producer.
+    alignas(CACHE_LINE_SIZE) atomic_size_t tail;
+};
+
+// Definition of typedef struct ChannelHub ChannelHub (in eventqueue.h):
+struct ChannelHub {
+    EventQueue* queue;
+    int doorbell_fd;
+    IoEventId doorbell_io_event;
+
+    EventChannel** channels;
+    size_t channels_size;
+    size_t channels_capacity;
+
+    // Set while delivering messages, so that channels freed by their functions keep their places.
+    bool is_delivering;
+};
+
+static void ring_doorbell(int doorbell_fd) {
+    uint64_t one = 1;
+    ssize_t written = write(doorbell_fd, &one, sizeof(one));
+    (void)written; // Can only fail if the counter overflows, in which case it's readable anyway.
+}
+
+static size_t round_up_to_power_of_two(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result *= 2;
+    }
+    return result;
+}
+
+// Deliver up to `limit` messages from `channel` in batches. Returns true if the channel still has
+// messages afterwards.
+static bool drain_channel(EventChannel* channel, size_t limit) {
+    size_t head = atomic_load_explicit(&channel->head, memory_order_relaxed);
+    size_t delivered = 0;
+
+    while (true) {
+        size_t tail = atomic_load_explicit(&channel->tail, memory_order_acquire);
+
+        if (head == tail) {
+            // Publish the head, then check the tail again. The producer publishes its tail before
+            // checking the head, so either it sees the ring as empty and rings the doorbell, or
+            // this sees its message.
+            atomic_store_explicit(&channel->head, head, memory_order_release);
+            atomic_thread_fence(memory_order_seq_cst);
+
+            tail = atomic_load_explicit(&channel->tail, memory_order_relaxed);
+            if (head == tail) {
+                return false;
+            }
+        }
+
+        if (delivered >= limit) {
+            atomic_store_explicit(&channel->head, head, memory_order_release);
+            return true;
+        }
+
+        // Deliver the contiguous run of messages starting at the head, without copying them.
+        size_t start = head & channel->mask;
+        size_t count = tail - head;
+        size_t until_wrap = channel->mask + 1 - start;
+
+        if (count > until_wrap) count = until_wrap;
+        if (count > EVENT_CHANNEL_BATCH_SIZE) count = EVENT_CHANNEL_BATCH_SIZE;
+
+        (*channel->callback)(channel->userdata, &channel->messages[start], count);
+
+        if (channel->is_removed) {
+            return false;
+        }
+
+        head += count;
+        delivered += count;
+
+        // Free the slots for the producer as soon as possible.
+        atomic_store_explicit(&channel->head, head, memory_order_release);
+    }
+}
+
+static void free_channel_unchecked(EventChannel* channel) {
+    free(channel->messages);
+    free(channel);
+}
+
+void channel_hub_free(ChannelHub* hub) {
+    for (size_t i = 0; i < hub->channels_size; i++) {
+        free_channel_unchecked(hub->channels[i]);
+    }
+
+    event_queue_remove_io_event(hub->queue, hub->doorbell_io_event);
+    close(hub->doorbell_fd);
+    free(hub->channels);
+    free(hub);
+}
+
+// Stop waiting on the doorbell once there are no channels, so that an otherwise idle queue can
+// return from `event_queue_wait`. Returns true if the hub was freed.
+static bool free_hub_if_empty(ChannelHub* hub) {
+    if (hub->channels_size > 0) {
+        return false;
+    }
+
+    hub->queue->channel_hub = NULL;
+    channel_hub_free(hub);
+    return true;
+}
+
+static void on_doorbell(int fd, EventIoFlag flag, void* userdata) {
+    (void)flag;
+
+    ChannelHub* hub = userdata;
+
+    uint64_t count;
+    ssize_t status = read(fd, &count, sizeof(count));
+    (void)status; // EAGAIN when there's nothing to read, which is fine.
+
+    bool has_remaining = false;
+    bool was_delivering = hub->is_delivering;
+    hub->is_delivering = true;
+
+    for (size_t i = 0; i < hub->channels_size; i++) {
+        // Bound the work done per channel, so that one busy channel can't starve the rest of the
+        // queue. Remaining messages are delivered after the queue's other work.
+        EventChannel* channel = hub->channels[i];
+        if (!channel->is_removed) {
+            has_remaining |= drain_channel(channel, channel->mask + 1);
+        }
+    }
+
+    // Only the outermost delivery frees channels, if a function dispatched I/O itself.
+    hub->is_delivering = was_delivering;
+
+    if (!was_delivering) {
+        size_t kept = 0;
+        for (size_t i = 0; i < hub->channels_size; i++) {
+            if (hub->channels[i]->is_removed) {
+                free_channel_unchecked(hub->channels[i]);
+            } else {
+                hub->channels[kept] = hub->channels[i];
+                kept += 1;
+            }
+        }
+        hub->channels_size = kept;
+
+        if (free_hub_if_empty(hub)) {
+            return;
+        }
+    }
+
+    if (has_remaining) {
+        ring_doorbell(hub->doorbell_fd);
+    }
+}
+
+static ChannelHub* channel_hub_new(EventQueue* queue) {
+    ChannelHub* hub = malloc(sizeof(ChannelHub));
+    if (hub == NULL) abort();
+
+    EventChannel** channels = malloc(sizeof(EventChannel*));
+    if (channels == NULL) abort();
+
+    int doorbell_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (doorbell_fd < 0) abort();
+
+    *hub = (ChannelHub){
+        .queue = queue,
+        .doorbell_fd = doorbell_fd,
+        .channels = channels,
+        .channels_size = 0,
+        .channels_capacity = 1,
+        .is_delivering = false,
+    };
+
+    hub->doorbell_io_event = event_queue_add_io_event(
+        queue, doorbell_fd, event_io_flag_read, on_doorbell, hub);
+
+    if (hub->doorbell_io_event.id == EVENT_QUEUE_INVALID_ID) {
+        int error = errno;
+        close(doorbell_fd);
+        free(channels);
+        free(hub);
+        errno = error;
+        return NULL;
+    }
+
+    return hub;
+}
+
+EventChannel* event_channel_new(
+    EventQueue* destination,
+    size_t capacity,
+    EventChannelFunction callback,
+    void* userdata
+) {
+    if (destination->channel_hub == NULL) {
+        destination->channel_hub = channel_hub_new(destination);
+
+        if (destination->channel_hub == NULL) {
+            return NULL; // With `errno` set.
+        }
+    }
+
+    ChannelHub* hub = destination->channel_hub;
+
+    capacity = round_up_to_power_of_two(capacity);
+
+    void** messages = malloc(sizeof(void*) * capacity);
+    if (messages == NULL) abort();
+
+    EventChannel* channel = aligned_alloc(alignof(EventChannel), sizeof(EventChannel));
+    if (channel == NULL) abort();
+
+    *channel = (EventChannel){
+        .hub = hub,
+        .callback = callback,
+        .userdata = userdata,
+        .messages = messages,
+        .mask = capacity - 1,
+        .doorbell_fd = hub->doorbell_fd,
+        .is_removed = false,
+    };
+    atomic_init(&channel->head, 0);
+    atomic_init(&channel->tail, 0);
+
+    if (hub->channels_size == hub->channels_capacity) {
+        hub->channels_capacity *= 2;
+        hub->channels = realloc(hub->channels, sizeof(EventChannel*) * hub->channels_capacity);
+        if (hub->channels == NULL) abort();
+    }
+
+    hub->channels[hub->channels_size] = channel;
+    hub->channels_size += 1;
+
+    return channel;
+}
+
+bool event_channel_send(EventChannel* channel, void* message) {
+    size_t tail = atomic_load_explicit(&channel->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&channel->head, memory_order_acquire);
+
+    if (tail - head > channel->mask) {
+        return false; // Full.
+    }
+
+    channel->messages[tail & channel->mask] = message;
+    atomic_store_explicit(&channel->tail, tail + 1, memory_order_release);
+
+    // Only ring the doorbell if the consumer had received everything before this message. See
+    // `drain_channel` for the other half of this handshake.
+    atomic_thread_fence(memory_order_seq_cst);
+    head = atomic_load_explicit(&channel->head, memory_order_relaxed);
+
+    if (head == tail) {
+        ring_doorbell(channel->doorbell_fd);
+    }
+
+    return true;
+}
+
+void event_channel_free(EventChannel* channel) {
+    ChannelHub* hub = channel->hub;
+
+    // Freed once the hub has finished delivering, so that the channels it's going through don't
+    // move under it.
+    if (hub->is_delivering) {
+        channel->is_removed = true;
+        return;
+    }
+
+    for (size_t i = 0; i < hub->channels_size; i++) {
+        if (hub->channels[i] == channel) {
+            hub->channels[i] = hub->channels[hub->channels_size - 1];
+            hub->channels_size -= 1;
+            break;
+        }
+    }
+
+    free_channel_unchecked(channel);
+    free_hub_if_empty(hub);
+}
@@ -0,0 +1,54 @@
+#include "event_clock.h"
+#include "eq_time.h"
+#include <stddef.h>
+
+static uint64_t real_clock_now_us(void* context) {
+    (void)context;
+    return time_now_us();
+}
+
+static void real_clock_sleep_until(void* context, uint64_t deadline_us) {
+    (void)context;
+    time_sleep_until(deadline_us);
+}
+
+static uint64_t virtual_clock_now_us(void* context) {
+    VirtualClock* clock = context;
+    return clock->now_us;
+}
+
+static void virtual_clock_sleep_until(void* context, uint64_t deadline_us) {
+    VirtualClock* clock = context;
+
+    if (clock->now_us < deadline_us) {
+        clock->now_us = deadline_us;
+    }
+}
+
+EventClock event_clock_real(void) {
+    return (EventClock){
+        .now_us = real_clock_now_us,
+        .sleep_until = real_clock_sleep_until,
+        .is_virtual = false,
+        .context = NULL,
+    };
+}
+
+VirtualClock virtual_clock_new(uint64_t start_us) {
+    return (VirtualClock){
+        .now_us = start_us,
+    };
+}
+
+void virtual_clock_advance(VirtualClock* clock, uint64_t delta_us) {
+    clock->now_us += delta_us;
+}
+
+EventClock event_clock_virtual(VirtualClock* clock) {
+    return (EventClock){
+        .now_us = virtual_clock_now_us,
+        .sleep_until = virtual_clock_sleep_until,
+        .is_virtual = true,
+        .context = clock,
+    };
+}
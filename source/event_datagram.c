@@ -0,0 +1,306 @@
+#define _GNU_SOURCE // For `recvmmsg` and `sendmmsg`
+#include "event_datagram.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+// The most batches received each time a socket is readable, so that a flood of datagrams doesn't
+// keep the queue from everything else. The rest are received once the queue polls again.
+#define EVENT_DATAGRAM_MAX_READ_BATCHES 16
+
+// A batch of datagram buffers, with a message header for each pointing into them, so that the
+// headers are built once, not for every system call.
+typedef struct DatagramBatch {
+    unsigned char* data;
+    struct sockaddr_storage* addresses;
+    struct iovec* iovecs;
+    struct mmsghdr* messages;
+} DatagramBatch;
+
+struct EventDatagramSocket {
+    EventQueue* queue;
+    int fd;
+    IoEventId io_event;
+    HookId flush_hook;
+    EventDatagramFunction callback;
+    void* userdata;
+
+    size_t batch_size;
+    size_t max_size;
+
+    DatagramBatch receive_batch;
+    EventDatagram* received;
+
+    // Ring of datagrams queued to be sent.
+    DatagramBatch send_batch;
+    size_t send_head;
+    size_t send_count;
+
+    bool is_watching_writable;
+
+    // Freeing is deferred while the function is running, so it can free the socket.
+    bool is_in_callback;
+    bool is_freed;
+};
+
+static void* allocate(size_t size) {
+    void* memory = malloc(size);
+    if (memory == NULL) abort();
+    return memory;
+}
+
+static DatagramBatch datagram_batch_new(size_t batch_size, size_t max_size) {
+    DatagramBatch batch = {
+        .data = allocate(batch_size * max_size),
+        .addresses = allocate(sizeof(struct sockaddr_storage) * batch_size),
+        .iovecs = allocate(sizeof(struct iovec) * batch_size),
+        .messages = allocate(sizeof(struct mmsghdr) * batch_size),
+    };
+
+    for (size_t i = 0; i < batch_size; i++) {
+        batch.iovecs[i] = (struct iovec){
+            .iov_base = &batch.data[i * max_size],
+            .iov_len = max_size,
+        };
+
+        batch.messages[i] = (struct mmsghdr){
+            .msg_hdr = {
+                .msg_name = &batch.addresses[i],
+                .msg_namelen = sizeof(struct sockaddr_storage),
+                .msg_iov = &batch.iovecs[i],
+                .msg_iovlen = 1,
+            },
+            .msg_len = 0,
+        };
+    }
+
+    return batch;
+}
+
+static void datagram_batch_free(DatagramBatch* batch) {
+    free(batch->data);
+    free(batch->addresses);
+    free(batch->iovecs);
+    free(batch->messages);
+}
+
+static void free_socket_unchecked(EventDatagramSocket* socket) {
+    event_queue_remove_io_event(socket->queue, socket->io_event);
+    event_queue_remove_hook(socket->queue, socket->flush_hook);
+
+    datagram_batch_free(&socket->receive_batch);
+    datagram_batch_free(&socket->send_batch);
+    free(socket->received);
+    free(socket);
+}
+
+static void update_io_mask(EventDatagramSocket* socket) {
+    bool should_watch_writable = socket->send_count > 0;
+
+    if (should_watch_writable == socket->is_watching_writable) {
+        return;
+    }
+
+    uint32_t mask = event_io_flag_read;
+    if (should_watch_writable) {
+        mask |= event_io_flag_write;
+    }
+
+    event_queue_modify_io_event(socket->queue, socket->io_event, mask);
+    socket->is_watching_writable = should_watch_writable;
+}
+
+static void handle_readable(EventDatagramSocket* socket) {
+    DatagramBatch* batch = &socket->receive_batch;
+
+    for (size_t round = 0; round < EVENT_DATAGRAM_MAX_READ_BATCHES; round++) {
+        for (size_t i = 0; i < socket->batch_size; i++) {
+            batch->messages[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        }
+
+        int count = recvmmsg(
+            socket->fd, batch->messages, (unsigned int)socket->batch_size, MSG_DONTWAIT, NULL);
+
+        if (count < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+
+            continue; // A pending error was reported instead of a datagram. It's now cleared.
+        }
+
+        for (size_t i = 0; i < (size_t)count; i++) {
+            const struct msghdr* header = &batch->messages[i].msg_hdr;
+
+            socket->received[i] = (EventDatagram){
+                .data = batch->iovecs[i].iov_base,
+                .size = batch->messages[i].msg_len,
+                .address = (const struct sockaddr*)&batch->addresses[i],
+                .address_size = header->msg_namelen,
+                .is_truncated = (header->msg_flags & MSG_TRUNC) != 0,
+            };
+        }
+
+        socket->is_in_callback = true;
+        (*socket->callback)(socket, socket->received, (size_t)count, socket->userdata);
+        socket->is_in_callback = false;
+
+        if (socket->is_freed) {
+            free_socket_unchecked(socket);
+            return;
+        }
+
+        if ((size_t)count < socket->batch_size) {
+            return; // Nothing more is waiting.
+        }
+    }
+}
+
+// Send queued datagrams until the queue is empty, or the socket can't take more.
+static void send_queued(EventDatagramSocket* socket) {
+    while (socket->send_count > 0) {
+        // `sendmmsg` takes contiguous headers, so a ring which wraps is sent in two calls.
+        size_t contiguous = socket->batch_size - socket->send_head;
+        if (contiguous > socket->send_count) {
+            contiguous = socket->send_count;
+        }
+
+        int sent = sendmmsg(
+            socket->fd, &socket->send_batch.messages[socket->send_head], (unsigned int)contiguous,
+            MSG_DONTWAIT);
+
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            } else if (errno == EINTR) {
+                continue;
+            }
+
+            sent = 1; // The first datagram was refused, so is dropped.
+        }
+
+        socket->send_head = (socket->send_head + (size_t)sent) % socket->batch_size;
+        socket->send_count -= (size_t)sent;
+    }
+
+    update_io_mask(socket);
+}
+
+static void on_datagram_io(int fd, EventIoFlag flag, void* userdata) {
+    (void)fd;
+    EventDatagramSocket* socket = userdata;
+
+    if (flag == event_io_flag_write) {
+        send_queued(socket);
+    } else {
+        handle_readable(socket);
+    }
+}
+
+// Send what callbacks queued, before the queue blocks.
+static void on_prepare(void* userdata) {
+    EventDatagramSocket* socket = userdata;
+
+    if (socket->send_count > 0) {
+        send_queued(socket);
+    }
+}
+
+EventDatagramSocket* event_datagram_socket_new(
+    EventQueue* queue,
+    int fd,
+    size_t batch_size,
+    size_t max_size,
+    EventDatagramFunction function,
+    void* userdata
+) {
+    EventDatagramSocket* socket = allocate(sizeof(EventDatagramSocket));
+
+    *socket = (EventDatagramSocket){
+        .queue = queue,
+        .fd = fd,
+        .callback = function,
+        .userdata = userdata,
+        .batch_size = batch_size,
+        .max_size = max_size,
+        .receive_batch = datagram_batch_new(batch_size, max_size),
+        .received = allocate(sizeof(EventDatagram) * batch_size),
+        .send_batch = datagram_batch_new(batch_size, max_size),
+        .send_head = 0,
+        .send_count = 0,
+        .is_watching_writable = false,
+        .is_in_callback = false,
+        .is_freed = false,
+    };
+
+    socket->io_event = event_queue_add_io_event(
+        queue, fd, event_io_flag_read, on_datagram_io, socket);
+    socket->flush_hook = event_queue_add_prepare_hook(queue, on_prepare, socket);
+
+    if (socket->io_event.id == EVENT_QUEUE_INVALID_ID
+        || socket->flush_hook.id == EVENT_QUEUE_INVALID_ID) {
+        int error = (socket->io_event.id == EVENT_QUEUE_INVALID_ID) ? errno : ENOMEM;
+        free_socket_unchecked(socket); // Removing what was added, if either was.
+        errno = error;
+        return NULL;
+    }
+
+    return socket;
+}
+
+bool event_datagram_socket_send(
+    EventDatagramSocket* socket,
+    const void* data,
+    size_t size,
+    const struct sockaddr* address,
+    socklen_t address_size
+) {
+    if (size > socket->max_size || address_size > sizeof(struct sockaddr_storage)) {
+        return false;
+    }
+
+    if (socket->send_count == socket->batch_size) {
+        send_queued(socket);
+
+        if (socket->send_count == socket->batch_size) {
+            return false;
+        }
+    }
+
+    DatagramBatch* batch = &socket->send_batch;
+    size_t index = (socket->send_head + socket->send_count) % socket->batch_size;
+
+    memcpy(batch->iovecs[index].iov_base, data, size);
+    batch->iovecs[index].iov_len = size;
+
+    struct msghdr* header = &batch->messages[index].msg_hdr;
+    if (address != NULL) {
+        memcpy(&batch->addresses[index], address, address_size);
+        header->msg_name = &batch->addresses[index];
+        header->msg_namelen = address_size;
+    } else {
+        header->msg_name = NULL;
+        header->msg_namelen = 0;
+    }
+
+    socket->send_count += 1;
+
+    return true;
+}
+
+void event_datagram_socket_flush(EventDatagramSocket* socket) {
+    send_queued(socket);
+}
+
+size_t event_datagram_socket_queued_count(const EventDatagramSocket* socket) {
+    return socket->send_count;
+}
+
+void event_datagram_socket_free(EventDatagramSocket* socket) {
+    if (socket->is_in_callback) {
+        socket->is_freed = true;
+    } else {
+        free_socket_unchecked(socket);
+    }
+}
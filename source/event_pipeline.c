@@ -0,0 +1,450 @@
+#include "event_pipeline.h"
+#include "event_channel.h"
+#include "eventqueue_internal.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Keeps the producer's and consumer's indices on separate cache lines.
+#define CACHE_LINE_SIZE 64
+
+// Room for the wake messages which can be outstanding in a channel at once. Wakes are deduplicated
+// by flags, so a channel which is full already has a wake on its way.
+#define WAKE_CHANNEL_CAPACITY 4
+
+// An event to trigger on a queue, to run a stage or call the source's ready function.
+typedef struct WakeTarget {
+    EventQueue* queue;
+    EventId event;
+} WakeTarget;
+
+typedef struct Stage {
+    EventPipeline* pipeline;
+    EventStageId id;
+    char* name;
+    EventStageFunction callback;
+    void* userdata;
+    size_t batch_size;
+
+    // Runs the stage on its queue. A collapsing event, so a stage is run once however many times
+    // it's woken before then.
+    WakeTarget target;
+
+    // Wakes this stage from the producer's queue, and the producer from this stage's queue, when
+    // they differ. NULL otherwise.
+    EventChannel* data_channel;
+    EventChannel* room_channel;
+
+    // What the room channel wakes, or NULL if nothing waits for room: the previous stage, or the
+    // source's ready function.
+    WakeTarget* producer_target;
+
+    // Set while the stage is woken, but not yet run, so further items don't wake it again.
+    atomic_bool is_woken;
+
+    // Set by the producer when it found the ring full, so that the consumer wakes it once there's
+    // room.
+    atomic_bool is_producer_blocked;
+
+    atomic_uint_fast64_t item_count;
+    atomic_uint_fast64_t batch_count;
+    atomic_uint_fast64_t blocked_count;
+
+    void** items;
+    size_t mask;
+
+    // The index of the next item to consume. Written by the stage.
+    alignas(CACHE_LINE_SIZE) atomic_size_t head;
+
+    // The index of the next item to add. Written by the producer.
+    alignas(CACHE_LINE_SIZE) atomic_size_t tail;
+} Stage;
+
+// Definition of typedef struct EventPipeline EventPipeline (in header):
+struct EventPipeline {
+    EventQueue* source;
+    EventHookFunction ready_callback;
+    void* ready_userdata;
+
+    // Calls the ready function on the source queue. Unused if there is none.
+    WakeTarget source_target;
+
+    Stage** stages;
+    size_t stages_size;
+    size_t stages_capacity;
+};
+
+static size_t round_up_to_power_of_two(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result *= 2;
+    }
+    return result;
+}
+
+// Wake `target`, through `channel` if it's on another queue. Returns false if the target's queue
+// refused the trigger, which happens in real-time mode when it has no room for it.
+static bool wake(WakeTarget* target, EventChannel* channel) {
+    if (channel != NULL) {
+        bool is_sent = event_channel_send(channel, target);
+        (void)is_sent; // A full channel already has a wake on its way.
+        return true;
+    }
+
+    return event_queue_trigger_event(target->queue, target->event, NULL);
+}
+
+// Wakes a stage from its producer's queue.
+static void on_data_message(void* userdata, void** messages, size_t count) {
+    (void)messages;
+    (void)count;
+
+    Stage* stage = userdata;
+    if (!wake(&stage->target, NULL)) {
+        // Let the next item pushed wake the stage again.
+        atomic_store_explicit(&stage->is_woken, false, memory_order_relaxed);
+    }
+}
+
+// Wakes a stage's producer from the stage's queue.
+static void on_room_message(void* userdata, void** messages, size_t count) {
+    (void)messages;
+    (void)count;
+
+    Stage* stage = userdata;
+    if (!wake(stage->producer_target, NULL)) {
+        // Let the stage wake its producer again the next time it makes room.
+        atomic_store_explicit(&stage->is_producer_blocked, true, memory_order_relaxed);
+    }
+}
+
+// Called by the producer.
+static size_t get_free_space(Stage* stage) {
+    size_t tail = atomic_load_explicit(&stage->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&stage->head, memory_order_acquire);
+    return stage->mask + 1 - (tail - head);
+}
+
+// Whether `stage` has room for an item. If not, marks its producer as blocked, so that it's woken
+// once there is. Called by the producer.
+static bool has_room(Stage* stage) {
+    if (get_free_space(stage) > 0) {
+        return true;
+    }
+
+    // Mark, then check again. The stage makes room before checking the mark, so either it sees the
+    // mark and wakes the producer, or this sees the room. See `run_stage`.
+    atomic_store_explicit(&stage->is_producer_blocked, true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    return get_free_space(stage) > 0;
+}
+
+// Add `item` to a stage with room, and wake it. Returns false, with `errno` set to `ENOMEM`,
+// without adding it, if the stage's queue refused to run it. Called by the producer.
+static bool push_item(Stage* stage, void* item) {
+    size_t tail = atomic_load_explicit(&stage->tail, memory_order_relaxed);
+    stage->items[tail & stage->mask] = item;
+    atomic_store_explicit(&stage->tail, tail + 1, memory_order_release);
+
+    // Publish the item, then check whether the stage is already woken. The stage clears its flag
+    // before looking for items, so either it sees this item, or this wakes it again.
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (!atomic_load_explicit(&stage->is_woken, memory_order_relaxed)
+        && !atomic_exchange_explicit(&stage->is_woken, true, memory_order_relaxed)
+        && !wake(&stage->target, stage->data_channel)) {
+        // Only triggers on the producer's own queue are refused, so the stage, on this thread,
+        // hasn't seen the item yet.
+        atomic_store_explicit(&stage->tail, tail, memory_order_relaxed);
+        atomic_store_explicit(&stage->is_woken, false, memory_order_relaxed);
+        errno = ENOMEM;
+        return false;
+    }
+
+    return true;
+}
+
+// Pass the stage a batch of the items waiting for it, then wake whatever's waiting on it.
+static void run_stage(void* userdata, void* eventdata) {
+    (void)eventdata;
+
+    Stage* stage = userdata;
+    EventPipeline* pipeline = stage->pipeline;
+
+    atomic_store_explicit(&stage->is_woken, false, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    size_t head = atomic_load_explicit(&stage->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&stage->tail, memory_order_acquire);
+
+    if (head == tail) {
+        return;
+    }
+
+    // Pass the contiguous run of items starting at the head, without copying them, and no more
+    // than the next stage has room for, so that stages emitting an item per item never fail.
+    size_t start = head & stage->mask;
+    size_t count = tail - head;
+    size_t until_wrap = stage->mask + 1 - start;
+
+    if (count > until_wrap) count = until_wrap;
+    if (count > stage->batch_size) count = stage->batch_size;
+
+    bool is_last = stage->id.id + 1 == pipeline->stages_size;
+    Stage* next = is_last ? NULL : pipeline->stages[stage->id.id + 1];
+
+    if (next != NULL) {
+        if (!has_room(next)) {
+            atomic_fetch_add_explicit(&stage->blocked_count, 1, memory_order_relaxed);
+            return; // Woken by the next stage once it has room.
+        }
+
+        size_t room = get_free_space(next);
+        if (count > room) count = room;
+    }
+
+    size_t consumed = (*stage->callback)(
+        pipeline, stage->id, &stage->items[start], count, stage->userdata);
+    assert(consumed <= count);
+
+    atomic_fetch_add_explicit(&stage->item_count, consumed, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stage->batch_count, 1, memory_order_relaxed);
+
+    // Make room, then check whether the producer is waiting for it. See `has_room`.
+    head += consumed;
+    atomic_store_explicit(&stage->head, head, memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (consumed > 0 && stage->producer_target != NULL
+        && atomic_load_explicit(&stage->is_producer_blocked, memory_order_relaxed)
+        && atomic_exchange_explicit(&stage->is_producer_blocked, false, memory_order_relaxed)
+        && !wake(stage->producer_target, stage->room_channel)) {
+        // Wake the producer again the next time there's room made.
+        atomic_store_explicit(&stage->is_producer_blocked, true, memory_order_relaxed);
+    }
+
+    // Run again for the rest after the queue's other work, unless held back by the next stage.
+    bool has_remaining = head != atomic_load_explicit(&stage->tail, memory_order_acquire);
+    if (!has_remaining) {
+        return;
+    }
+
+    if (next != NULL && !has_room(next)) {
+        atomic_fetch_add_explicit(&stage->blocked_count, 1, memory_order_relaxed);
+        return; // Woken by the next stage once it has room.
+    }
+
+    if (!atomic_exchange_explicit(&stage->is_woken, true, memory_order_relaxed)
+        && !wake(&stage->target, NULL)) {
+        // Let the next item pushed wake the stage again.
+        atomic_store_explicit(&stage->is_woken, false, memory_order_relaxed);
+    }
+}
+
+// Removes the stage's event, if it was added, along with its channels.
+static void free_stage(Stage* stage) {
+    event_queue_remove_event(stage->target.queue, stage->target.event);
+
+    if (stage->data_channel != NULL) {
+        event_channel_free(stage->data_channel);
+    }
+
+    if (stage->room_channel != NULL) {
+        event_channel_free(stage->room_channel);
+    }
+
+    free(stage->items);
+    free(stage->name);
+    free(stage);
+}
+
+static void call_ready_function(void* userdata, void* eventdata) {
+    (void)eventdata;
+
+    EventPipeline* pipeline = userdata;
+    (*pipeline->ready_callback)(pipeline->ready_userdata);
+}
+
+EventPipeline* event_pipeline_new(EventQueue* source, EventHookFunction ready, void* userdata) {
+    EventPipeline* pipeline = malloc(sizeof(EventPipeline));
+    if (pipeline == NULL) abort();
+
+    *pipeline = (EventPipeline){
+        .source = source,
+        .ready_callback = ready,
+        .ready_userdata = userdata,
+        .source_target = { .queue = source, .event = { .id = EVENT_QUEUE_INVALID_ID } },
+        .stages = NULL,
+        .stages_size = 0,
+        .stages_capacity = 0,
+    };
+
+    if (ready != NULL) {
+        pipeline->source_target.event =
+            event_queue_add_internal_event(source, call_ready_function, pipeline);
+
+        if (pipeline->source_target.event.id == EVENT_QUEUE_INVALID_ID) {
+            free(pipeline);
+            errno = ENOMEM;
+            return NULL;
+        }
+    }
+
+    return pipeline;
+}
+
+EventStageId event_pipeline_add_stage(
+    EventPipeline* pipeline,
+    EventQueue* queue,
+    const char* name,
+    size_t capacity,
+    size_t batch_size,
+    EventStageFunction function,
+    void* userdata
+) {
+    assert(batch_size > 0);
+
+    capacity = round_up_to_power_of_two(capacity);
+
+    void** items = malloc(sizeof(void*) * capacity);
+    if (items == NULL) abort();
+
+    char* name_copy = strdup(name);
+    if (name_copy == NULL) abort();
+
+    Stage* stage = aligned_alloc(alignof(Stage), sizeof(Stage));
+    if (stage == NULL) abort();
+
+    EventStageId id = { .id = (uint32_t)pipeline->stages_size };
+
+    *stage = (Stage){
+        .pipeline = pipeline,
+        .id = id,
+        .name = name_copy,
+        .callback = function,
+        .userdata = userdata,
+        .batch_size = batch_size,
+        .target = { .queue = queue },
+        .data_channel = NULL,
+        .room_channel = NULL,
+        .producer_target = NULL,
+        .items = items,
+        .mask = capacity - 1,
+    };
+    atomic_init(&stage->is_woken, false);
+    atomic_init(&stage->is_producer_blocked, false);
+    atomic_init(&stage->item_count, 0);
+    atomic_init(&stage->batch_count, 0);
+    atomic_init(&stage->blocked_count, 0);
+    atomic_init(&stage->head, 0);
+    atomic_init(&stage->tail, 0);
+
+    stage->target.event = event_queue_add_internal_event(queue, run_stage, stage);
+
+    // The producer is the previous stage, or the source, which only waits for room if it has a
+    // ready function.
+    if (pipeline->stages_size > 0) {
+        stage->producer_target = &pipeline->stages[pipeline->stages_size - 1]->target;
+    } else if (pipeline->ready_callback != NULL) {
+        stage->producer_target = &pipeline->source_target;
+    }
+
+    EventQueue* producer_queue = (pipeline->stages_size > 0)
+        ? pipeline->stages[pipeline->stages_size - 1]->target.queue
+        : pipeline->source;
+
+    bool is_added = stage->target.event.id != EVENT_QUEUE_INVALID_ID;
+
+    if (is_added && producer_queue != queue) {
+        stage->data_channel =
+            event_channel_new(queue, WAKE_CHANNEL_CAPACITY, on_data_message, stage);
+        is_added = stage->data_channel != NULL;
+
+        if (is_added && stage->producer_target != NULL) {
+            stage->room_channel = event_channel_new(
+                producer_queue, WAKE_CHANNEL_CAPACITY, on_room_message, stage);
+            is_added = stage->room_channel != NULL;
+        }
+    }
+
+    if (!is_added) {
+        free_stage(stage);
+        errno = ENOMEM;
+        return (EventStageId){ .id = EVENT_QUEUE_INVALID_ID };
+    }
+
+    if (pipeline->stages_size == pipeline->stages_capacity) {
+        pipeline->stages_capacity = (pipeline->stages_capacity == 0)
+            ? 1
+            : (pipeline->stages_capacity * 2);
+        pipeline->stages = realloc(pipeline->stages, sizeof(Stage*) * pipeline->stages_capacity);
+        if (pipeline->stages == NULL) abort();
+    }
+
+    pipeline->stages[pipeline->stages_size] = stage;
+    pipeline->stages_size += 1;
+
+    return id;
+}
+
+bool event_pipeline_push(EventPipeline* pipeline, void* item) {
+    assert(pipeline->stages_size > 0);
+
+    Stage* first = pipeline->stages[0];
+    if (!has_room(first)) {
+        return false;
+    }
+
+    return push_item(first, item);
+}
+
+bool event_pipeline_emit(EventPipeline* pipeline, EventStageId stage, void* item) {
+    if (stage.id + 1 >= pipeline->stages_size) {
+        return false;
+    }
+
+    // Counted as blocked once the stage's function returns. See `run_stage`.
+    Stage* next = pipeline->stages[stage.id + 1];
+    if (!has_room(next)) {
+        return false;
+    }
+
+    return push_item(next, item);
+}
+
+void event_pipeline_get_stage_stats(
+    const EventPipeline* pipeline,
+    EventStageId id,
+    EventStageStats* out
+) {
+    Stage* stage = pipeline->stages[id.id];
+
+    size_t head = atomic_load_explicit(&stage->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&stage->tail, memory_order_relaxed);
+
+    *out = (EventStageStats){
+        .name = stage->name,
+        .item_count = atomic_load_explicit(&stage->item_count, memory_order_relaxed),
+        .batch_count = atomic_load_explicit(&stage->batch_count, memory_order_relaxed),
+        .blocked_count = atomic_load_explicit(&stage->blocked_count, memory_order_relaxed),
+        .depth = (tail > head) ? (tail - head) : 0,
+        .capacity = stage->mask + 1,
+    };
+}
+
+void event_pipeline_free(EventPipeline* pipeline) {
+    for (size_t i = 0; i < pipeline->stages_size; i++) {
+        free_stage(pipeline->stages[i]);
+    }
+
+    if (pipeline->ready_callback != NULL) {
+        event_queue_remove_event(pipeline->source, pipeline->source_target.event);
+    }
+
+    free(pipeline->stages);
+    free(pipeline);
+}
@@ -0,0 +1,81 @@
+#define _GNU_SOURCE // For `pthread_setaffinity_np`
+#include "event_realtime.h"
+#include "eventqueue_internal.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+EventRealtimeConfig event_realtime_config_default(void) {
+    return (EventRealtimeConfig){
+        .cpu = -1,
+        .priority = 0,
+        .lock_memory = true,
+        .stack_size = EVENT_REALTIME_DEFAULT_STACK_SIZE,
+    };
+}
+
+static bool pin_to_cpu(int cpu) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    errno = error;
+    return error == 0;
+}
+
+static bool set_fifo_priority(int priority) {
+    struct sched_param parameters = { .sched_priority = priority };
+
+    int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters);
+    errno = error;
+    return error == 0;
+}
+
+// Write to `size` bytes of stack below the caller's frame, a page per call.
+__attribute__((noinline))
+static void prefault_stack(size_t size) {
+    volatile unsigned char page[4096];
+
+    for (size_t i = 0; i < sizeof(page); i += 64) {
+        page[i] = 0;
+    }
+
+    if (size > sizeof(page)) {
+        prefault_stack(size - sizeof(page));
+    }
+
+    // Keeps the frame alive across the call, so it isn't made a tail call reusing this frame.
+    (void)page[0];
+}
+
+bool event_queue_enter_realtime(EventQueue* queue, const EventRealtimeConfig* config) {
+    // The radix heap's buckets grow as timers move between them.
+    if (queue->timers.kind == timer_heap_kind_radix) {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (config->cpu >= 0 && !pin_to_cpu(config->cpu)) {
+        return false;
+    }
+
+    if (config->priority > 0 && !set_fifo_priority(config->priority)) {
+        return false;
+    }
+
+    if (config->lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        return false;
+    }
+
+    event_queue_prefault_tables(queue);
+    prefault_stack(config->stack_size);
+
+    queue->is_realtime = true;
+    return true;
+}
+
+void event_queue_leave_realtime(EventQueue* queue) {
+    queue->is_realtime = false;
+}
@@ -0,0 +1,433 @@
+#include "event_stream.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+// The most queued buffers passed to one `writev` call.
+#define EVENT_STREAM_MAX_IOVECS 64
+
+// The most buffers a pool keeps for reuse. Buffers released beyond this are freed.
+#define EVENT_BUFFER_POOL_MAX_FREE 64
+
+// Definition of typedef struct EventBufferPool EventBufferPool (in header):
+struct EventBufferPool {
+    size_t buffer_size;
+
+    // The number of holders of the pool: its stream, and each buffer taken from it.
+    size_t refcount;
+
+    EventBuffer* free_buffers[EVENT_BUFFER_POOL_MAX_FREE];
+    size_t free_buffers_size;
+};
+
+// A buffer queued for writing, and how much of it has been written.
+typedef struct QueuedBuffer {
+    EventBuffer* buffer;
+    size_t offset;
+} QueuedBuffer;
+
+struct EventStream {
+    EventQueue* queue;
+    int fd;
+    IoEventId io_event;
+    EventStreamCallbacks callbacks;
+    void* userdata;
+
+    EventBufferPool* pool;
+
+    // Ring of buffers queued for writing.
+    QueuedBuffer* write_queue;
+    size_t write_queue_head;
+    size_t write_queue_size;
+    size_t write_queue_capacity;
+    size_t queued_bytes;
+
+    size_t low_watermark;
+    size_t high_watermark;
+    bool is_above_high_watermark;
+
+    bool is_watching_writable;
+    bool is_closed;
+
+    // Freeing is deferred while callbacks are running, so they can free the stream.
+    size_t callback_depth;
+    bool is_freed;
+};
+
+// --- Buffers --- //
+
+static EventBuffer* allocate_buffer(size_t capacity, EventBufferPool* pool) {
+    EventBuffer* buffer = malloc(sizeof(EventBuffer) + capacity);
+    if (buffer == NULL) abort();
+
+    buffer->refcount = 1;
+    buffer->size = 0;
+    buffer->capacity = capacity;
+    buffer->pool = pool;
+
+    return buffer;
+}
+
+static EventBufferPool* buffer_pool_new(size_t buffer_size) {
+    EventBufferPool* pool = malloc(sizeof(EventBufferPool));
+    if (pool == NULL) abort();
+
+    pool->buffer_size = buffer_size;
+    pool->refcount = 1;
+    pool->free_buffers_size = 0;
+
+    return pool;
+}
+
+static void buffer_pool_release(EventBufferPool* pool) {
+    pool->refcount -= 1;
+
+    if (pool->refcount == 0) {
+        for (size_t i = 0; i < pool->free_buffers_size; i++) {
+            free(pool->free_buffers[i]);
+        }
+
+        free(pool);
+    }
+}
+
+static EventBuffer* buffer_pool_acquire(EventBufferPool* pool) {
+    pool->refcount += 1;
+
+    if (pool->free_buffers_size > 0) {
+        pool->free_buffers_size -= 1;
+
+        EventBuffer* buffer = pool->free_buffers[pool->free_buffers_size];
+        buffer->refcount = 1;
+        buffer->size = 0;
+
+        return buffer;
+    }
+
+    return allocate_buffer(pool->buffer_size, pool);
+}
+
+EventBuffer* event_buffer_new(size_t capacity) {
+    return allocate_buffer(capacity, NULL);
+}
+
+void event_buffer_retain(EventBuffer* buffer) {
+    buffer->refcount += 1;
+}
+
+void event_buffer_release(EventBuffer* buffer) {
+    buffer->refcount -= 1;
+
+    if (buffer->refcount > 0) {
+        return;
+    }
+
+    EventBufferPool* pool = buffer->pool;
+
+    if (pool == NULL) {
+        free(buffer);
+        return;
+    }
+
+    // Only keep buffers for reuse while the pool's stream is around to reuse them.
+    bool is_pool_in_use = pool->refcount > 1;
+
+    if (is_pool_in_use && pool->free_buffers_size < EVENT_BUFFER_POOL_MAX_FREE) {
+        pool->free_buffers[pool->free_buffers_size] = buffer;
+        pool->free_buffers_size += 1;
+    } else {
+        free(buffer);
+    }
+
+    buffer_pool_release(pool);
+}
+
+// --- Streams --- //
+
+static void free_stream_unchecked(EventStream* stream) {
+    for (size_t i = 0; i < stream->write_queue_size; i++) {
+        size_t index = (stream->write_queue_head + i) % stream->write_queue_capacity;
+        event_buffer_release(stream->write_queue[index].buffer);
+    }
+
+    if (!stream->is_closed) {
+        event_queue_remove_io_event(stream->queue, stream->io_event);
+    }
+
+    buffer_pool_release(stream->pool);
+    free(stream->write_queue);
+    free(stream);
+}
+
+static void begin_callback(EventStream* stream) {
+    stream->callback_depth += 1;
+}
+
+// Returns false if the stream was freed by the callback, in which case it mustn't be used.
+static bool end_callback(EventStream* stream) {
+    stream->callback_depth -= 1;
+
+    if (stream->callback_depth == 0 && stream->is_freed) {
+        free_stream_unchecked(stream);
+        return false;
+    }
+
+    return !stream->is_freed;
+}
+
+static void update_io_mask(EventStream* stream) {
+    bool should_watch_writable = stream->write_queue_size > 0;
+
+    if (stream->is_closed || should_watch_writable == stream->is_watching_writable) {
+        return;
+    }
+
+    uint32_t mask = event_io_flag_read;
+    if (should_watch_writable) {
+        mask |= event_io_flag_write;
+    }
+
+    event_queue_modify_io_event(stream->queue, stream->io_event, mask);
+    stream->is_watching_writable = should_watch_writable;
+}
+
+// Stop reading and writing, and report `error` to `on_close`. Returns false if the stream was
+// freed.
+static bool close_stream(EventStream* stream, int error) {
+    stream->is_closed = true;
+    event_queue_remove_io_event(stream->queue, stream->io_event);
+
+    begin_callback(stream);
+    (*stream->callbacks.on_close)(stream, error, stream->userdata);
+    return end_callback(stream);
+}
+
+static void handle_readable(EventStream* stream) {
+    EventBuffer* buffer = buffer_pool_acquire(stream->pool);
+    ssize_t size = read(stream->fd, buffer->data, buffer->capacity);
+
+    if (size > 0) {
+        buffer->size = (size_t)size;
+
+        begin_callback(stream);
+        (*stream->callbacks.on_read)(stream, buffer, stream->userdata);
+        event_buffer_release(buffer);
+        end_callback(stream);
+        return;
+    }
+
+    int error = errno;
+    event_buffer_release(buffer);
+
+    if (size == 0) {
+        close_stream(stream, 0);
+    } else if (error != EAGAIN && error != EWOULDBLOCK && error != EINTR) {
+        close_stream(stream, error);
+    }
+}
+
+// Remove `written` bytes from the front of the write queue.
+static void consume_written_bytes(EventStream* stream, size_t written) {
+    stream->queued_bytes -= written;
+
+    while (written > 0) {
+        QueuedBuffer* queued = &stream->write_queue[stream->write_queue_head];
+        size_t remaining = queued->buffer->size - queued->offset;
+
+        if (written < remaining) {
+            queued->offset += written;
+            return;
+        }
+
+        written -= remaining;
+        event_buffer_release(queued->buffer);
+
+        stream->write_queue_head = (stream->write_queue_head + 1) % stream->write_queue_capacity;
+        stream->write_queue_size -= 1;
+    }
+}
+
+static void handle_writable(EventStream* stream) {
+    while (stream->write_queue_size > 0) {
+        struct iovec iov[EVENT_STREAM_MAX_IOVECS];
+        size_t iov_count = 0;
+
+        size_t count = stream->write_queue_size;
+        for (size_t i = 0; i < count && iov_count < EVENT_STREAM_MAX_IOVECS; i++) {
+            size_t index = (stream->write_queue_head + i) % stream->write_queue_capacity;
+            QueuedBuffer* queued = &stream->write_queue[index];
+
+            iov[iov_count] = (struct iovec){
+                .iov_base = queued->buffer->data + queued->offset,
+                .iov_len = queued->buffer->size - queued->offset,
+            };
+            iov_count += 1;
+        }
+
+        ssize_t written = writev(stream->fd, iov, (int)iov_count);
+
+        if (written < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                break;
+            }
+
+            close_stream(stream, errno);
+            return;
+        }
+
+        consume_written_bytes(stream, (size_t)written);
+    }
+
+    update_io_mask(stream);
+
+    if (stream->is_above_high_watermark && stream->queued_bytes <= stream->low_watermark) {
+        stream->is_above_high_watermark = false;
+
+        if (stream->callbacks.on_drain != NULL) {
+            begin_callback(stream);
+            (*stream->callbacks.on_drain)(stream, stream->userdata);
+            end_callback(stream);
+        }
+    }
+}
+
+static void on_stream_io(int fd, EventIoFlag flag, void* userdata) {
+    (void)fd;
+
+    EventStream* stream = userdata;
+
+    if (flag == event_io_flag_read) {
+        handle_readable(stream);
+    } else if (flag == event_io_flag_write) {
+        handle_writable(stream);
+    }
+}
+
+EventStream* event_stream_new(
+    EventQueue* queue,
+    int fd,
+    const EventStreamCallbacks* callbacks,
+    void* userdata
+) {
+    EventStream* stream = malloc(sizeof(EventStream));
+    if (stream == NULL) abort();
+
+    QueuedBuffer* write_queue = malloc(sizeof(QueuedBuffer));
+    if (write_queue == NULL) abort();
+
+    *stream = (EventStream){
+        .queue = queue,
+        .fd = fd,
+        .callbacks = *callbacks,
+        .userdata = userdata,
+        .pool = buffer_pool_new(EVENT_STREAM_DEFAULT_READ_BUFFER_SIZE),
+        .write_queue = write_queue,
+        .write_queue_head = 0,
+        .write_queue_size = 0,
+        .write_queue_capacity = 1,
+        .queued_bytes = 0,
+        .low_watermark = EVENT_STREAM_DEFAULT_LOW_WATERMARK,
+        .high_watermark = EVENT_STREAM_DEFAULT_HIGH_WATERMARK,
+        .is_above_high_watermark = false,
+        .is_watching_writable = false,
+        .is_closed = false,
+        .callback_depth = 0,
+        .is_freed = false,
+    };
+
+    stream->io_event =
+        event_queue_add_io_event(queue, fd, event_io_flag_read, on_stream_io, stream);
+
+    if (stream->io_event.id == EVENT_QUEUE_INVALID_ID) {
+        int error = errno;
+        free_stream_unchecked(stream);
+        errno = error;
+        return NULL;
+    }
+
+    return stream;
+}
+
+void event_stream_set_watermarks(EventStream* stream, size_t low, size_t high) {
+    stream->low_watermark = low;
+    stream->high_watermark = high;
+}
+
+EventBuffer* event_stream_get_buffer(EventStream* stream) {
+    return buffer_pool_acquire(stream->pool);
+}
+
+static void reallocate_write_queue_if_at_capacity(EventStream* stream) {
+    if (stream->write_queue_size < stream->write_queue_capacity) {
+        return;
+    }
+
+    size_t old_capacity = stream->write_queue_capacity;
+    stream->write_queue_capacity *= 2;
+
+    stream->write_queue = realloc(
+        stream->write_queue, sizeof(QueuedBuffer) * stream->write_queue_capacity);
+    if (stream->write_queue == NULL) abort();
+
+    // Unwrap the ring: move the elements before the head to after the old end.
+    size_t wrapped_count = stream->write_queue_head;
+    memcpy(
+        &stream->write_queue[old_capacity], &stream->write_queue[0],
+        sizeof(QueuedBuffer) * wrapped_count);
+}
+
+bool event_stream_write(EventStream* stream, EventBuffer* buffer) {
+    if (stream->is_closed || buffer->size == 0) {
+        return !stream->is_above_high_watermark;
+    }
+
+    reallocate_write_queue_if_at_capacity(stream);
+
+    event_buffer_retain(buffer);
+
+    size_t index =
+        (stream->write_queue_head + stream->write_queue_size) % stream->write_queue_capacity;
+    stream->write_queue[index] = (QueuedBuffer){
+        .buffer = buffer,
+        .offset = 0,
+    };
+    stream->write_queue_size += 1;
+    stream->queued_bytes += buffer->size;
+
+    // Writes are flushed together once the fd is writable, rather than one system call each.
+    update_io_mask(stream);
+
+    if (stream->queued_bytes >= stream->high_watermark) {
+        stream->is_above_high_watermark = true;
+    }
+
+    return !stream->is_above_high_watermark;
+}
+
+bool event_stream_write_copy(EventStream* stream, const void* data, size_t size) {
+    EventBuffer* buffer = (size <= stream->pool->buffer_size)
+        ? buffer_pool_acquire(stream->pool)
+        : event_buffer_new(size);
+
+    memcpy(buffer->data, data, size);
+    buffer->size = size;
+
+    bool result = event_stream_write(stream, buffer);
+    event_buffer_release(buffer);
+
+    return result;
+}
+
+size_t event_stream_queued_bytes(const EventStream* stream) {
+    return stream->queued_bytes;
+}
+
+void event_stream_free(EventStream* stream) {
+    if (stream->callback_depth > 0) {
+        stream->is_freed = true;
+    } else {
+        free_stream_unchecked(stream);
+    }
+}
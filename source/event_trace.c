@@ -0,0 +1,488 @@
+#define _POSIX_C_SOURCE 200809L // For POSIX clock_* functions
+#include "event_trace.h"
+#include "eventqueue_internal.h"
+#include "trace_recorder.h"
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// Every log starts with these bytes, followed by the start time as a varint. Each record is then
+// a kind byte, the time since the previous record as a varint, and the kind's arguments as
+// varints.
+static const unsigned char trace_magic[5] = { 'E', 'Q', 'T', 'R', 1 };
+
+// Definition of typedef struct TraceRecorder TraceRecorder (in eventqueue.h):
+struct TraceRecorder {
+    FILE* file;
+    uint64_t last_time_us;
+};
+
+static size_t argument_count(TraceRecordKind kind) {
+    switch (kind) {
+        case trace_record_add_timer: return 3;
+        case trace_record_reschedule_timer: return 3;
+        case trace_record_add_event: return 2;
+        case trace_record_add_io_event: return 2;
+        default: return 1;
+    }
+}
+
+// Whether a record is of a dispatch, rather than a call made by the application.
+static bool is_dispatch_record(TraceRecordKind kind) {
+    return kind == trace_record_dispatch_timer
+        || kind == trace_record_dispatch_event
+        || kind == trace_record_dispatch_io_event;
+}
+
+// --- Recording --- //
+
+static void write_varint(FILE* file, uint64_t value) {
+    // Little-endian base 128: 7 bits per byte, with the high bit set on all but the last.
+    unsigned char bytes[10];
+    size_t size = 0;
+
+    do {
+        bytes[size] = value & 0x7f;
+        value >>= 7;
+
+        if (value != 0) {
+            bytes[size] |= 0x80;
+        }
+
+        size += 1;
+    } while (value != 0);
+
+    fwrite(bytes, 1, size, file);
+}
+
+TraceRecorder* trace_recorder_new(FILE* file, uint64_t start_us) {
+    TraceRecorder* recorder = malloc(sizeof(TraceRecorder));
+    if (recorder == NULL) abort();
+
+    *recorder = (TraceRecorder){
+        .file = file,
+        .last_time_us = start_us,
+    };
+
+    fwrite(trace_magic, 1, sizeof(trace_magic), file);
+    write_varint(file, start_us);
+
+    return recorder;
+}
+
+void trace_recorder_write(
+    TraceRecorder* recorder,
+    TraceRecordKind kind,
+    uint64_t time_us,
+    uint64_t a,
+    uint64_t b,
+    uint64_t c
+) {
+    uint64_t delta_us = (time_us > recorder->last_time_us) ? (time_us - recorder->last_time_us) : 0;
+    recorder->last_time_us += delta_us;
+
+    uint64_t arguments[3] = { a, b, c };
+
+    putc((int)kind, recorder->file);
+    write_varint(recorder->file, delta_us);
+
+    for (size_t i = 0; i < argument_count(kind); i++) {
+        write_varint(recorder->file, arguments[i]);
+    }
+}
+
+void trace_recorder_free(TraceRecorder* recorder) {
+    fflush(recorder->file);
+    free(recorder);
+}
+
+void event_queue_start_recording(EventQueue* queue, FILE* file) {
+    event_queue_stop_recording(queue);
+    queue->recorder = trace_recorder_new(file, event_queue_now_us(queue));
+}
+
+void event_queue_stop_recording(EventQueue* queue) {
+    if (queue->recorder != NULL) {
+        trace_recorder_free(queue->recorder);
+        queue->recorder = NULL;
+    }
+}
+
+// --- Replay --- //
+
+// Maps IDs in the log to IDs in the replaying queue. IDs are allocated in increasing order, so
+// entries are appended in order and looked up by binary search.
+typedef struct IdMap {
+    uint32_t* recorded;
+    uint32_t* replayed;
+    size_t size;
+    size_t capacity;
+} IdMap;
+
+// A pipe standing in for the file descriptor of a recorded I/O event.
+typedef struct ReplayPipe {
+    IoEventId id;
+    int read_fd;
+    int write_fd;
+} ReplayPipe;
+
+typedef struct Replay {
+    EventQueue queue;
+    VirtualClock clock;
+    EventTraceReport* report;
+
+    IdMap timers;
+    IdMap events;
+
+    // Maps I/O event IDs to indices of `pipes`.
+    IdMap io_events;
+    ReplayPipe* pipes;
+    size_t pipes_size;
+    size_t pipes_capacity;
+} Replay;
+
+static IdMap id_map_new(void) {
+    return (IdMap){
+        .recorded = NULL,
+        .replayed = NULL,
+        .size = 0,
+        .capacity = 0,
+    };
+}
+
+static void id_map_insert(IdMap* map, uint32_t recorded, uint32_t replayed) {
+    if (map->size == map->capacity) {
+        map->capacity = (map->capacity == 0) ? 16 : (map->capacity * 2);
+
+        map->recorded = realloc(map->recorded, sizeof(uint32_t) * map->capacity);
+        if (map->recorded == NULL) abort();
+
+        map->replayed = realloc(map->replayed, sizeof(uint32_t) * map->capacity);
+        if (map->replayed == NULL) abort();
+    }
+
+    map->recorded[map->size] = recorded;
+    map->replayed[map->size] = replayed;
+    map->size += 1;
+}
+
+static bool id_map_find(const IdMap* map, uint64_t recorded, size_t* out) {
+    size_t low = 0;
+    size_t high = map->size;
+
+    while (low < high) {
+        size_t middle = low + ((high - low) / 2);
+
+        if (map->recorded[middle] < recorded) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low < map->size && map->recorded[low] == recorded) {
+        *out = low;
+        return true;
+    } else {
+        return false;
+    }
+}
+
+static bool id_map_get(const IdMap* map, uint64_t recorded, uint32_t* out) {
+    size_t index;
+    if (!id_map_find(map, recorded, &index)) {
+        return false;
+    }
+
+    *out = map->replayed[index];
+    return true;
+}
+
+static void id_map_free(IdMap* map) {
+    free(map->recorded);
+    free(map->replayed);
+}
+
+static bool read_varint(FILE* file, uint64_t* out) {
+    uint64_t value = 0;
+
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        int byte = getc(file);
+        if (byte == EOF) {
+            return false;
+        }
+
+        value |= (uint64_t)(byte & 0x7f) << shift;
+
+        if ((byte & 0x80) == 0) {
+            *out = value;
+            return true;
+        }
+    }
+
+    return false; // Too long to be a 64-bit value.
+}
+
+static uint64_t monotonic_now_ns(void) {
+    struct timespec timespec;
+    clock_gettime(CLOCK_MONOTONIC, &timespec);
+    return ((uint64_t)timespec.tv_sec * 1000000000UL) + (uint64_t)timespec.tv_nsec;
+}
+
+static void on_replay_timer(void* userdata) {
+    Replay* replay = userdata;
+    replay->report->replayed_dispatch_count += 1;
+}
+
+static void on_replay_event(void* userdata, void* eventdata) {
+    (void)eventdata;
+    Replay* replay = userdata;
+    replay->report->replayed_dispatch_count += 1;
+}
+
+static void on_replay_batch_event(void* userdata, void** eventdata, size_t count) {
+    (void)eventdata;
+    (void)count;
+    Replay* replay = userdata;
+    replay->report->replayed_dispatch_count += 1;
+}
+
+static void on_replay_io_event(int fd, EventIoFlag flag, void* userdata) {
+    (void)flag;
+    Replay* replay = userdata;
+    replay->report->replayed_dispatch_count += 1;
+
+    char buffer[64];
+    while (read(fd, buffer, sizeof(buffer)) > 0) {}
+}
+
+// Dispatch everything due at or before `time_us`, then move the clock to `time_us`.
+static void advance_to(Replay* replay, uint64_t time_us) {
+    uint64_t deadline;
+    while (event_queue_next_deadline(&replay->queue, &deadline) && deadline <= time_us) {
+        event_queue_wait(&replay->queue);
+    }
+
+    if (replay->clock.now_us < time_us) {
+        replay->clock.now_us = time_us;
+    }
+}
+
+static void replay_add_io_event(Replay* replay, uint32_t recorded_id) {
+    int fds[2];
+    if (pipe(fds) != 0) abort();
+    if (fcntl(fds[0], F_SETFL, O_NONBLOCK) != 0) abort();
+
+    if (replay->pipes_size == replay->pipes_capacity) {
+        replay->pipes_capacity = (replay->pipes_capacity == 0) ? 4 : (replay->pipes_capacity * 2);
+        replay->pipes = realloc(replay->pipes, sizeof(ReplayPipe) * replay->pipes_capacity);
+        if (replay->pipes == NULL) abort();
+    }
+
+    IoEventId id = event_queue_add_io_event(
+        &replay->queue, fds[0], event_io_flag_read, on_replay_io_event, replay);
+
+    replay->pipes[replay->pipes_size] = (ReplayPipe){
+        .id = id,
+        .read_fd = fds[0],
+        .write_fd = fds[1],
+    };
+
+    id_map_insert(&replay->io_events, recorded_id, (uint32_t)replay->pipes_size);
+    replay->pipes_size += 1;
+}
+
+static void replay_record(Replay* replay, TraceRecordKind kind, const uint64_t* arguments) {
+    EventQueue* queue = &replay->queue;
+    uint32_t id;
+
+    switch (kind) {
+        case trace_record_add_timer: {
+            TimerId timer = event_queue_add_periodic_timer(
+                queue, arguments[1], arguments[2] - 1, on_replay_timer, replay);
+            id_map_insert(&replay->timers, (uint32_t)arguments[0], timer.id);
+            break;
+        }
+
+        case trace_record_remove_timer:
+            if (id_map_get(&replay->timers, arguments[0], &id)) {
+                event_queue_remove_timer(queue, (TimerId){id});
+            }
+            break;
+
+        case trace_record_reschedule_timer: {
+            size_t index;
+            if (id_map_find(&replay->timers, arguments[0], &index)) {
+                event_queue_remove_timer(queue, (TimerId){replay->timers.replayed[index]});
+
+                TimerId timer = event_queue_add_periodic_timer(
+                    queue, arguments[1], arguments[2] - 1, on_replay_timer, replay);
+                replay->timers.replayed[index] = timer.id;
+            }
+            break;
+        }
+
+        case trace_record_add_event: {
+            EventId event;
+            if (arguments[1] == 2) {
+                event = event_queue_add_batch_event(queue, on_replay_batch_event, replay);
+            } else if (arguments[1] == 1) {
+                event = event_queue_add_collapsing_event(queue, on_replay_event, replay);
+            } else {
+                event = event_queue_add_event(queue, on_replay_event, replay);
+            }
+            id_map_insert(&replay->events, (uint32_t)arguments[0], event.id);
+            break;
+        }
+
+        case trace_record_remove_event:
+            if (id_map_get(&replay->events, arguments[0], &id)) {
+                event_queue_remove_event(queue, (EventId){id});
+            }
+            break;
+
+        case trace_record_trigger_event:
+            if (id_map_get(&replay->events, arguments[0], &id)) {
+                event_queue_trigger_event(queue, (EventId){id}, NULL);
+            }
+            break;
+
+        case trace_record_add_io_event:
+            replay_add_io_event(replay, (uint32_t)arguments[0]);
+            break;
+
+        case trace_record_remove_io_event:
+            if (id_map_get(&replay->io_events, arguments[0], &id)) {
+                event_queue_remove_io_event(queue, replay->pipes[id].id);
+            }
+            break;
+
+        case trace_record_dispatch_io_event:
+            // Make the stand-in pipe readable, then dispatch it.
+            if (id_map_get(&replay->io_events, arguments[0], &id)) {
+                char byte = 0;
+                if (write(replay->pipes[id].write_fd, &byte, 1) != 1) abort();
+                event_queue_dispatch_ready_io(queue);
+            }
+            break;
+
+        case trace_record_dispatch_timer:
+        case trace_record_dispatch_event:
+            // Timers and events are dispatched by the replaying queue itself.
+            break;
+    }
+}
+
+bool event_trace_replay(FILE* file, EventTraceReport* report) {
+    *report = (EventTraceReport){0};
+
+    unsigned char magic[sizeof(trace_magic)];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < sizeof(magic); i++) {
+        if (magic[i] != trace_magic[i]) {
+            return false;
+        }
+    }
+
+    uint64_t time_us;
+    if (!read_varint(file, &time_us)) {
+        return false;
+    }
+
+    uint64_t start_us = time_us;
+
+    Replay replay = {
+        .queue = event_queue_new(),
+        .clock = virtual_clock_new(start_us),
+        .report = report,
+        .timers = id_map_new(),
+        .events = id_map_new(),
+        .io_events = id_map_new(),
+        .pipes = NULL,
+        .pipes_size = 0,
+        .pipes_capacity = 0,
+    };
+    event_queue_set_clock(&replay.queue, event_clock_virtual(&replay.clock));
+
+    uint64_t start_ns = monotonic_now_ns();
+    bool is_valid = true;
+
+    int kind;
+    while ((kind = getc(file)) != EOF) {
+        uint64_t delta_us;
+        uint64_t arguments[3] = {0};
+
+        if (kind < trace_record_add_timer || kind > trace_record_reschedule_timer
+            || !read_varint(file, &delta_us)) {
+            is_valid = false;
+            break;
+        }
+
+        for (size_t i = 0; i < argument_count(kind); i++) {
+            if (!read_varint(file, &arguments[i])) {
+                is_valid = false;
+            }
+        }
+
+        if (!is_valid) {
+            break;
+        }
+
+        time_us += delta_us;
+        advance_to(&replay, time_us);
+        replay_record(&replay, kind, arguments);
+
+        report->record_count += 1;
+
+        if (is_dispatch_record(kind)) {
+            report->recorded_dispatch_count += 1;
+        } else {
+            report->call_count += 1;
+        }
+    }
+
+    // Dispatch whatever was due by the end of the log.
+    advance_to(&replay, time_us);
+
+    report->elapsed_ns = monotonic_now_ns() - start_ns;
+    report->virtual_duration_us = time_us - start_us;
+
+    event_queue_free(&replay.queue);
+
+    for (size_t i = 0; i < replay.pipes_size; i++) {
+        close(replay.pipes[i].read_fd);
+        close(replay.pipes[i].write_fd);
+    }
+
+    free(replay.pipes);
+    id_map_free(&replay.timers);
+    id_map_free(&replay.events);
+    id_map_free(&replay.io_events);
+
+    return is_valid;
+}
+
+void event_trace_print_report(const EventTraceReport* report, FILE* file) {
+    double elapsed_s = (double)report->elapsed_ns / 1e9;
+    double virtual_s = (double)report->virtual_duration_us / 1e6;
+
+    fprintf(file, "records:             %llu\n", (unsigned long long)report->record_count);
+    fprintf(file, "calls:               %llu\n", (unsigned long long)report->call_count);
+    fprintf(
+        file, "recorded dispatches: %llu\n", (unsigned long long)report->recorded_dispatch_count);
+    fprintf(
+        file, "replayed dispatches: %llu\n", (unsigned long long)report->replayed_dispatch_count);
+    fprintf(file, "virtual duration:    %.3f s\n", virtual_s);
+    fprintf(file, "elapsed:             %.3f s\n", elapsed_s);
+
+    if (report->elapsed_ns > 0) {
+        fprintf(file, "records/s:           %.0f\n", (double)report->record_count / elapsed_s);
+        double replayed_dispatch_count = (double)report->replayed_dispatch_count;
+        fprintf(file, "dispatches/s:        %.0f\n", replayed_dispatch_count / elapsed_s);
+        fprintf(file, "speedup:             %.1fx\n", virtual_s / elapsed_s);
+    }
+}
@@ -0,0 +1,304 @@
+#include "event_watch.h"
+#include "file_watcher.h"
+#include <errno.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#define WATCHED_CHANGES (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE \
+    | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+typedef struct FileWatch {
+    uint32_t id;
+    int wd;
+    char* path;
+    FileWatchFunction callback;
+    void* userdata;
+
+    // FileWatchFlag values read since the watch was last dispatched.
+    uint32_t pending_changes;
+
+    // Set when removed during dispatch. The watch is then skipped, and compacted away after
+    // dispatch.
+    bool is_removed;
+} FileWatch;
+
+// Definition of typedef struct FileWatcher FileWatcher (in eventqueue.h):
+struct FileWatcher {
+    EventQueue* queue;
+    int inotify_fd;
+    IoEventId io_event;
+
+    uint32_t next_watch_id;
+    FileWatch* watches;
+    size_t watches_size;
+    size_t watches_capacity;
+    size_t watches_removed_count;
+    bool is_dispatching;
+};
+
+static uint32_t to_file_watch_flags(uint32_t inotify_mask) {
+    uint32_t flags = 0;
+
+    uint32_t modified_mask =
+        IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+
+    if (inotify_mask & modified_mask) {
+        flags |= file_watch_flag_modified;
+    }
+
+    if (inotify_mask & IN_ATTRIB) {
+        flags |= file_watch_flag_attributes;
+    }
+
+    if (inotify_mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+        flags |= file_watch_flag_removed;
+    }
+
+    return flags;
+}
+
+static void add_pending_changes(FileWatcher* watcher, int wd, uint32_t changes) {
+    // Several watches share a descriptor when they watch the same path.
+    for (size_t i = 0; i < watcher->watches_size; i++) {
+        if (watcher->watches[i].wd == wd) {
+            watcher->watches[i].pending_changes |= changes;
+        }
+    }
+}
+
+// Read every queued inotify event, so that a burst of changes is reported once.
+static void read_changes(FileWatcher* watcher) {
+    alignas(struct inotify_event) char buffer[4096];
+
+    while (true) {
+        ssize_t size = read(watcher->inotify_fd, buffer, sizeof(buffer));
+
+        if (size <= 0) {
+            break; // EAGAIN once drained.
+        }
+
+        ssize_t offset = 0;
+        while (offset < size) {
+            const struct inotify_event* event = (const struct inotify_event*)&buffer[offset];
+            add_pending_changes(watcher, event->wd, to_file_watch_flags(event->mask));
+            offset += (ssize_t)(sizeof(struct inotify_event) + event->len);
+        }
+    }
+}
+
+static void free_watch(FileWatch* watch) {
+    free(watch->path);
+}
+
+static bool is_descriptor_shared(const FileWatcher* watcher, int wd) {
+    size_t count = 0;
+
+    for (size_t i = 0; i < watcher->watches_size; i++) {
+        const FileWatch* watch = &watcher->watches[i];
+        if (!watch->is_removed && watch->wd == wd) {
+            count += 1;
+        }
+    }
+
+    return count > 1;
+}
+
+// Remove watches which were removed during dispatch.
+static void compact_watches(FileWatcher* watcher) {
+    size_t kept = 0;
+
+    for (size_t i = 0; i < watcher->watches_size; i++) {
+        if (watcher->watches[i].is_removed) {
+            free_watch(&watcher->watches[i]);
+        } else {
+            watcher->watches[kept] = watcher->watches[i];
+            kept += 1;
+        }
+    }
+
+    watcher->watches_size = kept;
+    watcher->watches_removed_count = 0;
+}
+
+static void on_inotify_readable(int fd, EventIoFlag flag, void* userdata) {
+    (void)fd;
+    (void)flag;
+
+    FileWatcher* watcher = userdata;
+    read_changes(watcher);
+
+    watcher->is_dispatching = true;
+
+    // Watches added by functions are appended, and have no pending changes.
+    for (size_t i = 0; i < watcher->watches_size; i++) {
+        FileWatch* watch = &watcher->watches[i];
+        uint32_t changes = watch->pending_changes;
+
+        if (watch->is_removed || changes == 0) {
+            continue;
+        }
+
+        watch->pending_changes = 0;
+
+        // Copied, since functions may add watches, moving the array.
+        FileWatch copy = *watch;
+        (*copy.callback)(copy.path, changes, copy.userdata);
+    }
+
+    watcher->is_dispatching = false;
+
+    if (watcher->watches_removed_count > 0) {
+        compact_watches(watcher);
+    }
+}
+
+// Watch the inotify fd only while watches exist, so that an otherwise idle queue can return from
+// `event_queue_wait`.
+// Returns false, with `errno` set, if the I/O event couldn't be added.
+static bool update_io_event(FileWatcher* watcher, bool had_watches) {
+    bool has_watches = watcher->watches_size > watcher->watches_removed_count;
+
+    if (has_watches && !had_watches) {
+        watcher->io_event = event_queue_add_io_event(
+            watcher->queue, watcher->inotify_fd, event_io_flag_read, on_inotify_readable, watcher);
+        return watcher->io_event.id != EVENT_QUEUE_INVALID_ID;
+    } else if (!has_watches && had_watches) {
+        event_queue_remove_io_event(watcher->queue, watcher->io_event);
+    }
+
+    return true;
+}
+
+static FileWatcher* file_watcher_new(EventQueue* queue) {
+    int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        return NULL;
+    }
+
+    FileWatch* watches = malloc(sizeof(FileWatch));
+    if (watches == NULL) abort();
+
+    FileWatcher* watcher = malloc(sizeof(FileWatcher));
+    if (watcher == NULL) abort();
+
+    *watcher = (FileWatcher){
+        .queue = queue,
+        .inotify_fd = inotify_fd,
+        .next_watch_id = 0,
+        .watches = watches,
+        .watches_size = 0,
+        .watches_capacity = 1,
+        .watches_removed_count = 0,
+        .is_dispatching = false,
+    };
+
+    return watcher;
+}
+
+void file_watcher_free(FileWatcher* watcher) {
+    for (size_t i = 0; i < watcher->watches_size; i++) {
+        free_watch(&watcher->watches[i]);
+    }
+
+    if (watcher->watches_size > watcher->watches_removed_count) {
+        event_queue_remove_io_event(watcher->queue, watcher->io_event);
+    }
+
+    close(watcher->inotify_fd);
+    free(watcher->watches);
+    free(watcher);
+}
+
+bool event_queue_add_file_watch(
+    EventQueue* queue,
+    const char* path,
+    FileWatchFunction callback,
+    void* userdata,
+    FileWatchId* out
+) {
+    if (queue->file_watcher == NULL) {
+        queue->file_watcher = file_watcher_new(queue);
+
+        if (queue->file_watcher == NULL) {
+            return false;
+        }
+    }
+
+    FileWatcher* watcher = queue->file_watcher;
+
+    int wd = inotify_add_watch(watcher->inotify_fd, path, WATCHED_CHANGES);
+    if (wd < 0) {
+        return false;
+    }
+
+    char* path_copy = strdup(path);
+    if (path_copy == NULL) abort();
+
+    if (watcher->watches_size == watcher->watches_capacity) {
+        watcher->watches_capacity *= 2;
+        watcher->watches = realloc(watcher->watches, sizeof(FileWatch) * watcher->watches_capacity);
+        if (watcher->watches == NULL) abort();
+    }
+
+    bool had_watches = watcher->watches_size > watcher->watches_removed_count;
+
+    uint32_t id = watcher->next_watch_id;
+    watcher->next_watch_id += 1;
+
+    watcher->watches[watcher->watches_size] = (FileWatch){
+        .id = id,
+        .wd = wd,
+        .path = path_copy,
+        .callback = callback,
+        .userdata = userdata,
+        .pending_changes = 0,
+        .is_removed = false,
+    };
+    watcher->watches_size += 1;
+
+    if (!update_io_event(watcher, had_watches)) {
+        // The only watch, so its descriptor isn't shared.
+        int error = errno;
+        inotify_rm_watch(watcher->inotify_fd, wd);
+        watcher->watches_size -= 1;
+        free_watch(&watcher->watches[watcher->watches_size]);
+        errno = error;
+        return false;
+    }
+
+    *out = (FileWatchId){ .id = id };
+    return true;
+}
+
+void event_queue_remove_file_watch(EventQueue* queue, FileWatchId id) {
+    FileWatcher* watcher = queue->file_watcher;
+    if (watcher == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < watcher->watches_size; i++) {
+        FileWatch* watch = &watcher->watches[i];
+
+        if (watch->is_removed || watch->id != id.id) {
+            continue;
+        }
+
+        if (!is_descriptor_shared(watcher, watch->wd)) {
+            // Fails harmlessly if the kernel already removed it, after the file was deleted.
+            inotify_rm_watch(watcher->inotify_fd, watch->wd);
+        }
+
+        watch->is_removed = true;
+        watcher->watches_removed_count += 1;
+        update_io_event(watcher, true);
+
+        if (!watcher->is_dispatching) {
+            compact_watches(watcher);
+        }
+
+        return;
+    }
+}
@@ -0,0 +1,199 @@
+#include "event_watchdog.h"
+#include "watchdog.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+// The number of times the heartbeat is checked per threshold. A stall is reported at most a
+// quarter of the threshold late.
+#define WATCHDOG_CHECKS_PER_THRESHOLD 4
+
+// Definition of typedef struct Watchdog Watchdog (in eventqueue.h):
+struct Watchdog {
+    pthread_t thread;
+    pthread_t loop_thread;
+    uint64_t threshold_us;
+    EventStallFunction callback;
+    void* userdata;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    bool is_stopping;
+
+    // Only used by the loop thread. Nested calls are attributed to the outermost function.
+    size_t depth;
+    uint64_t next_sequence;
+
+    // The heartbeat. `sequence` is non-zero while a function runs, and identifies the call. The
+    // other fields describe the call, and are written before `sequence` is published, and only
+    // once the previous call's `sequence` has been cleared. All accesses are sequentially
+    // consistent, so a check which reads the same `sequence` before and after the other fields
+    // has read a consistent description.
+    atomic_uint_fast64_t sequence;
+    atomic_uint_fast64_t started_us;
+    atomic_int kind;
+    atomic_uintptr_t function;
+    atomic_uint_fast32_t id;
+};
+
+static uint64_t monotonic_now_us(void) {
+    struct timespec timespec;
+    clock_gettime(CLOCK_MONOTONIC, &timespec);
+    return ((uint64_t)timespec.tv_sec * 1000000) + ((uint64_t)timespec.tv_nsec / 1000);
+}
+
+void watchdog_enter(
+    Watchdog* watchdog,
+    EventCallbackKind kind,
+    EventGenericFunction function,
+    uint32_t id
+) {
+    watchdog->depth += 1;
+
+    if (watchdog->depth > 1) {
+        return;
+    }
+
+    atomic_store(&watchdog->kind, (int)kind);
+    atomic_store(&watchdog->function, (uintptr_t)function);
+    atomic_store(&watchdog->id, id);
+    atomic_store(&watchdog->started_us, monotonic_now_us());
+
+    atomic_store(&watchdog->sequence, watchdog->next_sequence);
+    watchdog->next_sequence += 1;
+}
+
+void watchdog_leave(Watchdog* watchdog) {
+    watchdog->depth -= 1;
+
+    if (watchdog->depth == 0) {
+        atomic_store(&watchdog->sequence, 0);
+    }
+}
+
+// Check the heartbeat, and report the running function if it has stalled and wasn't reported yet.
+static void check_heartbeat(Watchdog* watchdog, uint64_t* reported_sequence) {
+    uint64_t sequence = atomic_load(&watchdog->sequence);
+
+    if (sequence == 0 || sequence == *reported_sequence) {
+        return;
+    }
+
+    EventStall stall = {
+        .kind = (EventCallbackKind)atomic_load(&watchdog->kind),
+        .function = (EventGenericFunction)atomic_load(&watchdog->function),
+        .id = (uint32_t)atomic_load(&watchdog->id),
+        .thread = watchdog->loop_thread,
+    };
+    uint64_t started_us = atomic_load(&watchdog->started_us);
+
+    if (atomic_load(&watchdog->sequence) != sequence) {
+        return; // Finished while being read.
+    }
+
+    uint64_t now_us = monotonic_now_us();
+    stall.running_us = (now_us > started_us) ? (now_us - started_us) : 0;
+
+    if (stall.running_us >= watchdog->threshold_us) {
+        *reported_sequence = sequence;
+        (*watchdog->callback)(&stall, watchdog->userdata);
+    }
+}
+
+static void* watchdog_thread(void* userdata) {
+    Watchdog* watchdog = userdata;
+
+    uint64_t period_us = watchdog->threshold_us / WATCHDOG_CHECKS_PER_THRESHOLD;
+    if (period_us == 0) {
+        period_us = 1;
+    }
+
+    uint64_t reported_sequence = 0;
+
+    pthread_mutex_lock(&watchdog->mutex);
+
+    while (!watchdog->is_stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+        uint64_t nanoseconds = (uint64_t)deadline.tv_nsec + (period_us * 1000);
+        deadline.tv_sec += (time_t)(nanoseconds / 1000000000);
+        deadline.tv_nsec = (long)(nanoseconds % 1000000000);
+
+        pthread_cond_timedwait(&watchdog->condition, &watchdog->mutex, &deadline);
+
+        if (watchdog->is_stopping) {
+            break;
+        }
+
+        pthread_mutex_unlock(&watchdog->mutex);
+        check_heartbeat(watchdog, &reported_sequence);
+        pthread_mutex_lock(&watchdog->mutex);
+    }
+
+    pthread_mutex_unlock(&watchdog->mutex);
+
+    return NULL;
+}
+
+static Watchdog* watchdog_new(uint64_t threshold_us, EventStallFunction callback, void* userdata) {
+    Watchdog* watchdog = malloc(sizeof(Watchdog));
+    if (watchdog == NULL) abort();
+
+    watchdog->loop_thread = pthread_self();
+    watchdog->threshold_us = threshold_us;
+    watchdog->callback = callback;
+    watchdog->userdata = userdata;
+    watchdog->is_stopping = false;
+    watchdog->depth = 0;
+    watchdog->next_sequence = 1;
+
+    atomic_init(&watchdog->sequence, 0);
+    atomic_init(&watchdog->started_us, 0);
+    atomic_init(&watchdog->kind, 0);
+    atomic_init(&watchdog->function, 0);
+    atomic_init(&watchdog->id, 0);
+
+    pthread_condattr_t condition_attributes;
+    if (pthread_condattr_init(&condition_attributes) != 0) abort();
+    if (pthread_condattr_setclock(&condition_attributes, CLOCK_MONOTONIC) != 0) abort();
+
+    if (pthread_mutex_init(&watchdog->mutex, NULL) != 0) abort();
+    if (pthread_cond_init(&watchdog->condition, &condition_attributes) != 0) abort();
+    pthread_condattr_destroy(&condition_attributes);
+
+    if (pthread_create(&watchdog->thread, NULL, watchdog_thread, watchdog) != 0) abort();
+
+    return watchdog;
+}
+
+void watchdog_free(Watchdog* watchdog) {
+    pthread_mutex_lock(&watchdog->mutex);
+    watchdog->is_stopping = true;
+    pthread_cond_signal(&watchdog->condition);
+    pthread_mutex_unlock(&watchdog->mutex);
+
+    pthread_join(watchdog->thread, NULL);
+
+    pthread_cond_destroy(&watchdog->condition);
+    pthread_mutex_destroy(&watchdog->mutex);
+    free(watchdog);
+}
+
+void event_queue_start_watchdog(
+    EventQueue* queue,
+    uint64_t threshold_us,
+    EventStallFunction callback,
+    void* userdata
+) {
+    event_queue_stop_watchdog(queue);
+    queue->watchdog = watchdog_new(threshold_us, callback, userdata);
+}
+
+void event_queue_stop_watchdog(EventQueue* queue) {
+    if (queue->watchdog != NULL) {
+        watchdog_free(queue->watchdog);
+        queue->watchdog = NULL;
+    }
+}
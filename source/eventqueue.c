@@ -1,42 +1,174 @@
 #include "eventqueue.h"
-#include "eq_time.h"
+#include "eventqueue_internal.h"
+#include "work_pool.h"
+#include "fiber_pool.h"
+#include "channel_hub.h"
+#include "trace_recorder.h"
+#include "file_watcher.h"
+#include "watchdog.h"
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <poll.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+// How repeated triggers of an event, made before it is dispatched, are delivered. Values are
+// stored in trace logs.
+typedef enum EventCoalesceMode {
+    // Every trigger results in a separate call of the event's function.
+    event_coalesce_mode_none,
+
+    // Pending triggers collapse into a single call, given the most recent `eventdata`.
+    event_coalesce_mode_collapse,
+
+    // Pending triggers are delivered in a single call of the event's batch function.
+    event_coalesce_mode_batch,
+} EventCoalesceMode;
+
+// A function to call once, the next time an event is dispatched.
+typedef struct EventWaiter {
+    EventFunction callback;
+    void* userdata;
+} EventWaiter;
+
+// A trigger of an event which doesn't coalesce, waiting to be dispatched.
+typedef struct PendingTrigger {
+    void* eventdata;
+    uint64_t time_us;
+    uint64_t expires_us;
+} PendingTrigger;
 
 // Definition of typedef struct Event Event (in header);
 struct Event {
     uint32_t id;
     void* userdata;
     EventFunction callback;
+    EventBatchFunction batch_callback;
+    EventCoalesceMode coalesce_mode;
+
+    // Added by the library for itself, so not subject to the queue's pending limit. Only
+    // collapsing events are. See `event_queue_add_internal_event`.
+    bool is_internal;
+
+    // Releases the `eventdata` of discarded triggers. May be NULL.
+    EventDestroyFunction destroy;
+
+    // Whether a dispatch of this event is in the timer queue. There is at most one at a time.
+    bool is_scheduled;
+
+    // The number of delayed triggers of this event in the timer queue.
+    size_t delayed_count;
+
+    // Whether any trigger was given an expiry. Until then, dispatches don't read the clock.
+    bool has_expiry;
+
+    // Every pending trigger, oldest first, in a ring. Only used by events which don't coalesce.
+    PendingTrigger* pending;
+    size_t pending_head;
+    size_t pending_capacity;
+
+    // The number of pending triggers, and when the oldest was made, for any mode.
+    size_t pending_count;
+    uint64_t oldest_trigger_us;
+
+    // The most pending triggers allowed, or 0 for no limit, and what happens to triggers beyond it.
+    size_t pending_limit;
+    EventOverflowPolicy overflow_policy;
+    uint64_t dropped_count;
+
+    // The `eventdata` and expiry of the most recent trigger. Only used by collapsing events.
+    void* latest_eventdata;
+    uint64_t latest_expires_us;
+
+    // The `eventdata` of every pending trigger, in trigger order, and their expiries alongside.
+    // Only used by batch events. Each array has room for `batch_capacity` entries. The spare arrays
+    // take the place of the others while a batch is delivered, so that triggers made meanwhile
+    // don't allocate. NULL while they're in use.
+    void** batch;
+    uint64_t* batch_expiry;
+    void** spare_batch;
+    uint64_t* spare_batch_expiry;
+    size_t batch_size;
+    size_t batch_capacity;
+
+    // One-shot functions to call after the next dispatch. See `event_queue_add_event_waiter`.
+    // `spare_waiters` has as much room, and takes the place of `waiters` while they're called, so
+    // that waiters added again by them don't allocate. NULL while it's in use.
+    EventWaiter* waiters;
+    EventWaiter* spare_waiters;
+    size_t waiters_size;
+    size_t waiters_capacity;
 };
 
 // Definition of typedef struct IoEvent IoEvent (in header):
 struct IoEvent {
     uint32_t id;
+    int fd;
     EventIoFunction callback;
     void* userdata;
+
+    // Called on removal, for I/O events owned by the library. May be NULL.
+    EventIoDestroyFunction destroy;
+
+    // Set when removed during dispatch. The event is then skipped, and compacted away after
+    // dispatch, so that positions don't change under the dispatch loop.
+    bool is_removed;
+};
+
+// When a hook is called. See `event_queue_add_prepare_hook` and related functions.
+typedef enum HookKind {
+    hook_kind_prepare,
+    hook_kind_check,
+    hook_kind_idle,
+    hook_kind_task,
+} HookKind;
+
+// Definition of typedef struct Hook Hook (in header):
+struct Hook {
+    uint32_t id;
+    HookKind kind;
+    EventHookFunction callback;
+    EventIdleFunction idle_callback;
+    EventTaskFunction task_callback;
+    void* userdata;
+
+    // Set when removed while hooks are running. Compacted away after they finish.
+    bool is_removed;
 };
 
+// Marks a file descriptor without an I/O event in `io_fd_indices`.
+#define NO_IO_EVENT SIZE_MAX
+
+static void reallocate_events(EventQueue* queue, size_t capacity) {
+    queue->events = realloc(queue->events, sizeof(Event) * capacity);
+    if (queue->events == NULL) abort();
+
+    queue->events_capacity = capacity;
+}
+
 static void reallocate_events_if_at_capacity(EventQueue* queue) {
     if (queue->events_size == queue->events_capacity) {
-        queue->events_capacity *= 2;
-        queue->events = realloc(queue->events, sizeof(Event) * queue->events_capacity);
-        if (queue->events == NULL) abort();
+        reallocate_events(queue, queue->events_capacity * 2);
     }
 }
 
-void reallocate_io_events_if_at_capacity(EventQueue* queue) {
-    if (queue->io_events_size == queue->io_events_capacity) {
-        queue->io_events_capacity *= 2;
+static void reallocate_io_events(EventQueue* queue, size_t capacity) {
+    queue->io_events = realloc(queue->io_events, sizeof(IoEvent) * capacity);
+    if (queue->io_events == NULL) abort();
+
+    queue->io_poll_descriptors = realloc(
+        queue->io_poll_descriptors, sizeof(struct pollfd) * capacity);
+    if (queue->io_poll_descriptors == NULL) abort();
 
-        queue->io_events = realloc(queue->io_events, sizeof(IoEvent) * queue->io_events_capacity);
-        if (queue->io_events == NULL) abort();
+    queue->io_events_capacity = capacity;
+}
 
-        queue->io_poll_descriptors = realloc(
-            queue->io_poll_descriptors, sizeof(struct pollfd) * queue->io_events_capacity);
-        if (queue->io_poll_descriptors == NULL) abort();
+static void reallocate_io_events_if_at_capacity(EventQueue* queue) {
+    if (queue->io_events_size == queue->io_events_capacity) {
+        reallocate_io_events(queue, queue->io_events_capacity * 2);
     }
 }
 
@@ -58,18 +190,48 @@ static bool get_event_by_id(const EventQueue* queue, EventId id, size_t* out) {
     return false;
 }
 
+static size_t get_io_event_index_by_fd(const EventQueue* queue, int fd) {
+    if (fd < 0 || (size_t)fd >= queue->io_fd_indices_capacity) {
+        return NO_IO_EVENT;
+    }
+
+    return queue->io_fd_indices[fd];
+}
+
 static bool get_io_event_by_id(const EventQueue* queue, IoEventId id, size_t* out) {
-    // TODO: Replace with binary search
-    for (size_t i = 0; i < queue->io_events_size; i++) {
-        if (queue->io_events[i].id == id.id) {
-            *out = i;
-            return true;
-        }
+    size_t index = get_io_event_index_by_fd(queue, id.fd);
+
+    // The ID must match too, in case the fd has been re-registered since.
+    if (index != NO_IO_EVENT && queue->io_events[index].id == id.id) {
+        *out = index;
+        return true;
     }
 
     return false;
 }
 
+static void reallocate_io_fd_indices_to_fit(EventQueue* queue, int fd) {
+    size_t old_capacity = queue->io_fd_indices_capacity;
+
+    if ((size_t)fd < old_capacity) {
+        return;
+    }
+
+    size_t new_capacity = (old_capacity == 0) ? 16 : old_capacity;
+    while (new_capacity <= (size_t)fd) {
+        new_capacity *= 2;
+    }
+
+    queue->io_fd_indices = realloc(queue->io_fd_indices, sizeof(size_t) * new_capacity);
+    if (queue->io_fd_indices == NULL) abort();
+
+    for (size_t i = old_capacity; i < new_capacity; i++) {
+        queue->io_fd_indices[i] = NO_IO_EVENT;
+    }
+
+    queue->io_fd_indices_capacity = new_capacity;
+}
+
 // given `array`, containing `length` elements of size `size`, remove the `index`th element, and
 // shift subsequent element down by 1.
 static void remove_array_element(size_t size, size_t length, void* array, size_t index) {
@@ -79,248 +241,2169 @@ static void remove_array_element(size_t size, size_t length, void* array, size_t
     memmove(destination, source, amount);
 }
 
-static void remove_event_at_position(EventQueue* queue, size_t index) {
-    remove_array_element(sizeof(Event), queue->events_size, queue->events, index);
-    queue->events_size -= 1;
+static void remove_hook_at_position(EventQueue* queue, size_t index) {
+    remove_array_element(sizeof(Hook), queue->hooks_size, queue->hooks, index);
+    queue->hooks_size -= 1;
 }
 
-static void remove_io_event_at_position(EventQueue* queue, size_t index) {
-    remove_array_element(sizeof(IoEvent), queue->io_events_size, queue->io_events, index);
-    remove_array_element(sizeof(struct pollfd), queue->io_events_size, queue->io_poll_descriptors, index);
-    queue->io_events_size -= 1;
-}
+static bool has_hooks_of_kind(const EventQueue* queue, HookKind kind) {
+    for (size_t i = 0; i < queue->hooks_size; i++) {
+        if (queue->hooks[i].kind == kind && !queue->hooks[i].is_removed) {
+            return true;
+        }
+    }
 
-static void push_event_to_timer_queue(EventQueue* queue, EventId id, void* eventdata) {
-    Timer timer = {
-        .is_event = true,
-        .deadline = time_now_us(),
-        .period = 0, // Unused
-        .callback = NULL, // Unused
-        .userdata = eventdata,
-        .id = id.id,
-    };
-    timer_heap_insert(&queue->timers, timer);
+    return false;
 }
 
-EventQueue event_queue_new(void) {
-    TimerHeap timers = timer_heap_new();
+// Release the `eventdata` of a trigger which won't be dispatched.
+static void discard_trigger(const Event* event, void* eventdata) {
+    if (event->destroy != NULL) {
+        (*event->destroy)(event->userdata, eventdata);
+    }
+}
 
-    Event* events = malloc(sizeof(Event));
-    if (events == NULL) abort();
+// Release the `eventdata` of every pending trigger of an event, which is going away.
+static void discard_pending_triggers(const Event* event) {
+    if (event->destroy == NULL || event->pending_count == 0) {
+        return;
+    }
 
-    struct pollfd* io_poll_descriptors = malloc(sizeof(struct pollfd));
-    if (io_poll_descriptors == NULL) abort();
+    switch (event->coalesce_mode) {
+        case event_coalesce_mode_none:
+            for (size_t i = 0; i < event->pending_count; i++) {
+                size_t position = (event->pending_head + i) % event->pending_capacity;
+                discard_trigger(event, event->pending[position].eventdata);
+            }
+            break;
 
-    IoEvent* io_events = malloc(sizeof(IoEvent));
-    if (io_events == NULL) abort();
+        case event_coalesce_mode_collapse:
+            discard_trigger(event, event->latest_eventdata);
+            break;
 
-    return (EventQueue){
-        .next_timer_id = 0,
-        .next_event_id = 0,
-        .timers = timers,
-        .events = events,
-        .events_size = 0,
-        .events_capacity = 1,
-        .io_poll_descriptors = io_poll_descriptors,
-        .io_events = io_events,
-        .io_events_size = 0,
-        .io_events_capacity = 1,
-    };
+        case event_coalesce_mode_batch:
+            for (size_t i = 0; i < event->batch_size; i++) {
+                discard_trigger(event, event->batch[i]);
+            }
+            break;
+    }
 }
 
-TimerId event_queue_add_timer(
-    EventQueue* queue,
-    uint64_t delay_us,
-    TimerFunction callback,
-    void* userdata
-) {
-    return event_queue_add_periodic_timer(queue, delay_us, TIMER_APERIODIC, callback, userdata);
-}
+// Release the `eventdata` of the delayed triggers in the timer queue, of one event or, if `event`
+// is NULL, of every event.
+static void discard_delayed_triggers(EventQueue* queue, const Event* event) {
+    for (size_t i = 0; i < queue->timers.size; i++) {
+        const Timer* timer = &queue->timers.data[i];
 
-TimerId event_queue_add_periodic_timer(
-    EventQueue* queue,
-    uint64_t delay_us,
-    uint64_t period_us,
-    TimerFunction callback,
-    void* userdata
-) {
-    uint32_t id = queue->next_timer_id;
-    queue->next_timer_id += 1;
+        if (!timer->is_delayed_trigger) {
+            continue;
+        }
 
-    uint64_t now = time_now_us();
+        size_t index;
+        if (event != NULL) {
+            if (timer->id == event->id) {
+                discard_trigger(event, timer->userdata);
+            }
+        } else if (get_event_by_id(queue, (EventId){timer->id}, &index)) {
+            discard_trigger(&queue->events[index], timer->userdata);
+        }
+    }
+}
 
-    Timer timer = {
-        .is_event = false,
-        .id = id,
-        .deadline = now + delay_us,
-        .period = period_us,
-        .callback = callback,
-        .userdata = userdata,
-    };
+static void remove_event_at_position(EventQueue* queue, size_t index) {
+    Event* event = &queue->events[index];
 
-    timer_heap_insert(&queue->timers, timer);
+    // A dispatch left in the timer queue finds no event, and is skipped.
+    discard_pending_triggers(event);
+    queue->pending_event_count -= event->pending_count;
+    if (event->is_internal) {
+        queue->internal_pending_event_count -= event->pending_count;
+    }
 
-    return (TimerId){id};
+    if (event->delayed_count > 0) {
+        discard_delayed_triggers(queue, event);
+        timer_heap_remove_delayed_triggers(&queue->timers, event->id);
+        queue->delayed_event_count -= event->delayed_count;
+    }
+
+    free(event->pending);
+    free(event->batch);
+    free(event->batch_expiry);
+    free(event->spare_batch);
+    free(event->spare_batch_expiry);
+    free(event->waiters);
+    free(event->spare_waiters);
+    remove_array_element(sizeof(Event), queue->events_size, queue->events, index);
+    queue->events_size -= 1;
 }
 
-void event_queue_remove_timer(EventQueue* queue, TimerId id) {
-    timer_heap_remove_id(&queue->timers, id);
+static uint32_t poll_events_to_epoll_events(short events) {
+    uint32_t epoll_events = 0;
+
+    if (events & POLLIN) epoll_events |= EPOLLIN;
+    if (events & POLLOUT) epoll_events |= EPOLLOUT;
+
+    return epoll_events;
 }
 
-EventId event_queue_add_event(EventQueue* queue, EventFunction callback, void* userdata) {
-    uint32_t id = queue->next_event_id;
-    queue->next_event_id += 1;
+// Mirror a change to the I/O events in the backend fd's epoll set (see `event_queue_get_fd`), if it
+// exists.
+static void update_backend_io_event(EventQueue* queue, int operation, int fd, short events) {
+    if (queue->backend_fd < 0) {
+        return;
+    }
 
-    Event event = {
-        .id = id,
-        .callback = callback,
-        .userdata = userdata,
+    struct epoll_event event = {
+        .events = poll_events_to_epoll_events(events),
+        .data.fd = fd,
     };
 
-    push_event(queue, event);
+    // Fails if the fd was closed before its I/O event was removed, which epoll handles itself.
+    (void)epoll_ctl(queue->backend_fd, operation, fd, &event);
+}
 
-    return (EventId){id};
+// Remove the I/O event at `index` by moving the last one into its place.
+static void swap_remove_io_event_at_position(EventQueue* queue, size_t index) {
+    size_t last = queue->io_events_size - 1;
+
+    queue->io_events[index] = queue->io_events[last];
+    queue->io_poll_descriptors[index] = queue->io_poll_descriptors[last];
+    queue->io_events_size -= 1;
+
+    if (index != last && !queue->io_events[index].is_removed) {
+        queue->io_fd_indices[queue->io_events[index].fd] = index;
+    }
 }
 
-void event_queue_remove_event(EventQueue* queue, EventId id) {
-    size_t index;
-    if (get_event_by_id(queue, id, &index)) {
-        remove_event_at_position(queue, index);
+static void remove_io_event_at_position(EventQueue* queue, size_t index) {
+    IoEvent* event = &queue->io_events[index];
+    queue->io_fd_indices[event->fd] = NO_IO_EVENT;
+
+    // Before destroying, which may close the fd.
+    update_backend_io_event(queue, EPOLL_CTL_DEL, event->fd, 0);
+
+    if (event->destroy != NULL) {
+        (*event->destroy)(event->userdata);
+    }
+
+    if (queue->is_dispatching_io) {
+        event->is_removed = true;
+        queue->io_poll_descriptors[index].fd = -1; // Ignored by `poll`.
+        queue->io_events_removed_count += 1;
+    } else {
+        swap_remove_io_event_at_position(queue, index);
     }
-    // TODO: Handle case of invalid ID?
 }
 
-void event_queue_trigger_event(EventQueue* queue, EventId id, void* eventdata) {
-    size_t index;
-    if (get_event_by_id(queue, id, &index)) {
-        push_event_to_timer_queue(queue, id, eventdata);
+// Remove I/O events which were removed during dispatch.
+static void compact_io_events(EventQueue* queue) {
+    size_t index = 0;
+
+    while (queue->io_events_removed_count > 0 && index < queue->io_events_size) {
+        if (queue->io_events[index].is_removed) {
+            // Check this position again, since another event has moved into it.
+            swap_remove_io_event_at_position(queue, index);
+            queue->io_events_removed_count -= 1;
+        } else {
+            index += 1;
+        }
     }
-    // TODO: Handle case of invalid ID?
 }
 
-IoEventId event_queue_add_io_event(
-    EventQueue* queue,
-    int fd,
-    uint32_t mask,
-    EventIoFunction callback,
-    void* userdata
-) {
-    // TODO: Support non-read IO events.
-    assert(mask == event_io_flag_read);
+static short mask_to_poll_events(uint32_t mask) {
+    short events = 0;
 
-    reallocate_io_events_if_at_capacity(queue);
+    if ((mask & event_io_flag_read) != 0) events |= POLLIN;
+    if ((mask & event_io_flag_write) != 0) events |= POLLOUT;
 
-    struct pollfd pollfd = {
-        .fd = fd,
-        .events = POLLIN,
-        .revents = 0,
-    };
+    return events;
+}
 
-    uint32_t id = queue->next_io_event_id;
-    queue->next_io_event_id += 1;
+static uint64_t queue_now_us(const EventQueue* queue) {
+    return (*queue->clock.now_us)(queue->clock.context);
+}
 
-    IoEvent event = {
-        .id = id,
-        .callback = callback,
-        .userdata = userdata,
-    };
+static void queue_sleep_until(const EventQueue* queue, uint64_t deadline_us) {
+    (*queue->clock.sleep_until)(queue->clock.context, deadline_us);
+}
 
-    queue->io_poll_descriptors[queue->io_events_size] = pollfd;
-    queue->io_events[queue->io_events_size] = event;
-    queue->io_events_size += 1;
+static void record(EventQueue* queue, TraceRecordKind kind, uint64_t a, uint64_t b, uint64_t c) {
+    if (queue->recorder != NULL) {
+        trace_recorder_write(queue->recorder, kind, queue_now_us(queue), a, b, c);
+    }
+}
 
-    return (IoEventId){id};
+// Tell the watchdog, if any, that a function is about to be called. See `event_watchdog.h`.
+static void watch_enter(
+    EventQueue* queue,
+    EventCallbackKind kind,
+    EventGenericFunction function,
+    uint32_t id
+) {
+    if (queue->watchdog != NULL) {
+        watchdog_enter(queue->watchdog, kind, function, id);
+    }
 }
 
-void event_queue_remove_io_event(EventQueue* queue, IoEventId id) {
-    size_t index;
-    if (get_io_event_by_id(queue, id, &index)) {
-        remove_io_event_at_position(queue, index);
+// Tell the watchdog, if any, that the function given to `watch_enter` has returned.
+static void watch_leave(EventQueue* queue) {
+    if (queue->watchdog != NULL) {
+        watchdog_leave(queue->watchdog);
     }
 }
 
-static bool handle_io_events(EventQueue* queue, int timeout_ms) {
-    if (queue->io_events_size == 0) {
-        return false; // Handled no events, report false.
+// Arm the backend fd (see `event_queue_get_fd`)'s timerfd for the earliest timer, if it changed.
+static void update_backend_timer(EventQueue* queue) {
+    if (queue->backend_fd < 0) {
+        return;
     }
 
-    int poll_status = poll(queue->io_poll_descriptors, queue->io_events_size, timeout_ms);
+    const Timer* next = timer_heap_find(&queue->timers);
+    bool has_deadline = next != NULL;
+    uint64_t deadline_us = has_deadline ? next->deadline : 0;
 
-    if (poll_status > 0) {
-        for (size_t i = 0; i < queue->io_events_size; i++) {
-            struct pollfd* polllfd = &queue->io_poll_descriptors[i];
+    // The timerfd runs on the system clock, which a virtual clock has nothing to do with, so only
+    // timers which are due already arm it.
+    if (has_deadline && queue->clock.is_virtual && deadline_us > queue_now_us(queue)) {
+        has_deadline = false;
+    }
 
-            if ((polllfd->revents & POLLIN) != 0) {
-                IoEvent event = queue->io_events[i];
-                (*event.callback)(polllfd->fd, event_io_flag_read, event.userdata);
-            }
+    // Remaining tasks are always ready to run.
+    if (has_hooks_of_kind(queue, hook_kind_task)) {
+        has_deadline = true;
+        deadline_us = 0;
+    }
+
+    struct itimerspec timer_spec = {0}; // Disarms the timer.
 
-            polllfd->revents = 0;
+    if (!has_deadline) {
+        if (!queue->is_backend_timer_armed) {
+            return;
         }
 
-        return true;
+        queue->is_backend_timer_armed = false;
     } else {
-        // TODO: Handle poll error and timeout.
-        return false;
-    }
-}
+        if (queue->is_backend_timer_armed && queue->backend_timer_deadline == deadline_us) {
+            return;
+        }
 
-static bool handle_event_timer(EventQueue* queue, Timer timer) {
-    // NOTE: Currently, there's no deadline check/wait for events. Since they're 'immediate,'
-    // they should always be executed without delay.
+        uint64_t now_us = queue_now_us(queue);
+        uint64_t remaining_us = (deadline_us > now_us) ? (deadline_us - now_us) : 0;
 
-    EventId id = (EventId){timer.id};
+        // An all-zero time disarms the timer, so due timers expire after a nanosecond instead.
+        timer_spec.it_value.tv_sec = (time_t)(remaining_us / 1000000);
+        timer_spec.it_value.tv_nsec = (long)((remaining_us % 1000000) * 1000);
+        if (remaining_us == 0) {
+            timer_spec.it_value.tv_nsec = 1;
+        }
 
-    size_t index;
-    if (get_event_by_id(queue, id, &index)) {
-        Event event = queue->events[index];
-        (*event.callback)(event.userdata, timer.userdata);
+        queue->is_backend_timer_armed = true;
+        queue->backend_timer_deadline = deadline_us;
     }
 
-    return true;
+    if (timerfd_settime(queue->backend_timer_fd, 0, &timer_spec, NULL) != 0) abort();
 }
 
-static bool handle_ordinary_timer(EventQueue* queue, Timer timer) {
-    uint64_t now_us = time_now_us();
+// Whether another timer fits. Tables grow as needed, except in real-time mode, where only reserved
+// capacity is used.
+static bool has_timer_capacity(const EventQueue* queue, size_t count) {
+    return !queue->is_realtime || queue->timers.size + count <= queue->timers.capacity;
+}
 
-    if (timer.deadline > now_us) {
-        int timeout_ms = (timer.deadline - now_us) / 1000;
-        handle_io_events(queue, timeout_ms);
+// Schedule a dispatch of event `id`, for its trigger made at `time_us`.
+static void push_event_to_timer_queue(EventQueue* queue, EventId id, uint64_t time_us) {
+    Timer timer = {
+        .is_event = true,
+        .deadline = time_us,
+        .period = 0, // Unused
+        .callback = NULL, // Unused
+        .userdata = NULL, // Unused
+        .id = id.id,
+    };
+    timer_heap_insert(&queue->timers, timer);
+    queue->scheduled_event_count += 1;
+    update_backend_timer(queue);
+}
 
-        // millisecond granularity of `poll` might not take us up to actual deadline, so sleep
-        // again using microsecond deadline:
-        time_sleep_until(timer.deadline);
+static void reallocate_pending_triggers(Event* event, size_t capacity) {
+    PendingTrigger* pending = malloc(sizeof(PendingTrigger) * capacity);
+    if (pending == NULL) abort();
+
+    // Unwrap the ring, so that the oldest trigger is first.
+    for (size_t i = 0; i < event->pending_count; i++) {
+        pending[i] = event->pending[(event->pending_head + i) % event->pending_capacity];
     }
 
-    // Trigger the timer's callback function.
-    (*timer.callback)(timer.userdata);
+    free(event->pending);
+    event->pending = pending;
+    event->pending_head = 0;
+    event->pending_capacity = capacity;
+}
 
-    bool is_periodic = timer.period != TIMER_APERIODIC;
-    if (is_periodic) {
-        // TODO: This can be optimized by checking if the timer is reinserted before the binary
-        // tree sift-down in timer_heap_take.
-        timer.deadline += timer.period;
-        timer_heap_insert(&queue->timers, timer);
+static void push_pending_trigger(
+    Event* event,
+    void* eventdata,
+    uint64_t time_us,
+    uint64_t expires_us
+) {
+    if (event->pending_count == event->pending_capacity) {
+        size_t capacity = (event->pending_capacity == 0) ? 1 : (event->pending_capacity * 2);
+        reallocate_pending_triggers(event, capacity);
     }
 
-    return true;
+    size_t position = (event->pending_head + event->pending_count) % event->pending_capacity;
+    event->pending[position] = (PendingTrigger){
+        .eventdata = eventdata,
+        .time_us = time_us,
+        .expires_us = expires_us,
+    };
 }
 
-bool event_queue_wait(EventQueue* queue) {
-    Timer timer;
-    if (!timer_heap_take(&queue->timers, &timer)) {
-        const int infinite_timeout = -1;
-        return handle_io_events(queue, infinite_timeout);
+// Take the oldest pending trigger of an event which doesn't coalesce. Updates `pending_count`.
+static PendingTrigger pop_pending_trigger(EventQueue* queue, Event* event) {
+    PendingTrigger trigger = event->pending[event->pending_head];
+    event->pending_head = (event->pending_head + 1) % event->pending_capacity;
+
+    event->pending_count -= 1;
+    queue->pending_event_count -= 1;
+
+    if (event->pending_count > 0) {
+        event->oldest_trigger_us = event->pending[event->pending_head].time_us;
+    }
+
+    return trigger;
+}
+
+static void push_to_event_batch(Event* event, void* eventdata, uint64_t expires_us) {
+    if (event->batch_size == event->batch_capacity) {
+        event->batch_capacity = (event->batch_capacity == 0) ? 1 : (event->batch_capacity * 2);
+        size_t batch_size = sizeof(void*) * event->batch_capacity;
+        size_t expiry_size = sizeof(uint64_t) * event->batch_capacity;
+
+        event->batch = realloc(event->batch, batch_size);
+        event->batch_expiry = realloc(event->batch_expiry, expiry_size);
+        event->spare_batch = realloc(event->spare_batch, batch_size);
+        event->spare_batch_expiry = realloc(event->spare_batch_expiry, expiry_size);
+
+        if (event->batch == NULL || event->batch_expiry == NULL || event->spare_batch == NULL
+            || event->spare_batch_expiry == NULL) {
+            abort();
+        }
+    }
+
+    event->batch[event->batch_size] = eventdata;
+    event->batch_expiry[event->batch_size] = expires_us;
+    event->batch_size += 1;
+}
+
+// Add a trigger, made at `time_us`, to an event's pending triggers. A collapsing event with a
+// pending trigger replaces its `eventdata` instead, discarding the one it had.
+static void add_pending_trigger(
+    EventQueue* queue,
+    Event* event,
+    void* eventdata,
+    uint64_t time_us,
+    uint64_t expires_us
+) {
+    if (expires_us != EVENT_QUEUE_NO_EXPIRY) {
+        event->has_expiry = true;
+    }
+
+    switch (event->coalesce_mode) {
+        case event_coalesce_mode_none:
+            push_pending_trigger(event, eventdata, time_us, expires_us);
+            break;
+
+        case event_coalesce_mode_collapse:
+            if (event->pending_count > 0) {
+                discard_trigger(event, event->latest_eventdata);
+            }
+
+            event->latest_eventdata = eventdata;
+            event->latest_expires_us = expires_us;
+
+            if (event->pending_count > 0) {
+                return;
+            }
+            break;
+
+        case event_coalesce_mode_batch:
+            push_to_event_batch(event, eventdata, expires_us);
+            break;
+    }
+
+    if (event->pending_count == 0) {
+        event->oldest_trigger_us = time_us;
+    }
+
+    event->pending_count += 1;
+    queue->pending_event_count += 1;
+    if (event->is_internal) {
+        queue->internal_pending_event_count += 1;
+    }
+}
+
+// Drop the oldest pending trigger of an event, to make room for a newer one. The event's dispatch
+// stays in the timer queue, and is skipped if nothing is left.
+static void drop_oldest_trigger(EventQueue* queue, Event* event) {
+    switch (event->coalesce_mode) {
+        case event_coalesce_mode_none:
+            discard_trigger(event, pop_pending_trigger(queue, event).eventdata);
+            break;
+
+        case event_coalesce_mode_collapse:
+            discard_trigger(event, event->latest_eventdata);
+            event->latest_eventdata = NULL;
+            event->pending_count -= 1;
+            queue->pending_event_count -= 1;
+            if (event->is_internal) {
+                queue->internal_pending_event_count -= 1;
+            }
+            break;
+
+        case event_coalesce_mode_batch:
+            discard_trigger(event, event->batch[0]);
+            remove_array_element(sizeof(void*), event->batch_size, event->batch, 0);
+            remove_array_element(sizeof(uint64_t), event->batch_size, event->batch_expiry, 0);
+            event->batch_size -= 1;
+            event->pending_count -= 1;
+            queue->pending_event_count -= 1;
+            break;
+    }
+
+    event->dropped_count += 1;
+    queue->dropped_event_count += 1;
+}
+
+static bool is_expired(uint64_t expires_us, uint64_t now_us) {
+    return now_us >= expires_us;
+}
+
+// Discard an event's pending triggers which have expired. The triggers of events which don't
+// coalesce are discarded from the oldest, until one hasn't expired, so that each is looked at once;
+// any which expire behind it are discarded once they're the oldest, before being dispatched.
+static void discard_expired_triggers(EventQueue* queue, Event* event, uint64_t now_us) {
+    size_t expired_count = 0;
+
+    switch (event->coalesce_mode) {
+        case event_coalesce_mode_none:
+            while (event->pending_count > 0
+                && is_expired(event->pending[event->pending_head].expires_us, now_us)) {
+                discard_trigger(event, pop_pending_trigger(queue, event).eventdata);
+                expired_count += 1;
+            }
+            break;
+
+        case event_coalesce_mode_collapse:
+            if (event->pending_count > 0 && is_expired(event->latest_expires_us, now_us)) {
+                discard_trigger(event, event->latest_eventdata);
+                event->latest_eventdata = NULL;
+                event->pending_count = 0;
+                queue->pending_event_count -= 1;
+                if (event->is_internal) {
+                    queue->internal_pending_event_count -= 1;
+                }
+                expired_count = 1;
+            }
+            break;
+
+        case event_coalesce_mode_batch: {
+            size_t kept = 0;
+
+            for (size_t i = 0; i < event->batch_size; i++) {
+                if (is_expired(event->batch_expiry[i], now_us)) {
+                    discard_trigger(event, event->batch[i]);
+                } else {
+                    event->batch[kept] = event->batch[i];
+                    event->batch_expiry[kept] = event->batch_expiry[i];
+                    kept += 1;
+                }
+            }
+
+            expired_count = event->batch_size - kept;
+            event->batch_size = kept;
+            event->pending_count -= expired_count;
+            queue->pending_event_count -= expired_count;
+            break;
+        }
+    }
+
+    queue->expired_event_count += expired_count;
+}
+
+// Find the event with the oldest pending trigger, for dropping when the queue's limit is reached.
+static Event* find_oldest_pending_event(EventQueue* queue) {
+    Event* oldest = NULL;
+
+    for (size_t i = 0; i < queue->events_size; i++) {
+        Event* event = &queue->events[i];
+
+        if (event->pending_count > 0 && !event->is_internal
+            && (oldest == NULL || event->oldest_trigger_us < oldest->oldest_trigger_us)) {
+            oldest = event;
+        }
+    }
+
+    return oldest;
+}
+
+static EventId add_event_with_mode(
+    EventQueue* queue,
+    EventCoalesceMode coalesce_mode,
+    bool is_internal,
+    EventFunction callback,
+    EventBatchFunction batch_callback,
+    void* userdata
+) {
+    if (queue->is_realtime && queue->events_size == queue->events_capacity) {
+        return (EventId){EVENT_QUEUE_INVALID_ID};
+    }
+
+    uint32_t id = queue->next_event_id;
+    queue->next_event_id += 1;
+
+    Event event = {
+        .id = id,
+        .callback = callback,
+        .batch_callback = batch_callback,
+        .coalesce_mode = coalesce_mode,
+        .is_internal = is_internal,
+        .userdata = userdata,
+        .destroy = NULL,
+        .is_scheduled = false,
+        .delayed_count = 0,
+        .has_expiry = false,
+        .pending = NULL,
+        .pending_head = 0,
+        .pending_capacity = 0,
+        .pending_count = 0,
+        .oldest_trigger_us = 0,
+        .pending_limit = 0,
+        .overflow_policy = event_overflow_policy_reject,
+        .dropped_count = 0,
+        .latest_eventdata = NULL,
+        .latest_expires_us = EVENT_QUEUE_NO_EXPIRY,
+        .batch = NULL,
+        .batch_expiry = NULL,
+        .spare_batch = NULL,
+        .spare_batch_expiry = NULL,
+        .batch_size = 0,
+        .batch_capacity = 0,
+        .waiters = NULL,
+        .spare_waiters = NULL,
+        .waiters_size = 0,
+        .waiters_capacity = 0,
+    };
+
+    push_event(queue, event);
+
+    record(queue, trace_record_add_event, id, coalesce_mode, 0);
+
+    return (EventId){id};
+}
+
+EventQueue event_queue_new(void) {
+    TimerHeap timers = timer_heap_new();
+
+    Event* events = malloc(sizeof(Event));
+    if (events == NULL) abort();
+
+    struct pollfd* io_poll_descriptors = malloc(sizeof(struct pollfd));
+    if (io_poll_descriptors == NULL) abort();
+
+    IoEvent* io_events = malloc(sizeof(IoEvent));
+    if (io_events == NULL) abort();
+
+    EventClock clock = event_clock_real();
+
+    return (EventQueue){
+        .next_timer_id = 0,
+        .next_timer_group_id = 1, // 0 is for timers without a group.
+        .next_event_id = 0,
+        .clock = clock,
+        .timers = timers,
+        .events = events,
+        .events_size = 0,
+        .events_capacity = 1,
+        .io_poll_descriptors = io_poll_descriptors,
+        .io_events = io_events,
+        .io_events_size = 0,
+        .io_events_capacity = 1,
+        .io_fd_indices = NULL,
+        .io_fd_indices_capacity = 0,
+        .io_events_removed_count = 0,
+        .is_dispatching_io = false,
+        .next_hook_id = 0,
+        .hooks = NULL,
+        .hooks_size = 0,
+        .hooks_capacity = 0,
+        .is_running_hooks = false,
+        .idle_budget_us = EVENT_QUEUE_DEFAULT_IDLE_BUDGET_US,
+        .next_idle_hook = 0,
+        .task_budget_us = EVENT_QUEUE_DEFAULT_TASK_BUDGET_US,
+        .task_max_lateness_us = 0,
+        .next_task_hook = 0,
+        .work_pool = NULL,
+        .work_thread_count = EVENT_QUEUE_DEFAULT_WORK_THREADS,
+        .work_io_event = { .id = 0, .fd = -1 },
+        .is_watching_work = false,
+        .fiber_pool = NULL,
+        .channel_hub = NULL,
+        .recorder = NULL,
+        .file_watcher = NULL,
+        .watchdog = NULL,
+        .is_auto_shrinking = false,
+        .is_realtime = false,
+        .backend_fd = -1,
+        .backend_timer_fd = -1,
+        .backend_timer_deadline = 0,
+        .is_backend_timer_armed = false,
+        .reserved_timers = 0,
+        .reserved_events = 0,
+        .reserved_io_events = 0,
+        .scheduled_event_count = 0,
+        .pending_event_count = 0,
+        .internal_pending_event_count = 0,
+        .pending_event_limit = 0,
+        .pending_overflow_policy = event_overflow_policy_reject,
+        .dropped_event_count = 0,
+        .rejected_event_count = 0,
+        .expired_event_count = 0,
+        .delayed_event_count = 0,
+        .overload_callback = NULL,
+        .overload_userdata = NULL,
+        .overload_threshold_us = 0,
+        .lag_us = 0,
+        .is_overloaded = false,
+        .io_wakeup_count = 0,
+        .io_ready_count = 0,
+        .created_us = (*clock.now_us)(clock.context),
+        .blocked_us = 0,
+    };
+}
+
+void event_queue_set_clock(EventQueue* queue, EventClock clock) {
+    queue->clock = clock;
+    queue->created_us = queue_now_us(queue);
+}
+
+bool event_queue_set_timer_kind(EventQueue* queue, TimerHeapKind kind) {
+    if (queue->is_realtime && kind == timer_heap_kind_radix) {
+        errno = EINVAL;
+        return false;
+    }
+
+    timer_heap_set_kind(&queue->timers, kind);
+    return true;
+}
+
+uint64_t event_queue_now_us(const EventQueue* queue) {
+    return queue_now_us(queue);
+}
+
+TimerId event_queue_add_timer(
+    EventQueue* queue,
+    uint64_t delay_us,
+    TimerFunction callback,
+    void* userdata
+) {
+    return event_queue_add_periodic_timer(queue, delay_us, TIMER_APERIODIC, callback, userdata);
+}
+
+TimerId event_queue_add_periodic_timer(
+    EventQueue* queue,
+    uint64_t delay_us,
+    uint64_t period_us,
+    TimerFunction callback,
+    void* userdata
+) {
+    return event_queue_add_grouped_timer(
+        queue, (TimerGroupId){0}, delay_us, period_us, callback, userdata);
+}
+
+TimerId event_queue_add_grouped_timer(
+    EventQueue* queue,
+    TimerGroupId group,
+    uint64_t delay_us,
+    uint64_t period_us,
+    TimerFunction callback,
+    void* userdata
+) {
+    if (!has_timer_capacity(queue, 1)) {
+        return (TimerId){EVENT_QUEUE_INVALID_ID};
+    }
+
+    uint32_t id = queue->next_timer_id;
+    queue->next_timer_id += 1;
+
+    uint64_t now = queue_now_us(queue);
+
+    Timer timer = {
+        .is_event = false,
+        .id = id,
+        .group = group.id,
+        .deadline = now + delay_us,
+        .period = period_us,
+        .callback = callback,
+        .userdata = userdata,
+    };
+
+    timer_heap_insert(&queue->timers, timer);
+    update_backend_timer(queue);
+
+    record(queue, trace_record_add_timer, id, delay_us, period_us + 1);
+
+    return (TimerId){id};
+}
+
+void event_queue_remove_timer(EventQueue* queue, TimerId id) {
+    record(queue, trace_record_remove_timer, id.id, 0, 0);
+    timer_heap_remove_id(&queue->timers, id);
+    update_backend_timer(queue);
+}
+
+TimerGroupId event_queue_add_timer_group(EventQueue* queue) {
+    uint32_t id = queue->next_timer_group_id;
+    queue->next_timer_group_id += 1;
+
+    return (TimerGroupId){id};
+}
+
+void event_queue_cancel_group(EventQueue* queue, TimerGroupId group) {
+    if (group.id == 0) {
+        return; // Not a group, but every ungrouped timer.
+    }
+
+    if (queue->recorder != NULL) {
+        // Replays don't know about groups, so record each removal.
+        for (size_t i = 0; i < queue->timers.size; i++) {
+            const Timer* timer = &queue->timers.data[i];
+
+            if (!timer->is_event && timer->group == group.id) {
+                record(queue, trace_record_remove_timer, timer->id, 0, 0);
+            }
+        }
+    }
+
+    timer_heap_remove_group(&queue->timers, group);
+    update_backend_timer(queue);
+}
+
+void event_queue_reschedule_group(EventQueue* queue, TimerGroupId group, int64_t delta_us) {
+    if (group.id == 0) {
+        return; // Not a group, but every ungrouped timer.
+    }
+
+    timer_heap_shift_group(&queue->timers, group, delta_us);
+    update_backend_timer(queue);
+
+    if (queue->recorder != NULL) {
+        uint64_t now = queue_now_us(queue);
+
+        for (size_t i = 0; i < queue->timers.size; i++) {
+            const Timer* timer = &queue->timers.data[i];
+
+            if (!timer->is_event && timer->group == group.id) {
+                uint64_t delay = (timer->deadline > now) ? (timer->deadline - now) : 0;
+                record(queue, trace_record_reschedule_timer, timer->id, delay, timer->period + 1);
+            }
+        }
+    }
+}
+
+EventId event_queue_add_event(EventQueue* queue, EventFunction callback, void* userdata) {
+    return add_event_with_mode(queue, event_coalesce_mode_none, false, callback, NULL, userdata);
+}
+
+EventId event_queue_add_collapsing_event(
+    EventQueue* queue,
+    EventFunction callback,
+    void* userdata
+) {
+    return add_event_with_mode(
+        queue, event_coalesce_mode_collapse, false, callback, NULL, userdata);
+}
+
+EventId event_queue_add_internal_event(EventQueue* queue, EventFunction callback, void* userdata) {
+    return add_event_with_mode(queue, event_coalesce_mode_collapse, true, callback, NULL, userdata);
+}
+
+EventId event_queue_add_batch_event(
+    EventQueue* queue,
+    EventBatchFunction callback,
+    void* userdata
+) {
+    return add_event_with_mode(queue, event_coalesce_mode_batch, false, NULL, callback, userdata);
+}
+
+void event_queue_remove_event(EventQueue* queue, EventId id) {
+    size_t index;
+    if (get_event_by_id(queue, id, &index)) {
+        record(queue, trace_record_remove_event, id.id, 0, 0);
+        remove_event_at_position(queue, index);
+        update_backend_timer(queue); // For its delayed triggers.
+    }
+    // TODO: Handle case of invalid ID?
+}
+
+bool event_queue_add_event_waiter(
+    EventQueue* queue,
+    EventId id,
+    EventFunction callback,
+    void* userdata
+) {
+    size_t index;
+    if (!get_event_by_id(queue, id, &index)) {
+        return false;
+    }
+
+    Event* event = &queue->events[index];
+
+    if (queue->is_realtime && event->waiters_size == event->waiters_capacity) {
+        return false;
+    }
+
+    if (event->waiters_size == event->waiters_capacity) {
+        size_t capacity = (event->waiters_capacity == 0) ? 1 : (event->waiters_capacity * 2);
+        event->waiters = realloc(event->waiters, sizeof(EventWaiter) * capacity);
+        event->spare_waiters = realloc(event->spare_waiters, sizeof(EventWaiter) * capacity);
+        if (event->waiters == NULL || event->spare_waiters == NULL) abort();
+
+        event->waiters_capacity = capacity;
+    }
+
+    event->waiters[event->waiters_size] = (EventWaiter){
+        .callback = callback,
+        .userdata = userdata,
+    };
+    event->waiters_size += 1;
+
+    return true;
+}
+
+// Whether a trigger of `event` fits without growing any table, for real-time mode.
+static bool has_trigger_capacity(const EventQueue* queue, const Event* event) {
+    switch (event->coalesce_mode) {
+        case event_coalesce_mode_none:
+            return (!queue->is_realtime || event->pending_count < event->pending_capacity)
+                && (event->is_scheduled || has_timer_capacity(queue, 1));
+
+        case event_coalesce_mode_collapse:
+            return event->is_scheduled || has_timer_capacity(queue, 1);
+
+        case event_coalesce_mode_batch:
+            return (!queue->is_realtime || event->batch_size < event->batch_capacity)
+                && (event->is_scheduled || has_timer_capacity(queue, 1));
+    }
+
+    return true;
+}
+
+// Apply the event's limit, then the queue's, to a new trigger of `event`, dropping the oldest
+// pending trigger if that's the policy, and the new one fits. Returns false if the new trigger must
+// not be added, and stores what to return from `event_queue_trigger_event` in `result`. A trigger
+// dropped as the newest is discarded here; a rejected one is left to the caller.
+static bool apply_pending_limits(
+    EventQueue* queue,
+    Event* event,
+    void* eventdata,
+    uint64_t now_us,
+    bool* result
+) {
+    // Expired triggers make room before anything is dropped.
+    if (event->has_expiry && event->pending_limit != 0
+        && event->pending_count >= event->pending_limit) {
+        discard_expired_triggers(queue, event, now_us);
+    }
+
+    EventOverflowPolicy policy;
+    Event* oldest;
+
+    if (event->pending_limit != 0 && event->pending_count >= event->pending_limit) {
+        policy = event->overflow_policy;
+        oldest = event;
+    } else if (queue->pending_event_limit != 0 && !event->is_internal
+        && queue->pending_event_count - queue->internal_pending_event_count
+            >= queue->pending_event_limit) {
+        policy = queue->pending_overflow_policy;
+        oldest = find_oldest_pending_event(queue);
+    } else {
+        return true;
+    }
+
+    switch (policy) {
+        case event_overflow_policy_reject:
+            event->dropped_count += 1;
+            queue->rejected_event_count += 1;
+            *result = false;
+            return false;
+
+        case event_overflow_policy_drop_newest:
+            discard_trigger(event, eventdata);
+            event->dropped_count += 1;
+            queue->dropped_event_count += 1;
+            *result = true;
+            return false;
+
+        case event_overflow_policy_drop_oldest:
+            // Dropping another event's trigger doesn't make room for this one's, so check there's
+            // room first, rather than lose both.
+            if (oldest != event && !has_trigger_capacity(queue, event)) {
+                *result = false;
+                return false;
+            }
+
+            if (oldest != NULL) {
+                drop_oldest_trigger(queue, oldest);
+            }
+            return true;
+    }
+
+    return true;
+}
+
+// Add a trigger of the event at `index`, made at `time_us`, to its pending triggers, applying
+// limits, and schedule its dispatch. Returns as `event_queue_trigger_event`.
+static bool trigger_event_at_position(
+    EventQueue* queue,
+    size_t index,
+    void* eventdata,
+    uint64_t time_us,
+    uint64_t expires_us
+) {
+    Event* event = &queue->events[index];
+
+    // Triggers collapsing into a pending one don't add to it, so aren't limited.
+    bool is_new_trigger =
+        event->coalesce_mode != event_coalesce_mode_collapse || event->pending_count == 0;
+
+    bool result;
+    if (is_new_trigger && !apply_pending_limits(queue, event, eventdata, time_us, &result)) {
+        return result;
+    }
+
+    if (!has_trigger_capacity(queue, event)) {
+        return false;
+    }
+
+    record(queue, trace_record_trigger_event, event->id, 0, 0);
+
+    add_pending_trigger(queue, event, eventdata, time_us, expires_us);
+
+    // Each event has one dispatch in the timer queue at a time, for its oldest pending trigger.
+    if (!event->is_scheduled) {
+        event->is_scheduled = true;
+        push_event_to_timer_queue(queue, (EventId){event->id}, time_us);
+    }
+
+    return true;
+}
+
+bool event_queue_trigger_event(EventQueue* queue, EventId id, void* eventdata) {
+    size_t index;
+    if (!get_event_by_id(queue, id, &index)) {
+        return false;
+    }
+
+    return trigger_event_at_position(
+        queue, index, eventdata, queue_now_us(queue), EVENT_QUEUE_NO_EXPIRY);
+}
+
+bool event_queue_trigger_event_at(
+    EventQueue* queue,
+    EventId id,
+    void* eventdata,
+    uint64_t not_before_us,
+    uint64_t expires_us
+) {
+    size_t index;
+    if (!get_event_by_id(queue, id, &index)) {
+        return false;
+    }
+
+    uint64_t now_us = queue_now_us(queue);
+    if (not_before_us <= now_us) {
+        return trigger_event_at_position(queue, index, eventdata, now_us, expires_us);
+    }
+
+    if (!has_timer_capacity(queue, 1)) {
+        return false;
+    }
+
+    // Waits in the timer queue until due, then is added as if triggered then.
+    Timer timer = {
+        .is_event = true,
+        .is_delayed_trigger = true,
+        .deadline = not_before_us,
+        .period = expires_us,
+        .callback = NULL, // Unused
+        .userdata = eventdata,
+        .id = id.id,
+    };
+    timer_heap_insert(&queue->timers, timer);
+    update_backend_timer(queue);
+
+    queue->events[index].delayed_count += 1;
+    queue->delayed_event_count += 1;
+
+    return true;
+}
+
+void event_queue_set_event_destroy_function(
+    EventQueue* queue,
+    EventId id,
+    EventDestroyFunction function
+) {
+    size_t index;
+    if (get_event_by_id(queue, id, &index)) {
+        queue->events[index].destroy = function;
+    }
+}
+
+void event_queue_set_event_limit(
+    EventQueue* queue,
+    EventId id,
+    size_t limit,
+    EventOverflowPolicy policy
+) {
+    size_t index;
+    if (!get_event_by_id(queue, id, &index)) {
+        return;
+    }
+
+    Event* event = &queue->events[index];
+    event->pending_limit = limit;
+    event->overflow_policy = policy;
+
+    if (event->coalesce_mode == event_coalesce_mode_none && limit > event->pending_capacity) {
+        reallocate_pending_triggers(event, limit);
+    }
+}
+
+void event_queue_set_pending_limit(EventQueue* queue, size_t limit, EventOverflowPolicy policy) {
+    queue->pending_event_limit = limit;
+    queue->pending_overflow_policy = policy;
+}
+
+uint64_t event_queue_get_event_drop_count(const EventQueue* queue, EventId id) {
+    size_t index;
+    if (!get_event_by_id(queue, id, &index)) {
+        return 0;
+    }
+
+    return queue->events[index].dropped_count;
+}
+
+void event_queue_set_overload_function(
+    EventQueue* queue,
+    uint64_t threshold_us,
+    EventOverloadFunction function,
+    void* userdata
+) {
+    queue->overload_threshold_us = threshold_us;
+    queue->overload_callback = function;
+    queue->overload_userdata = userdata;
+    queue->is_overloaded = false;
+    queue->lag_us = 0;
+}
+
+IoEventId event_queue_add_io_event(
+    EventQueue* queue,
+    int fd,
+    uint32_t mask,
+    EventIoFunction callback,
+    void* userdata
+) {
+    return event_queue_add_owned_io_event(queue, fd, mask, callback, NULL, userdata);
+}
+
+IoEventId event_queue_add_owned_io_event(
+    EventQueue* queue,
+    int fd,
+    uint32_t mask,
+    EventIoFunction callback,
+    EventIoDestroyFunction destroy,
+    void* userdata
+) {
+    assert(fd >= 0);
+
+    // One I/O event per fd.
+    if (get_io_event_index_by_fd(queue, fd) != NO_IO_EVENT) {
+        errno = EEXIST;
+        return (IoEventId){ .id = EVENT_QUEUE_INVALID_ID, .fd = fd };
+    }
+
+    bool has_capacity = queue->io_events_size < queue->io_events_capacity
+        && (size_t)fd < queue->io_fd_indices_capacity;
+
+    if (queue->is_realtime && !has_capacity) {
+        errno = ENOMEM;
+        return (IoEventId){ .id = EVENT_QUEUE_INVALID_ID, .fd = fd };
+    }
+
+    reallocate_io_events_if_at_capacity(queue);
+    reallocate_io_fd_indices_to_fit(queue, fd);
+
+    struct pollfd pollfd = {
+        .fd = fd,
+        .events = mask_to_poll_events(mask),
+        .revents = 0,
+    };
+
+    uint32_t id = queue->next_io_event_id;
+    queue->next_io_event_id += 1;
+
+    IoEvent event = {
+        .id = id,
+        .fd = fd,
+        .callback = callback,
+        .userdata = userdata,
+        .destroy = destroy,
+        .is_removed = false,
+    };
+
+    size_t index = queue->io_events_size;
+    queue->io_poll_descriptors[index] = pollfd;
+    queue->io_events[index] = event;
+    queue->io_fd_indices[fd] = index;
+    queue->io_events_size += 1;
+
+    update_backend_io_event(queue, EPOLL_CTL_ADD, fd, pollfd.events);
+
+    record(queue, trace_record_add_io_event, id, mask, 0);
+
+    return (IoEventId){ .id = id, .fd = fd };
+}
+
+void event_queue_modify_io_event(EventQueue* queue, IoEventId id, uint32_t mask) {
+    size_t index;
+    if (get_io_event_by_id(queue, id, &index)) {
+        queue->io_poll_descriptors[index].events = mask_to_poll_events(mask);
+        short events = queue->io_poll_descriptors[index].events;
+        update_backend_io_event(queue, EPOLL_CTL_MOD, id.fd, events);
+    }
+}
+
+void event_queue_remove_io_event(EventQueue* queue, IoEventId id) {
+    size_t index;
+    if (get_io_event_by_id(queue, id, &index)) {
+        record(queue, trace_record_remove_io_event, id.id, 0, 0);
+        remove_io_event_at_position(queue, index);
+    }
+}
+
+static void on_work_completion(int fd, EventIoFlag flag, void* userdata) {
+    (void)fd;
+    (void)flag;
+
+    EventQueue* queue = userdata;
+    work_pool_run_completions(queue->work_pool);
+
+    // Stop watching for completions once there are none to wait for, so that an otherwise idle
+    // queue can return from `event_queue_wait`. Done functions may have submitted more work.
+    if (work_pool_outstanding(queue->work_pool) == 0 && queue->is_watching_work) {
+        event_queue_remove_io_event(queue, queue->work_io_event);
+        queue->is_watching_work = false;
+    }
+}
+
+bool event_queue_submit_work(
+    EventQueue* queue,
+    WorkFunction work,
+    WorkDoneFunction done,
+    void* userdata
+) {
+    if (queue->work_pool == NULL) {
+        queue->work_pool = work_pool_new(queue->work_thread_count);
+    }
+
+    // Tracked separately from the outstanding count, which drops to 0 while done functions run,
+    // before the completion fd stops being watched.
+    if (!queue->is_watching_work) {
+        int fd = work_pool_completion_fd(queue->work_pool);
+        queue->work_io_event = event_queue_add_io_event(
+            queue, fd, event_io_flag_read, on_work_completion, queue);
+
+        if (queue->work_io_event.id == EVENT_QUEUE_INVALID_ID) {
+            return false; // With `errno` set.
+        }
+
+        queue->is_watching_work = true;
+    }
+
+    work_pool_submit(queue->work_pool, work, done, userdata);
+    return true;
+}
+
+void event_queue_set_work_thread_count(EventQueue* queue, size_t thread_count) {
+    if (queue->work_pool == NULL && thread_count > 0) {
+        queue->work_thread_count = thread_count;
+    }
+}
+
+static void dispatch_io_event(EventQueue* queue, size_t index, EventIoFlag flag) {
+    IoEvent event = queue->io_events[index];
+    record(queue, trace_record_dispatch_io_event, event.id, 0, 0);
+
+    watch_enter(
+        queue, event_callback_kind_io_event, (EventGenericFunction)event.callback, event.id);
+    (*event.callback)(event.fd, flag, event.userdata);
+    watch_leave(queue);
+}
+
+static bool handle_io_events(EventQueue* queue, int timeout_ms) {
+    if (queue->io_events_size == 0) {
+        return false; // Handled no events, report false.
+    }
+
+    uint64_t poll_start_us = (timeout_ms != 0) ? queue_now_us(queue) : 0;
+    int poll_status = poll(queue->io_poll_descriptors, queue->io_events_size, timeout_ms);
+
+    if (timeout_ms != 0) {
+        queue->blocked_us += queue_now_us(queue) - poll_start_us;
+    }
+
+    if (poll_status > 0) {
+        queue->io_wakeup_count += 1;
+        queue->io_ready_count += (uint64_t)poll_status;
+
+        // Removals made by callbacks are deferred until the loop is done, so positions are stable.
+        // Events added by callbacks are appended, and have no `revents` yet.
+        bool was_dispatching_io = queue->is_dispatching_io;
+        queue->is_dispatching_io = true;
+
+        for (size_t i = 0; i < queue->io_events_size; i++) {
+            struct pollfd* pollfd = &queue->io_poll_descriptors[i];
+            short revents = pollfd->revents;
+            pollfd->revents = 0;
+
+            // Errors and hangups are always reported by `poll`. They're passed on as readability
+            // (or writability), so that the function sees them from its next read (or write).
+            short events = pollfd->events;
+            bool is_failed = (revents & (POLLERR | POLLHUP)) != 0;
+            bool is_readable = (revents & POLLIN) != 0 || (is_failed && (events & POLLIN) != 0);
+            bool is_writable = (revents & POLLOUT) != 0 || (is_failed && (events & POLLOUT) != 0);
+
+            if (is_readable && !queue->io_events[i].is_removed) {
+                dispatch_io_event(queue, i, event_io_flag_read);
+            }
+
+            if (is_writable && !queue->io_events[i].is_removed) {
+                dispatch_io_event(queue, i, event_io_flag_write);
+            }
+        }
+
+        // Only the outermost dispatch compacts, if a callback dispatched I/O itself.
+        queue->is_dispatching_io = was_dispatching_io;
+        if (!was_dispatching_io) {
+            compact_io_events(queue);
+        }
+
+        return true;
+    } else {
+        // TODO: Handle poll error and timeout.
+        return false;
+    }
+}
+
+static void dispatch_event_batch(EventQueue* queue, size_t index) {
+    // Detach the batch before calling, so triggers made from within the callback start a new batch
+    // rather than modifying the one being delivered. They're added to the spare arrays, which have
+    // the same room, so that they fit in real-time mode.
+    Event* event = &queue->events[index];
+    Event detached = *event;
+    event->batch = event->spare_batch;
+    event->batch_expiry = event->spare_batch_expiry;
+    event->spare_batch = NULL;
+    event->spare_batch_expiry = NULL;
+    event->batch_size = 0;
+
+    (*detached.batch_callback)(detached.userdata, detached.batch, detached.batch_size);
+
+    // The callback may have removed the event, or moved it by adding/removing others. Keep the
+    // detached arrays as the spares, unless it was removed, or outgrew them.
+    size_t new_index;
+    bool exists = get_event_by_id(queue, (EventId){detached.id}, &new_index);
+
+    if (exists && queue->events[new_index].spare_batch == NULL) {
+        queue->events[new_index].spare_batch = detached.batch;
+        queue->events[new_index].spare_batch_expiry = detached.batch_expiry;
+    } else {
+        free(detached.batch);
+        free(detached.batch_expiry);
+    }
+}
+
+static void notify_event_waiters(EventQueue* queue, EventId id, void* eventdata) {
+    // The event's callback may have removed the event, or moved it by adding/removing others.
+    size_t index;
+    if (!get_event_by_id(queue, id, &index) || queue->events[index].waiters_size == 0) {
+        return;
+    }
+
+    // Detach the waiters before calling them, so that waiters added by them wait for the next
+    // dispatch. They're added to the spare array, which has the same room, so that a waiter which
+    // waits again fits in real-time mode.
+    Event* event = &queue->events[index];
+    EventWaiter* waiters = event->waiters;
+    size_t waiters_size = event->waiters_size;
+    event->waiters = event->spare_waiters;
+    event->spare_waiters = NULL;
+    event->waiters_size = 0;
+
+    for (size_t i = 0; i < waiters_size; i++) {
+        (*waiters[i].callback)(waiters[i].userdata, eventdata);
+    }
+
+    // Keep the detached array as the spare, unless the event was removed, or outgrew it.
+    if (get_event_by_id(queue, id, &index) && queue->events[index].spare_waiters == NULL) {
+        queue->events[index].spare_waiters = waiters;
+    } else {
+        free(waiters);
+    }
+}
+
+static bool handle_event_timer(EventQueue* queue, Timer timer) {
+    // NOTE: Currently, there's no deadline check/wait for events. Since they're 'immediate,'
+    // they should always be executed without delay.
+
+    EventId id = (EventId){timer.id};
+
+    size_t index;
+    if (!get_event_by_id(queue, id, &index)) {
+        return true;
+    }
+
+    Event* event = &queue->events[index];
+    event->is_scheduled = false;
+
+    if (event->has_expiry) {
+        discard_expired_triggers(queue, event, queue_now_us(queue));
+    }
+
+    if (event->pending_count == 0) {
+        return true; // Every pending trigger was dropped, or expired.
+    }
+
+    record(queue, trace_record_dispatch_event, id.id, 0, 0);
+
+    void* eventdata = NULL;
+
+    EventGenericFunction function = (event->coalesce_mode == event_coalesce_mode_batch)
+        ? (EventGenericFunction)event->batch_callback
+        : (EventGenericFunction)event->callback;
+    watch_enter(queue, event_callback_kind_event, function, id.id);
+
+    switch (event->coalesce_mode) {
+        case event_coalesce_mode_none:
+            eventdata = pop_pending_trigger(queue, event).eventdata;
+
+            // Further triggers take their turn with other events and timers, by trigger time.
+            if (event->pending_count > 0) {
+                event->is_scheduled = true;
+                push_event_to_timer_queue(queue, id, event->oldest_trigger_us);
+            }
+
+            (*event->callback)(event->userdata, eventdata);
+            break;
+
+        case event_coalesce_mode_collapse:
+            eventdata = event->latest_eventdata;
+            event->pending_count = 0;
+            queue->pending_event_count -= 1;
+            if (event->is_internal) {
+                queue->internal_pending_event_count -= 1;
+            }
+            (*event->callback)(event->userdata, eventdata);
+            break;
+
+        case event_coalesce_mode_batch:
+            eventdata = event->batch[event->batch_size - 1];
+            queue->pending_event_count -= event->pending_count;
+            event->pending_count = 0;
+            dispatch_event_batch(queue, index);
+            break;
+    }
+
+    watch_leave(queue);
+
+    notify_event_waiters(queue, id, eventdata);
+
+    return true;
+}
+
+static HookId add_hook(
+    EventQueue* queue,
+    HookKind kind,
+    EventHookFunction callback,
+    EventIdleFunction idle_callback,
+    EventTaskFunction task_callback,
+    void* userdata
+) {
+    if (queue->is_realtime && queue->hooks_size == queue->hooks_capacity) {
+        return (HookId){EVENT_QUEUE_INVALID_ID};
+    }
+
+    if (queue->hooks_size == queue->hooks_capacity) {
+        queue->hooks_capacity = (queue->hooks_capacity == 0) ? 1 : (queue->hooks_capacity * 2);
+        queue->hooks = realloc(queue->hooks, sizeof(Hook) * queue->hooks_capacity);
+        if (queue->hooks == NULL) abort();
+    }
+
+    uint32_t id = queue->next_hook_id;
+    queue->next_hook_id += 1;
+
+    queue->hooks[queue->hooks_size] = (Hook){
+        .id = id,
+        .kind = kind,
+        .callback = callback,
+        .idle_callback = idle_callback,
+        .task_callback = task_callback,
+        .userdata = userdata,
+        .is_removed = false,
+    };
+    queue->hooks_size += 1;
+
+    return (HookId){id};
+}
+
+HookId event_queue_add_prepare_hook(EventQueue* queue, EventHookFunction callback, void* userdata) {
+    return add_hook(queue, hook_kind_prepare, callback, NULL, NULL, userdata);
+}
+
+HookId event_queue_add_check_hook(EventQueue* queue, EventHookFunction callback, void* userdata) {
+    return add_hook(queue, hook_kind_check, callback, NULL, NULL, userdata);
+}
+
+HookId event_queue_add_idle_callback(
+    EventQueue* queue,
+    EventIdleFunction callback,
+    void* userdata
+) {
+    return add_hook(queue, hook_kind_idle, NULL, callback, NULL, userdata);
+}
+
+HookId event_queue_add_task(EventQueue* queue, EventTaskFunction callback, void* userdata) {
+    return add_hook(queue, hook_kind_task, NULL, NULL, callback, userdata);
+}
+
+void event_queue_remove_hook(EventQueue* queue, HookId id) {
+    for (size_t i = 0; i < queue->hooks_size; i++) {
+        if (queue->hooks[i].id == id.id && !queue->hooks[i].is_removed) {
+            if (queue->is_running_hooks) {
+                queue->hooks[i].is_removed = true;
+            } else {
+                remove_hook_at_position(queue, i);
+            }
+            return;
+        }
+    }
+}
+
+void event_queue_set_idle_budget(EventQueue* queue, uint64_t budget_us) {
+    queue->idle_budget_us = budget_us;
+}
+
+void event_queue_set_task_budget(EventQueue* queue, uint64_t budget_us, uint64_t max_lateness_us) {
+    assert(budget_us > 0);
+
+    queue->task_budget_us = budget_us;
+    queue->task_max_lateness_us = max_lateness_us;
+}
+
+static void compact_hooks(EventQueue* queue) {
+    size_t index = 0;
+
+    while (index < queue->hooks_size) {
+        if (queue->hooks[index].is_removed) {
+            remove_hook_at_position(queue, index);
+        } else {
+            index += 1;
+        }
+    }
+}
+
+static void run_hooks(EventQueue* queue, HookKind kind) {
+    if (queue->hooks_size == 0) {
+        return;
+    }
+
+    // Hooks added by hooks are appended, and first run next time. Removals are deferred.
+    bool was_running_hooks = queue->is_running_hooks;
+    queue->is_running_hooks = true;
+
+    size_t hooks_size = queue->hooks_size;
+    for (size_t i = 0; i < hooks_size; i++) {
+        Hook hook = queue->hooks[i];
+
+        if (hook.kind == kind && !hook.is_removed) {
+            (*hook.callback)(hook.userdata);
+        }
+    }
+
+    queue->is_running_hooks = was_running_hooks;
+    if (!was_running_hooks) {
+        compact_hooks(queue);
+    }
+}
+
+// Run idle callbacks until the idle budget or `deadline_us` is reached, whichever is first. Each is
+// called at most once. Callbacks are rotated, so that a callback which uses up the budget doesn't
+// starve those after it.
+static void run_idle_callbacks(EventQueue* queue, uint64_t deadline_us) {
+    uint64_t now_us = queue_now_us(queue);
+    uint64_t budget_end_us = now_us + queue->idle_budget_us;
+    if (budget_end_us > deadline_us) {
+        budget_end_us = deadline_us;
+    }
+
+    bool was_running_hooks = queue->is_running_hooks;
+    queue->is_running_hooks = true;
+
+    size_t hooks_size = queue->hooks_size;
+    for (size_t i = 0; i < hooks_size && now_us < budget_end_us; i++) {
+        size_t index = (queue->next_idle_hook + i) % hooks_size;
+        Hook hook = queue->hooks[index];
+
+        if (hook.kind == hook_kind_idle && !hook.is_removed) {
+            (*hook.idle_callback)(hook.userdata, budget_end_us - now_us);
+            queue->next_idle_hook = index + 1;
+            now_us = queue_now_us(queue);
+        }
+    }
+
+    queue->is_running_hooks = was_running_hooks;
+    if (!was_running_hooks) {
+        compact_hooks(queue);
+    }
+}
+
+static uint64_t add_saturating(uint64_t a, uint64_t b) {
+    return (a > UINT64_MAX - b) ? UINT64_MAX : (a + b);
+}
+
+// The time by which task steps must stop: the end of the task budget, or the latest the next timer
+// may be dispatched, whichever is first.
+static uint64_t get_task_deadline(const EventQueue* queue, uint64_t now_us) {
+    uint64_t deadline_us = add_saturating(now_us, queue->task_budget_us);
+
+    const Timer* next = timer_heap_find(&queue->timers);
+    if (next != NULL) {
+        uint64_t latest_us = add_saturating(next->deadline, queue->task_max_lateness_us);
+        if (latest_us < deadline_us) {
+            deadline_us = latest_us;
+        }
+    }
+
+    return deadline_us;
+}
+
+// Whether tasks remain, and there is time to run them before the next timer.
+static bool is_task_runnable(const EventQueue* queue) {
+    return has_hooks_of_kind(queue, hook_kind_task)
+        && queue_now_us(queue) < get_task_deadline(queue, queue_now_us(queue));
+}
+
+// Call task steps in turn until the task deadline. Like idle callbacks, tasks are rotated so that a
+// task which uses up the budget doesn't starve those after it, and each is called at most once.
+static void run_tasks(EventQueue* queue) {
+    uint64_t now_us = queue_now_us(queue);
+    uint64_t deadline_us = get_task_deadline(queue, now_us);
+
+    bool was_running_hooks = queue->is_running_hooks;
+    queue->is_running_hooks = true;
+
+    size_t hooks_size = queue->hooks_size;
+    for (size_t i = 0; i < hooks_size && now_us < deadline_us; i++) {
+        size_t index = (queue->next_task_hook + i) % hooks_size;
+        Hook hook = queue->hooks[index];
+
+        if (hook.kind == hook_kind_task && !hook.is_removed) {
+            EventGenericFunction function = (EventGenericFunction)hook.task_callback;
+            watch_enter(queue, event_callback_kind_task, function, hook.id);
+            EventTaskStatus status = (*hook.task_callback)(hook.userdata, deadline_us - now_us);
+            watch_leave(queue);
+
+            if (status == event_task_status_done) {
+                queue->hooks[index].is_removed = true;
+            }
+
+            queue->next_task_hook = index + 1;
+            now_us = queue_now_us(queue);
+        }
+    }
+
+    queue->is_running_hooks = was_running_hooks;
+    if (!was_running_hooks) {
+        compact_hooks(queue);
+    }
+}
+
+// Block until `deadline_us` (or indefinitely, if `has_deadline` is false), dispatching I/O events
+// which become ready meanwhile. Idle callbacks run first if no I/O is ready, then prepare hooks
+// run before blocking, and check hooks after. If `is_returning_on_io`, return as soon as I/O has
+// been handled, rather than at the deadline. Returns true if any I/O events were dispatched.
+static bool block_until(
+    EventQueue* queue,
+    bool has_deadline,
+    uint64_t deadline_us,
+    bool is_returning_on_io
+) {
+    bool handled_io = false;
+
+    if (has_hooks_of_kind(queue, hook_kind_idle)) {
+        // Idle callbacks only run when nothing else is ready.
+        handled_io = handle_io_events(queue, 0);
+
+        if (!handled_io) {
+            run_idle_callbacks(queue, has_deadline ? deadline_us : UINT64_MAX);
+        }
+    }
+
+    run_hooks(queue, hook_kind_prepare);
+
+    int timeout_ms = -1;
+    if (has_deadline) {
+        uint64_t now_us = queue_now_us(queue);
+        uint64_t remaining_us = (deadline_us > now_us) ? (deadline_us - now_us) : 0;
+
+        // Virtual time doesn't pass while blocked, so only check for I/O which is already ready.
+        timeout_ms = queue->clock.is_virtual ? 0 : (int)(remaining_us / 1000);
+    }
+
+    handled_io |= handle_io_events(queue, timeout_ms);
+
+    if (has_deadline && !(handled_io && is_returning_on_io)) {
+        // millisecond granularity of `poll` might not take us up to actual deadline, so sleep
+        // again using microsecond deadline:
+        uint64_t sleep_start_us = queue_now_us(queue);
+        queue_sleep_until(queue, deadline_us);
+        queue->blocked_us += queue_now_us(queue) - sleep_start_us;
+    }
+
+    run_hooks(queue, hook_kind_check);
+
+    return handled_io;
+}
+
+static bool handle_ordinary_timer(EventQueue* queue, Timer timer) {
+    // Trigger the timer's callback function.
+    record(queue, trace_record_dispatch_timer, timer.id, 0, 0);
+
+    watch_enter(queue, event_callback_kind_timer, (EventGenericFunction)timer.callback, timer.id);
+    (*timer.callback)(timer.userdata);
+    watch_leave(queue);
+
+    bool is_periodic = timer.period != TIMER_APERIODIC;
+    if (is_periodic) {
+        // TODO: This can be optimized by checking if the timer is reinserted before the binary
+        // tree sift-down in timer_heap_take.
+        timer.deadline += timer.period;
+        timer_heap_insert(&queue->timers, timer);
+    }
+
+    return true;
+}
+
+bool event_queue_dispatch_ready_io(EventQueue* queue) {
+    return handle_io_events(queue, 0);
+}
+
+bool event_queue_next_deadline(const EventQueue* queue, uint64_t* out) {
+    const Timer* timer = timer_heap_find(&queue->timers);
+
+    if (timer == NULL) {
+        return false;
+    }
+
+    *out = timer->deadline;
+    return true;
+}
+
+// Measure how late the timer or event about to be dispatched is, and report crossing the overload
+// threshold, either way. Recovery needs lag below half the threshold, so that lag hovering around
+// it doesn't report repeatedly.
+static void update_lag(EventQueue* queue, uint64_t deadline_us) {
+    uint64_t now_us = queue_now_us(queue);
+    queue->lag_us = (now_us > deadline_us) ? (now_us - deadline_us) : 0;
+
+    bool is_overloaded = queue->is_overloaded
+        ? (queue->lag_us >= queue->overload_threshold_us / 2)
+        : (queue->lag_us > queue->overload_threshold_us);
+
+    if (is_overloaded != queue->is_overloaded) {
+        queue->is_overloaded = is_overloaded;
+        (*queue->overload_callback)(is_overloaded, queue->lag_us, queue->overload_userdata);
+    }
+}
+
+// Add a delayed trigger which is now due to its event's pending triggers, unless it has expired.
+static bool handle_delayed_trigger(EventQueue* queue, Timer timer) {
+    queue->delayed_event_count -= 1;
+
+    size_t index;
+    if (!get_event_by_id(queue, (EventId){timer.id}, &index)) {
+        return true;
+    }
+
+    Event* event = &queue->events[index];
+    event->delayed_count -= 1;
+
+    void* eventdata = timer.userdata;
+    uint64_t expires_us = timer.period;
+
+    if (is_expired(expires_us, queue_now_us(queue))) {
+        discard_trigger(event, eventdata);
+        queue->expired_event_count += 1;
+    } else if (!trigger_event_at_position(queue, index, eventdata, timer.deadline, expires_us)) {
+        discard_trigger(event, eventdata); // Rejected, with no caller to hand it back to.
+    }
+
+    return true;
+}
+
+// Take the earliest timer, and dispatch it.
+static bool dispatch_next_timer(EventQueue* queue) {
+    Timer timer;
+    if (!timer_heap_take(&queue->timers, &timer)) {
+        return false;
+    }
+
+    if (queue->overload_callback != NULL) {
+        update_lag(queue, timer.deadline);
+    }
+
+    if (timer.is_delayed_trigger) {
+        return handle_delayed_trigger(queue, timer);
     } else if (timer.is_event) {
+        queue->scheduled_event_count -= 1;
         return handle_event_timer(queue, timer);
     } else /* ordinary non-event timer */ {
         return handle_ordinary_timer(queue, timer);
     }
 }
 
+static bool wait_once(EventQueue* queue) {
+    // Tasks take the place of blocking, interleaved with I/O, until a timer is due.
+    if (is_task_runnable(queue)) {
+        handle_io_events(queue, 0);
+        run_tasks(queue);
+        return true;
+    }
+
+    const Timer* next = timer_heap_find(&queue->timers);
+
+    if (next == NULL) {
+        if (queue->io_events_size == 0) {
+            return false; // Nothing to wait for.
+        }
+
+        return block_until(queue, false, 0, false);
+    }
+
+    // NOTE: Events are always due, since they're 'immediate.'
+    if (next->deadline > queue_now_us(queue)) {
+        block_until(queue, true, next->deadline, false);
+
+        // Hooks and I/O events may have added an earlier timer, which is then due too, or removed
+        // the one waited for. Then what they did counts as the wait, and later timers wait for the
+        // next one.
+        next = timer_heap_find(&queue->timers);
+        if (next == NULL || next->deadline > queue_now_us(queue)) {
+            return true;
+        }
+    }
+
+    return dispatch_next_timer(queue);
+}
+
+static EventQueueTableUsage get_table_usage(size_t size, size_t capacity, size_t entry_size) {
+    return (EventQueueTableUsage){
+        .size = size,
+        .capacity = capacity,
+        .bytes_used = size * entry_size,
+        .bytes_allocated = capacity * entry_size,
+    };
+}
+
+// The highest fd with an I/O event, plus one.
+static size_t get_io_fd_indices_size(const EventQueue* queue) {
+    size_t size = 0;
+
+    for (size_t i = 0; i < queue->io_events_size; i++) {
+        const IoEvent* event = &queue->io_events[i];
+
+        if (!event->is_removed && (size_t)event->fd + 1 > size) {
+            size = (size_t)event->fd + 1;
+        }
+    }
+
+    return size;
+}
+
+void event_queue_get_stats(const EventQueue* queue, EventQueueStats* out) {
+    uint64_t now_us = queue_now_us(queue);
+
+    *out = (EventQueueStats){
+        .timer_count =
+            queue->timers.size - queue->scheduled_event_count - queue->delayed_event_count,
+        .pending_event_count = queue->pending_event_count + queue->delayed_event_count,
+        .dropped_event_count = queue->dropped_event_count,
+        .rejected_event_count = queue->rejected_event_count,
+        .expired_event_count = queue->expired_event_count,
+        .lag_us = queue->lag_us,
+        .io_event_count = queue->io_events_size - queue->io_events_removed_count,
+        .io_wakeup_count = queue->io_wakeup_count,
+        .io_ready_count = queue->io_ready_count,
+        .elapsed_us = (now_us > queue->created_us) ? (now_us - queue->created_us) : 0,
+        .blocked_us = queue->blocked_us,
+    };
+}
+
+void event_queue_get_memory_usage(const EventQueue* queue, EventQueueMemoryUsage* out) {
+    out->timers = get_table_usage(
+        queue->timers.size, queue->timers.capacity, timer_heap_entry_size(&queue->timers));
+    out->events = get_table_usage(queue->events_size, queue->events_capacity, sizeof(Event));
+    out->io_events = get_table_usage(
+        queue->io_events_size, queue->io_events_capacity, sizeof(IoEvent) + sizeof(struct pollfd));
+    out->io_fd_indices = get_table_usage(
+        get_io_fd_indices_size(queue), queue->io_fd_indices_capacity, sizeof(size_t));
+    out->hooks = get_table_usage(queue->hooks_size, queue->hooks_capacity, sizeof(Hook));
+
+    for (size_t i = 0; i < queue->events_size; i++) {
+        const Event* event = &queue->events[i];
+
+        size_t pending_size = (event->coalesce_mode == event_coalesce_mode_none)
+            ? event->pending_count
+            : 0;
+
+        out->events.bytes_used += sizeof(PendingTrigger) * pending_size;
+        out->events.bytes_allocated += sizeof(PendingTrigger) * event->pending_capacity;
+        out->events.bytes_used += (sizeof(void*) + sizeof(uint64_t)) * event->batch_size;
+        out->events.bytes_used += sizeof(EventWaiter) * event->waiters_size;
+        out->events.bytes_allocated +=
+            (sizeof(void*) + sizeof(uint64_t)) * event->batch_capacity * 2; // And spares
+        out->events.bytes_allocated +=
+            sizeof(EventWaiter) * event->waiters_capacity * 2; // And spare
+    }
+}
+
+void event_queue_reserve(EventQueue* queue, size_t timers, size_t events, size_t io_events) {
+    queue->reserved_timers = timers;
+    queue->reserved_events = events;
+    queue->reserved_io_events = io_events;
+
+    timer_heap_reserve(&queue->timers, timers);
+
+    if (events > queue->events_capacity) {
+        reallocate_events(queue, events);
+    }
+
+    if (io_events > queue->io_events_capacity) {
+        reallocate_io_events(queue, io_events);
+    }
+
+    if (io_events > 0) {
+        reallocate_io_fd_indices_to_fit(queue, (int)(io_events - 1));
+    }
+}
+
+static size_t max_size(size_t a, size_t b) {
+    return (a > b) ? a : b;
+}
+
+void event_queue_shrink_to_fit(EventQueue* queue) {
+    timer_heap_shrink(&queue->timers, queue->reserved_timers);
+
+    // Growth doubles the capacity of events and I/O events, so it can't be 0.
+    size_t events_capacity = max_size(max_size(queue->events_size, queue->reserved_events), 1);
+    if (events_capacity < queue->events_capacity) {
+        reallocate_events(queue, events_capacity);
+    }
+
+    size_t io_events_capacity =
+        max_size(max_size(queue->io_events_size, queue->reserved_io_events), 1);
+    if (io_events_capacity < queue->io_events_capacity) {
+        reallocate_io_events(queue, io_events_capacity);
+    }
+
+    size_t io_fd_indices_capacity =
+        max_size(get_io_fd_indices_size(queue), queue->reserved_io_events);
+    if (io_fd_indices_capacity == 0) {
+        free(queue->io_fd_indices);
+        queue->io_fd_indices = NULL;
+        queue->io_fd_indices_capacity = 0;
+    } else if (io_fd_indices_capacity < queue->io_fd_indices_capacity) {
+        queue->io_fd_indices = realloc(
+            queue->io_fd_indices, sizeof(size_t) * io_fd_indices_capacity);
+        if (queue->io_fd_indices == NULL) abort();
+        queue->io_fd_indices_capacity = io_fd_indices_capacity;
+    }
+
+    if (queue->hooks_size == 0) {
+        free(queue->hooks);
+        queue->hooks = NULL;
+        queue->hooks_capacity = 0;
+    } else if (queue->hooks_size < queue->hooks_capacity) {
+        queue->hooks = realloc(queue->hooks, sizeof(Hook) * queue->hooks_size);
+        if (queue->hooks == NULL) abort();
+        queue->hooks_capacity = queue->hooks_size;
+    }
+
+    // Buffers kept between batches and waits are reallocated when next needed.
+    for (size_t i = 0; i < queue->events_size; i++) {
+        Event* event = &queue->events[i];
+
+        // Storage for an event's limit is kept, so that triggers within it never allocate.
+        if (event->pending_count == 0 && event->pending_limit == 0) {
+            free(event->pending);
+            event->pending = NULL;
+            event->pending_head = 0;
+            event->pending_capacity = 0;
+        }
+
+        if (event->batch_size == 0) {
+            free(event->batch);
+            free(event->batch_expiry);
+            free(event->spare_batch);
+            free(event->spare_batch_expiry);
+            event->batch = NULL;
+            event->batch_expiry = NULL;
+            event->spare_batch = NULL;
+            event->spare_batch_expiry = NULL;
+            event->batch_capacity = 0;
+        }
+
+        if (event->waiters_size == 0) {
+            free(event->waiters);
+            free(event->spare_waiters);
+            event->waiters = NULL;
+            event->spare_waiters = NULL;
+            event->waiters_capacity = 0;
+        }
+    }
+}
+
+void event_queue_prefault_tables(EventQueue* queue) {
+    timer_heap_prefault(&queue->timers);
+
+    size_t unused_events = queue->events_capacity - queue->events_size;
+    memset(&queue->events[queue->events_size], 0, sizeof(Event) * unused_events);
+
+    size_t unused_io_events = queue->io_events_capacity - queue->io_events_size;
+    memset(&queue->io_events[queue->io_events_size], 0, sizeof(IoEvent) * unused_io_events);
+    memset(
+        &queue->io_poll_descriptors[queue->io_events_size], 0,
+        sizeof(struct pollfd) * unused_io_events);
+
+    size_t unused_hooks = queue->hooks_capacity - queue->hooks_size;
+    if (unused_hooks > 0) {
+        memset(&queue->hooks[queue->hooks_size], 0, sizeof(Hook) * unused_hooks);
+    }
+
+    // Unused entries of `io_fd_indices` are written when it grows.
+}
+
+void event_queue_set_auto_shrink(EventQueue* queue, bool is_enabled) {
+    queue->is_auto_shrinking = is_enabled;
+}
+
+// Halve `capacity` if at most a quarter of it is in use, but not below `reserved`.
+static size_t get_auto_shrunk_capacity(size_t size, size_t capacity, size_t reserved) {
+    if (capacity <= EVENT_QUEUE_AUTO_SHRINK_MIN_CAPACITY || size > capacity / 4) {
+        return capacity;
+    }
+
+    size_t halved = capacity / 2;
+    return (halved > reserved) ? halved : reserved;
+}
+
+static void auto_shrink(EventQueue* queue) {
+    timer_heap_shrink(&queue->timers, get_auto_shrunk_capacity(
+        queue->timers.size, queue->timers.capacity, queue->reserved_timers));
+
+    size_t events_capacity = get_auto_shrunk_capacity(
+        queue->events_size, queue->events_capacity, queue->reserved_events);
+    if (events_capacity < queue->events_capacity) {
+        reallocate_events(queue, events_capacity);
+    }
+
+    size_t io_events_capacity = get_auto_shrunk_capacity(
+        queue->io_events_size, queue->io_events_capacity, queue->reserved_io_events);
+    if (io_events_capacity < queue->io_events_capacity && !queue->is_dispatching_io) {
+        reallocate_io_events(queue, io_events_capacity);
+    }
+}
+
+// Work done at the end of each wait or poll.
+static void finish_wait(EventQueue* queue) {
+    update_backend_timer(queue);
+
+    if (queue->is_auto_shrinking) {
+        auto_shrink(queue);
+    }
+}
+
+bool event_queue_wait(EventQueue* queue) {
+    bool result = wait_once(queue);
+    finish_wait(queue);
+
+    return result;
+}
+
+bool event_queue_wait_timeout(EventQueue* queue, uint64_t timeout_us) {
+    uint64_t now_us = queue_now_us(queue);
+    uint64_t limit_us = add_saturating(now_us, timeout_us);
+
+    const Timer* next = timer_heap_find(&queue->timers);
+    bool result;
+
+    if (is_task_runnable(queue) || (next != NULL && next->deadline <= limit_us)) {
+        result = wait_once(queue);
+    } else if (next == NULL && queue->io_events_size == 0) {
+        result = false; // Nothing to wait for.
+    } else {
+        result = block_until(queue, true, limit_us, true);
+    }
+
+    finish_wait(queue);
+
+    return result;
+}
+
+bool event_queue_poll(EventQueue* queue) {
+    if (queue->backend_fd >= 0) {
+        // Clear the timerfd's expiry, so that the backend fd is only readable again once re-armed.
+        uint64_t expirations;
+        ssize_t status = read(queue->backend_timer_fd, &expirations, sizeof(expirations));
+        (void)status; // EAGAIN if it hasn't expired.
+
+        queue->is_backend_timer_armed = false;
+    }
+
+    bool handled = handle_io_events(queue, 0);
+
+    // Timers which become due while dispatching, such as events triggered by other events, wait for
+    // the next call, so that this returns promptly.
+    uint64_t now_us = queue_now_us(queue);
+    size_t limit = queue->timers.size;
+
+    for (size_t i = 0; i < limit; i++) {
+        const Timer* next = timer_heap_find(&queue->timers);
+
+        if (next == NULL || next->deadline > now_us) {
+            break;
+        }
+
+        dispatch_next_timer(queue);
+        handled = true;
+    }
+
+    if (is_task_runnable(queue)) {
+        run_tasks(queue);
+        handled = true;
+    }
+
+    // The host loop blocks next.
+    run_hooks(queue, hook_kind_prepare);
+
+    finish_wait(queue);
+
+    return handled;
+}
+
+int event_queue_get_fd(EventQueue* queue) {
+    if (queue->backend_fd >= 0) {
+        return queue->backend_fd;
+    }
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) abort();
+
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0) abort();
+
+    struct epoll_event timer_event = {
+        .events = EPOLLIN,
+        .data.fd = timer_fd,
+    };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &timer_event) != 0) abort();
+
+    queue->backend_fd = epoll_fd;
+    queue->backend_timer_fd = timer_fd;
+    queue->is_backend_timer_armed = false;
+
+    for (size_t i = 0; i < queue->io_events_size; i++) {
+        if (!queue->io_events[i].is_removed) {
+            const struct pollfd* pollfd = &queue->io_poll_descriptors[i];
+            update_backend_io_event(queue, EPOLL_CTL_ADD, pollfd->fd, pollfd->events);
+        }
+    }
+
+    update_backend_timer(queue);
+
+    return epoll_fd;
+}
+
 void event_queue_free(EventQueue* queue) {
+    // Cleared as they're freed, since destroy functions below may still modify timers.
+    if (queue->backend_fd >= 0) {
+        close(queue->backend_fd);
+        close(queue->backend_timer_fd);
+        queue->backend_fd = -1;
+    }
+
+    if (queue->watchdog != NULL) {
+        watchdog_free(queue->watchdog);
+        queue->watchdog = NULL;
+    }
+
+    if (queue->recorder != NULL) {
+        trace_recorder_free(queue->recorder);
+        queue->recorder = NULL;
+    }
+
+    if (queue->channel_hub != NULL) {
+        channel_hub_free(queue->channel_hub);
+    }
+
+    if (queue->file_watcher != NULL) {
+        file_watcher_free(queue->file_watcher);
+    }
+
+    if (queue->work_pool != NULL) {
+        work_pool_free(queue->work_pool);
+    }
+
+    if (queue->fiber_pool != NULL) {
+        fiber_pool_free(queue->fiber_pool);
+    }
+
+    for (size_t i = 0; i < queue->io_events_size; i++) {
+        IoEvent* event = &queue->io_events[i];
+
+        if (!event->is_removed && event->destroy != NULL) {
+            (*event->destroy)(event->userdata);
+        }
+    }
+
+    discard_delayed_triggers(queue, NULL);
+
+    for (size_t i = 0; i < queue->events_size; i++) {
+        discard_pending_triggers(&queue->events[i]);
+        free(queue->events[i].pending);
+        free(queue->events[i].batch);
+        free(queue->events[i].batch_expiry);
+        free(queue->events[i].spare_batch);
+        free(queue->events[i].spare_batch_expiry);
+        free(queue->events[i].waiters);
+        free(queue->events[i].spare_waiters);
+    }
+
     timer_heap_free(&queue->timers);
     free(queue->events);
     free(queue->io_poll_descriptors);
     free(queue->io_events);
+    free(queue->io_fd_indices);
+    free(queue->hooks);
 }
@@ -0,0 +1,50 @@
+#ifndef EVENTQUEUE_INTERNAL_H
+#define EVENTQUEUE_INTERNAL_H
+
+// Event queue functions used by other parts of the library, but not part of its public interface.
+
+#include "eventqueue.h"
+#include <stdbool.h>
+
+// Call `function(userdata, eventdata)` once, the next time the event `id` is dispatched, after the
+// event's own function. For batch events, `eventdata` is that of the most recent trigger. Returns
+// false if there is no event with the given ID, or, in real-time mode, if the waiter doesn't fit.
+// Waiters of a removed event are never called.
+bool event_queue_add_event_waiter(
+    EventQueue* queue,
+    EventId id,
+    EventFunction function,
+    void* userdata
+);
+
+// Like `event_queue_add_collapsing_event`, for an event the library adds for itself. Its triggers
+// aren't limited by, or counted towards, the queue's pending limit (see
+// `event_queue_set_pending_limit`), so that a limit meant for the application's events can't
+// discard them.
+EventId event_queue_add_internal_event(EventQueue* queue, EventFunction function, void* userdata);
+
+// A function which releases what an owned I/O event holds, such as its fd. See
+// `event_queue_add_owned_io_event`.
+typedef void (*EventIoDestroyFunction)(void* userdata);
+
+// Like `event_queue_add_io_event`, but `destroy(userdata)` is called when the I/O event is removed,
+// including when the queue is freed. `destroy` is called at the point of removal, so a function
+// which removes its own I/O event must not use `userdata` afterwards.
+IoEventId event_queue_add_owned_io_event(
+    EventQueue* queue,
+    int fd,
+    uint32_t mask,
+    EventIoFunction function,
+    EventIoDestroyFunction destroy,
+    void* userdata
+);
+
+// Write to every page of the queue's tables, up to their capacity, so that using them later doesn't
+// fault pages in.
+void event_queue_prefault_tables(EventQueue* queue);
+
+// Call the functions of I/O events which are ready now, without blocking. Returns true if any were
+// called.
+bool event_queue_dispatch_ready_io(EventQueue* queue);
+
+#endif // EVENTQUEUE_INTERNAL_H
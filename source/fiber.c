@@ -0,0 +1,259 @@
+#include "fiber.h"
+#include "fiber_pool.h"
+#include "eventqueue_internal.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+
+// On x86-64, switch stacks by hand. Only the callee-saved registers need saving, which avoids the
+// signal mask system call made by `swapcontext`.
+
+typedef struct FiberContext {
+    void* stack_pointer;
+} FiberContext;
+
+// Push callee-saved registers, store the stack pointer in `*save`, load `load` as the stack
+// pointer, and pop the registers saved there.
+void eventqueue_fiber_switch(void** save, void* load);
+
+__asm__(
+    ".text\n"
+    ".globl eventqueue_fiber_switch\n"
+    ".hidden eventqueue_fiber_switch\n"
+    ".type eventqueue_fiber_switch, @function\n"
+    "eventqueue_fiber_switch:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size eventqueue_fiber_switch, .-eventqueue_fiber_switch\n"
+);
+
+static void context_init(
+    FiberContext* context,
+    void* stack_bottom,
+    void* stack_top,
+    void (*entry)(void)
+) {
+    (void)stack_bottom;
+
+    // Lay out the stack as `eventqueue_fiber_switch` leaves it: six saved registers, then the
+    // address to return to. `stack_top` is 16-byte aligned, so `entry` starts with the stack
+    // pointer 8 bytes off alignment, as if it had been called.
+    void** stack = (void**)stack_top - 8;
+
+    for (size_t i = 0; i < 6; i++) {
+        stack[i] = NULL;
+    }
+
+    memcpy(&stack[6], &entry, sizeof(entry));
+    stack[7] = NULL; // Return address of `entry`, which never returns.
+
+    context->stack_pointer = stack;
+}
+
+static void context_switch(FiberContext* save, FiberContext* load) {
+    eventqueue_fiber_switch(&save->stack_pointer, load->stack_pointer);
+}
+
+#else
+
+#include <ucontext.h>
+
+typedef struct FiberContext {
+    ucontext_t context;
+} FiberContext;
+
+static void context_init(
+    FiberContext* context,
+    void* stack_bottom,
+    void* stack_top,
+    void (*entry)(void)
+) {
+    if (getcontext(&context->context) != 0) abort();
+
+    context->context.uc_stack.ss_sp = stack_bottom;
+    context->context.uc_stack.ss_size = (size_t)((char*)stack_top - (char*)stack_bottom);
+    context->context.uc_link = NULL;
+    makecontext(&context->context, entry, 0);
+}
+
+static void context_switch(FiberContext* save, FiberContext* load) {
+    if (swapcontext(&save->context, &load->context) != 0) abort();
+}
+
+#endif
+
+typedef struct Fiber {
+    EventQueue* queue;
+    FiberFunction function;
+    void* userdata;
+
+    // The stack acquired from the queue's fiber pool. This struct is stored at its top.
+    void* stack;
+
+    bool is_finished;
+
+    // The I/O event which resumes the fiber, while it is in `fiber_wait_readable`.
+    IoEventId io_event;
+
+    // The `eventdata` which resumed the fiber, while it is in `fiber_wait_event`.
+    void* eventdata;
+
+    // The fiber's own context, while it is suspended.
+    FiberContext context;
+
+    // The context which resumed the fiber, while it is running.
+    FiberContext caller_context;
+} Fiber;
+
+// The fiber running on this thread, or NULL if none is.
+static _Thread_local Fiber* current_fiber = NULL;
+
+static void fiber_entry(void) {
+    Fiber* fiber = current_fiber;
+    (*fiber->function)(fiber->userdata);
+
+    fiber->is_finished = true;
+    context_switch(&fiber->context, &fiber->caller_context);
+
+    abort(); // Finished fibers are never resumed.
+}
+
+static void fiber_resume(Fiber* fiber) {
+    assert(current_fiber == NULL); // Fibers are only resumed by the event queue.
+
+    current_fiber = fiber;
+    context_switch(&fiber->caller_context, &fiber->context);
+    current_fiber = NULL;
+
+    if (fiber->is_finished) {
+        // Nothing uses the stack (or this struct, which is on it) after the fiber finishes.
+        fiber_pool_release(fiber->queue->fiber_pool, fiber->stack);
+    }
+}
+
+static Fiber* fiber_suspend(void) {
+    Fiber* fiber = current_fiber;
+    assert(fiber != NULL); // Must be called from within a fiber.
+
+    context_switch(&fiber->context, &fiber->caller_context);
+
+    return fiber;
+}
+
+static void on_fiber_timer(void* userdata) {
+    fiber_resume(userdata);
+}
+
+static void on_fiber_readable(int fd, EventIoFlag flag, void* userdata) {
+    (void)fd;
+    (void)flag;
+
+    Fiber* fiber = userdata;
+    event_queue_remove_io_event(fiber->queue, fiber->io_event);
+    fiber_resume(fiber);
+}
+
+static void on_fiber_event(void* userdata, void* eventdata) {
+    Fiber* fiber = userdata;
+    fiber->eventdata = eventdata;
+    fiber_resume(fiber);
+}
+
+bool fiber_spawn(EventQueue* queue, FiberFunction function, void* userdata) {
+    if (queue->fiber_pool == NULL) {
+        queue->fiber_pool = fiber_pool_new(FIBER_STACK_SIZE + sizeof(Fiber));
+    }
+
+    void* stack = fiber_pool_acquire(queue->fiber_pool);
+    char* stack_end = (char*)stack + fiber_pool_stack_size(queue->fiber_pool);
+
+    // Store the fiber at the top of its stack. The stack grows down, away from it.
+    uintptr_t fiber_address =
+        ((uintptr_t)stack_end - sizeof(Fiber)) & ~(uintptr_t)(alignof(Fiber) - 1);
+    Fiber* fiber = (Fiber*)fiber_address;
+    void* stack_top = (void*)(fiber_address & ~(uintptr_t)15);
+
+    *fiber = (Fiber){
+        .queue = queue,
+        .function = function,
+        .userdata = userdata,
+        .stack = stack,
+        .is_finished = false,
+        .io_event = { .id = 0, .fd = -1 },
+        .eventdata = NULL,
+    };
+
+    context_init(&fiber->context, stack, stack_top, fiber_entry);
+
+    TimerId timer = event_queue_add_timer(queue, 0, on_fiber_timer, fiber);
+    if (timer.id == EVENT_QUEUE_INVALID_ID) {
+        fiber_pool_release(queue->fiber_pool, stack);
+        errno = ENOMEM;
+        return false;
+    }
+
+    return true;
+}
+
+bool fiber_sleep_us(uint64_t delay_us) {
+    Fiber* fiber = current_fiber;
+    assert(fiber != NULL);
+
+    TimerId timer = event_queue_add_timer(fiber->queue, delay_us, on_fiber_timer, fiber);
+    if (timer.id == EVENT_QUEUE_INVALID_ID) {
+        errno = ENOMEM;
+        return false;
+    }
+
+    fiber_suspend();
+    return true;
+}
+
+bool fiber_wait_readable(int fd) {
+    Fiber* fiber = current_fiber;
+    assert(fiber != NULL);
+
+    fiber->io_event = event_queue_add_io_event(
+        fiber->queue, fd, event_io_flag_read, on_fiber_readable, fiber);
+    if (fiber->io_event.id == EVENT_QUEUE_INVALID_ID) {
+        return false; // With `errno` set.
+    }
+
+    fiber_suspend();
+    return true;
+}
+
+bool fiber_wait_event(EventId id, void** eventdata) {
+    Fiber* fiber = current_fiber;
+    assert(fiber != NULL);
+
+    if (!event_queue_add_event_waiter(fiber->queue, id, on_fiber_event, fiber)) {
+        return false;
+    }
+
+    fiber_suspend();
+
+    *eventdata = fiber->eventdata;
+    return true;
+}
+
+bool fiber_yield(void) {
+    return fiber_sleep_us(0);
+}
@@ -0,0 +1,110 @@
+#include "fiber_pool.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+struct FiberPool {
+    size_t stack_size;
+    size_t guard_size;
+
+    // Every stack ever mapped by this pool, so that they can be unmapped when the pool is freed.
+    void** stacks;
+    size_t stacks_size;
+    size_t stacks_capacity;
+
+    // Stacks which are not currently in use.
+    void** free_stacks;
+    size_t free_stacks_size;
+};
+
+static void reallocate_stacks_if_at_capacity(FiberPool* pool) {
+    if (pool->stacks_size == pool->stacks_capacity) {
+        pool->stacks_capacity *= 2;
+
+        pool->stacks = realloc(pool->stacks, sizeof(void*) * pool->stacks_capacity);
+        if (pool->stacks == NULL) abort();
+
+        // There can never be more free stacks than stacks, so the free list grows alongside.
+        pool->free_stacks = realloc(pool->free_stacks, sizeof(void*) * pool->stacks_capacity);
+        if (pool->free_stacks == NULL) abort();
+    }
+}
+
+static void* map_stack(const FiberPool* pool) {
+    void* mapping = mmap(
+        NULL,
+        pool->guard_size + pool->stack_size,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK,
+        -1,
+        0
+    );
+    if (mapping == MAP_FAILED) abort();
+
+    // Stacks grow down, so an overflow runs into the inaccessible guard page and faults instead of
+    // silently corrupting other memory.
+    if (mprotect(mapping, pool->guard_size, PROT_NONE) != 0) abort();
+
+    return (char*)mapping + pool->guard_size;
+}
+
+FiberPool* fiber_pool_new(size_t stack_size) {
+    FiberPool* pool = malloc(sizeof(FiberPool));
+    if (pool == NULL) abort();
+
+    void** stacks = malloc(sizeof(void*));
+    if (stacks == NULL) abort();
+
+    void** free_stacks = malloc(sizeof(void*));
+    if (free_stacks == NULL) abort();
+
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+    *pool = (FiberPool){
+        // Round up to whole pages.
+        .stack_size = ((stack_size + page_size - 1) / page_size) * page_size,
+        .guard_size = page_size,
+        .stacks = stacks,
+        .stacks_size = 0,
+        .stacks_capacity = 1,
+        .free_stacks = free_stacks,
+        .free_stacks_size = 0,
+    };
+
+    return pool;
+}
+
+void* fiber_pool_acquire(FiberPool* pool) {
+    if (pool->free_stacks_size > 0) {
+        pool->free_stacks_size -= 1;
+        return pool->free_stacks[pool->free_stacks_size];
+    }
+
+    reallocate_stacks_if_at_capacity(pool);
+
+    void* stack = map_stack(pool);
+    pool->stacks[pool->stacks_size] = stack;
+    pool->stacks_size += 1;
+
+    return stack;
+}
+
+void fiber_pool_release(FiberPool* pool, void* stack) {
+    pool->free_stacks[pool->free_stacks_size] = stack;
+    pool->free_stacks_size += 1;
+}
+
+size_t fiber_pool_stack_size(const FiberPool* pool) {
+    return pool->stack_size;
+}
+
+void fiber_pool_free(FiberPool* pool) {
+    for (size_t i = 0; i < pool->stacks_size; i++) {
+        void* mapping = (char*)pool->stacks[i] - pool->guard_size;
+        munmap(mapping, pool->guard_size + pool->stack_size);
+    }
+
+    free(pool->stacks);
+    free(pool->free_stacks);
+    free(pool);
+}
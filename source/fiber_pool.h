@@ -0,0 +1,24 @@
+#ifndef EVENTQUEUE_FIBER_POOL_H
+#define EVENTQUEUE_FIBER_POOL_H
+
+// A pool of fiber stacks. Stacks are mapped once, with a guard page below them, and are reused
+// after their fiber finishes, so starting a fiber doesn't normally need a system call.
+
+#include <stddef.h>
+
+typedef struct FiberPool FiberPool;
+
+FiberPool* fiber_pool_new(size_t stack_size);
+
+// Get a stack of `stack_size` bytes from the pool. Returns a pointer to its lowest address.
+void* fiber_pool_acquire(FiberPool* pool);
+
+// Return a stack taken by `fiber_pool_acquire` to the pool.
+void fiber_pool_release(FiberPool* pool, void* stack);
+
+size_t fiber_pool_stack_size(const FiberPool* pool);
+
+// Unmap every stack of the pool, including those which haven't been released.
+void fiber_pool_free(FiberPool* pool);
+
+#endif // EVENTQUEUE_FIBER_POOL_H
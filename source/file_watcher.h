@@ -0,0 +1,11 @@
+#ifndef EVENTQUEUE_FILE_WATCHER_H
+#define EVENTQUEUE_FILE_WATCHER_H
+
+// The inotify fd shared by all file watches on an event queue.
+
+#include "eventqueue.h"
+
+// Remove every file watch on `queue`, and close the inotify fd.
+void file_watcher_free(FileWatcher* watcher);
+
+#endif // EVENTQUEUE_FILE_WATCHER_H
@@ -0,0 +1,95 @@
+#include "eventqueue.h"
+#include "eventqueue_internal.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434 // The same on every architecture.
+#endif
+
+// A watched child process. Owned by its I/O event.
+typedef struct ProcessEvent {
+    EventQueue* queue;
+    IoEventId io_event;
+    pid_t pid;
+    int pidfd;
+    ProcessExitFunction callback;
+    void* userdata;
+} ProcessEvent;
+
+static void destroy_process_event(void* userdata) {
+    ProcessEvent* process = userdata;
+
+    close(process->pidfd);
+    free(process);
+}
+
+// A pidfd becomes readable once its process has exited.
+static void on_process_exit(int fd, EventIoFlag flag, void* userdata) {
+    (void)fd;
+    (void)flag;
+
+    ProcessEvent* process = userdata;
+
+    int status;
+    pid_t result;
+    do {
+        result = waitpid(process->pid, &status, WNOHANG);
+    } while (result < 0 && errno == EINTR);
+
+    if (result == 0) {
+        return; // Not exited yet.
+    }
+
+    // Reaped elsewhere, so the status is unknown.
+    if (result < 0) {
+        status = -1;
+    }
+
+    ProcessEvent exited = *process;
+
+    // Frees `process`.
+    event_queue_remove_io_event(exited.queue, exited.io_event);
+
+    (*exited.callback)(exited.pid, status, exited.userdata);
+}
+
+bool event_queue_add_process_event(
+    EventQueue* queue,
+    pid_t pid,
+    ProcessExitFunction function,
+    void* userdata,
+    IoEventId* out
+) {
+    int pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd < 0) {
+        return false;
+    }
+
+    ProcessEvent* process = malloc(sizeof(ProcessEvent));
+    if (process == NULL) abort();
+
+    *process = (ProcessEvent){
+        .queue = queue,
+        .pid = pid,
+        .pidfd = pidfd,
+        .callback = function,
+        .userdata = userdata,
+    };
+
+    process->io_event = event_queue_add_owned_io_event(
+        queue, pidfd, event_io_flag_read, on_process_exit, destroy_process_event, process);
+
+    if (process->io_event.id == EVENT_QUEUE_INVALID_ID) {
+        int error = errno;
+        destroy_process_event(process); // Not owned by the queue, since it wasn't added.
+        errno = error;
+        return false;
+    }
+
+    *out = process->io_event;
+    return true;
+}
@@ -1,5 +1,7 @@
 #include "timer_heap.h"
+#include "timer_radix.h"
 #include <stdlib.h>
+#include <string.h>
 
 static void swap_elements(TimerHeap* heap, size_t a, size_t b) {
     Timer swap = heap->data[a];
@@ -70,14 +72,25 @@ TimerHeap timer_heap_new(void) {
         .data = data,
         .capacity = 1,
         .size = 0,
+        .kind = timer_heap_kind_binary,
+        .radix = NULL,
     };
 }
 
+static void reallocate_to_capacity(TimerHeap* heap, size_t capacity) {
+    heap->data = realloc(heap->data, sizeof(Timer) * capacity);
+    if (heap->data == NULL) abort();
+
+    if (heap->radix != NULL) {
+        timer_radix_reallocate(heap->radix, capacity);
+    }
+
+    heap->capacity = capacity;
+}
+
 static void reallocate_if_at_capacity(TimerHeap* heap) {
     if (heap->size == heap->capacity) {
-        heap->capacity *= 2;
-        heap->data = realloc(heap->data, sizeof(Timer) * heap->capacity);
-        if (heap->data == NULL) abort();
+        reallocate_to_capacity(heap, heap->capacity * 2);
     }
 }
 
@@ -92,7 +105,8 @@ static size_t append_element_unchecked(TimerHeap* heap, Timer timer) {
 
 static bool get_timer_index_by_id(const TimerHeap* heap, TimerId id, size_t* out) {
     for (size_t i = 0; i < heap->size; i++) {
-        if (heap->data[i].id == id.id) {
+        // Event IDs are separate from timer IDs, so may be equal.
+        if (heap->data[i].id == id.id && !heap->data[i].is_event) {
             *out = i;
             return true;
         }
@@ -101,15 +115,55 @@ static bool get_timer_index_by_id(const TimerHeap* heap, TimerId id, size_t* out
     return false;
 }
 
+// Restore the heap property of the whole heap, in linear time.
+static void heapify(TimerHeap* heap) {
+    for (size_t i = heap->size / 2; i > 0; i--) {
+        sift_down(heap, i - 1);
+    }
+}
+
+// Restore the order of the whole heap, after timers have been changed or removed in place.
+static void reorder(TimerHeap* heap) {
+    if (heap->kind == timer_heap_kind_radix) {
+        timer_radix_rebuild(heap);
+    } else {
+        heapify(heap);
+    }
+}
+
+// Switch how timers are ordered. Timers already in the heap are kept.
+void timer_heap_set_kind(TimerHeap* heap, TimerHeapKind kind) {
+    if (kind == heap->kind) {
+        return;
+    }
+
+    if (kind == timer_heap_kind_radix) {
+        heap->radix = timer_radix_new(heap, heap->capacity);
+    } else {
+        timer_radix_free(heap->radix);
+        heap->radix = NULL;
+        heapify(heap);
+    }
+
+    heap->kind = kind;
+}
+
 void timer_heap_insert(TimerHeap* heap, Timer timer) {
     reallocate_if_at_capacity(heap);
     size_t index = append_element_unchecked(heap, timer);
-    sift_up(heap, index);
+
+    if (heap->kind == timer_heap_kind_radix) {
+        timer_radix_push(heap, index);
+    } else {
+        sift_up(heap, index);
+    }
 }
 
 const Timer* timer_heap_find(const TimerHeap* heap) {
     if (heap->size == 0) {
         return NULL;
+    } else if (heap->kind == timer_heap_kind_radix) {
+        return &heap->data[timer_radix_find(heap)];
     } else {
         return &heap->data[0];
     }
@@ -118,6 +172,9 @@ const Timer* timer_heap_find(const TimerHeap* heap) {
 bool timer_heap_take(TimerHeap* heap, Timer* out) {
     if (heap->size == 0) {
         return false;
+    } else if (heap->kind == timer_heap_kind_radix) {
+        timer_radix_take(heap, out);
+        return true;
     } else {
         // Extract data
         *out = heap->data[0];
@@ -135,7 +192,13 @@ bool timer_heap_take(TimerHeap* heap, Timer* out) {
 
 void timer_heap_remove_id(TimerHeap* heap, TimerId id) {
     size_t index;
-    if (get_timer_index_by_id(heap, id, &index)) {
+    if (!get_timer_index_by_id(heap, id, &index)) {
+        return;
+    }
+
+    if (heap->kind == timer_heap_kind_radix) {
+        timer_radix_remove(heap, index);
+    } else {
         // Replace to-be-removed timer with least-minimal element.
         heap->data[index] = heap->data[heap->size - 1];
         heap->size -= 1;
@@ -145,6 +208,120 @@ void timer_heap_remove_id(TimerHeap* heap, TimerId id) {
     }
 }
 
+// Remove every timer in `group` in a single pass, then rebuild the heap. Returns the number of
+// timers removed.
+size_t timer_heap_remove_group(TimerHeap* heap, TimerGroupId group) {
+    size_t kept = 0;
+
+    for (size_t i = 0; i < heap->size; i++) {
+        // Events are in no group, but are kept even for group 0, which is that of every ungrouped
+        // timer.
+        if (heap->data[i].is_event || heap->data[i].group != group.id) {
+            heap->data[kept] = heap->data[i];
+            kept += 1;
+        }
+    }
+
+    size_t removed = heap->size - kept;
+    heap->size = kept;
+
+    if (removed > 0) {
+        reorder(heap);
+    }
+
+    return removed;
+}
+
+// Remove the delayed triggers of the event with ID `event_id`.
+size_t timer_heap_remove_delayed_triggers(TimerHeap* heap, uint32_t event_id) {
+    size_t kept = 0;
+
+    for (size_t i = 0; i < heap->size; i++) {
+        if (!heap->data[i].is_delayed_trigger || heap->data[i].id != event_id) {
+            heap->data[kept] = heap->data[i];
+            kept += 1;
+        }
+    }
+
+    size_t removed = heap->size - kept;
+    heap->size = kept;
+
+    if (removed > 0) {
+        reorder(heap);
+    }
+
+    return removed;
+}
+
+// Add `delta` to the deadline of every timer in `group`, saturating at 0 and `UINT64_MAX`, then
+// rebuild the heap.
+void timer_heap_shift_group(TimerHeap* heap, TimerGroupId group, int64_t delta) {
+    bool is_shifted = false;
+
+    for (size_t i = 0; i < heap->size; i++) {
+        Timer* timer = &heap->data[i];
+
+        if (timer->is_event || timer->group != group.id) {
+            continue;
+        }
+
+        if (delta >= 0) {
+            uint64_t amount = (uint64_t)delta;
+            timer->deadline = (timer->deadline > UINT64_MAX - amount)
+                ? UINT64_MAX
+                : (timer->deadline + amount);
+        } else {
+            uint64_t amount = (uint64_t)(-(delta + 1)) + 1; // Avoids overflow for INT64_MIN.
+            timer->deadline = (timer->deadline < amount) ? 0 : timer->deadline - amount;
+        }
+
+        is_shifted = true;
+    }
+
+    if (is_shifted) {
+        reorder(heap);
+    }
+}
+
+// Ensure `capacity` timers fit without reallocating.
+void timer_heap_reserve(TimerHeap* heap, size_t capacity) {
+    if (capacity > heap->capacity) {
+        reallocate_to_capacity(heap, capacity);
+    }
+}
+
+// Reduce the capacity to `capacity`, but no lower than the number of timers, or 1.
+void timer_heap_shrink(TimerHeap* heap, size_t capacity) {
+    if (capacity < heap->size) capacity = heap->size;
+    if (capacity < 1) capacity = 1; // Growth doubles the capacity, so it can't be 0.
+
+    if (capacity < heap->capacity) {
+        reallocate_to_capacity(heap, capacity);
+    }
+}
+
+// The number of bytes allocated per timer.
+size_t timer_heap_entry_size(const TimerHeap* heap) {
+    if (heap->kind == timer_heap_kind_radix) {
+        return sizeof(Timer) + timer_radix_entry_size();
+    } else {
+        return sizeof(Timer);
+    }
+}
+
+// Write to the unused capacity, so that it's backed by memory.
+void timer_heap_prefault(TimerHeap* heap) {
+    memset(&heap->data[heap->size], 0, sizeof(Timer) * (heap->capacity - heap->size));
+
+    if (heap->radix != NULL) {
+        timer_radix_prefault(heap);
+    }
+}
+
 void timer_heap_free(TimerHeap* heap) {
+    if (heap->radix != NULL) {
+        timer_radix_free(heap->radix);
+    }
+
     free(heap->data);
 }
@@ -0,0 +1,288 @@
+#include "timer_radix.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// A timer's key is its deadline, clamped to the radix heap's floor (the key of the last timer
+// taken). Bucket 0 holds timers whose key equals the floor, and bucket `b` holds those whose key
+// first differs from the floor at bit `b - 1`, so every key in a bucket is less than every key in
+// the buckets after it.
+#define BUCKET_COUNT 65
+
+// Marks an empty bucket's minimum.
+#define NO_ENTRY SIZE_MAX
+
+// A timer in a bucket. Keys are stored alongside positions, so that buckets can be scanned and
+// redistributed without touching the timers themselves.
+typedef struct BucketEntry {
+    uint64_t key;
+    size_t index;
+} BucketEntry;
+
+typedef struct Bucket {
+    BucketEntry* entries;
+    size_t size;
+    size_t capacity;
+
+    // The position of the entry with the smallest key, or `NO_ENTRY` if empty.
+    size_t minimum;
+} Bucket;
+
+// Where a timer's entry is.
+typedef struct TimerRadixSlot {
+    size_t bucket;
+    size_t position;
+} TimerRadixSlot;
+
+// Definition of typedef struct TimerRadix TimerRadix (in timer_heap.h):
+struct TimerRadix {
+    // Indexed like the heap's `data`.
+    TimerRadixSlot* slots;
+    size_t capacity;
+
+    Bucket buckets[BUCKET_COUNT];
+
+    // Bit `b - 1` is set if bucket `b` isn't empty. Bucket 0 is checked through its size.
+    uint64_t occupied;
+
+    uint64_t floor;
+};
+
+static size_t get_bucket(const TimerRadix* radix, uint64_t key) {
+    if (key == radix->floor) {
+        return 0;
+    }
+
+    return 64 - (size_t)__builtin_clzll(key ^ radix->floor);
+}
+
+static void push_entry(TimerRadix* radix, size_t index, uint64_t key) {
+    size_t bucket_index = get_bucket(radix, key);
+    Bucket* bucket = &radix->buckets[bucket_index];
+
+    if (bucket->size == bucket->capacity) {
+        bucket->capacity = (bucket->capacity == 0) ? 4 : (bucket->capacity * 2);
+        bucket->entries = realloc(bucket->entries, sizeof(BucketEntry) * bucket->capacity);
+        if (bucket->entries == NULL) abort();
+    }
+
+    size_t position = bucket->size;
+    bucket->entries[position] = (BucketEntry){ .key = key, .index = index };
+    bucket->size += 1;
+
+    if (bucket->minimum == NO_ENTRY) {
+        bucket->minimum = position;
+
+        if (bucket_index != 0) {
+            radix->occupied |= (uint64_t)1 << (bucket_index - 1);
+        }
+    } else if (key < bucket->entries[bucket->minimum].key) {
+        bucket->minimum = position;
+    }
+
+    radix->slots[index] = (TimerRadixSlot){ .bucket = bucket_index, .position = position };
+}
+
+// Find the smallest key in a bucket again, after its minimum has been removed.
+static void update_minimum(Bucket* bucket) {
+    size_t minimum = 0;
+
+    for (size_t i = 1; i < bucket->size; i++) {
+        if (bucket->entries[i].key < bucket->entries[minimum].key) {
+            minimum = i;
+        }
+    }
+
+    bucket->minimum = minimum;
+}
+
+static void remove_entry(TimerRadix* radix, size_t index) {
+    TimerRadixSlot slot = radix->slots[index];
+    Bucket* bucket = &radix->buckets[slot.bucket];
+
+    // Swap-remove, moving the bucket's last entry into the gap.
+    size_t last = bucket->size - 1;
+    bucket->size -= 1;
+
+    if (slot.position != last) {
+        bucket->entries[slot.position] = bucket->entries[last];
+        radix->slots[bucket->entries[slot.position].index].position = slot.position;
+    }
+
+    if (bucket->size == 0) {
+        bucket->minimum = NO_ENTRY;
+
+        if (slot.bucket != 0) {
+            radix->occupied &= ~((uint64_t)1 << (slot.bucket - 1));
+        }
+    } else if (bucket->minimum == slot.position) {
+        if (slot.bucket == 0) {
+            bucket->minimum = 0; // Keys in bucket 0 are all equal.
+        } else {
+            update_minimum(bucket);
+        }
+    } else if (bucket->minimum == last) {
+        bucket->minimum = slot.position;
+    }
+}
+
+// Point the entry of the timer at `from` to `to`, as the heap moves it there.
+static void move_timer(TimerRadix* radix, size_t from, size_t to) {
+    TimerRadixSlot slot = radix->slots[from];
+    radix->slots[to] = slot;
+    radix->buckets[slot.bucket].entries[slot.position].index = to;
+}
+
+static uint64_t get_key(const TimerRadix* radix, const Timer* timer) {
+    return (timer->deadline < radix->floor) ? radix->floor : timer->deadline;
+}
+
+static void clear_buckets(TimerRadix* radix) {
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        radix->buckets[i].size = 0;
+        radix->buckets[i].minimum = NO_ENTRY;
+    }
+
+    radix->occupied = 0;
+}
+
+TimerRadix* timer_radix_new(const TimerHeap* heap, size_t capacity) {
+    TimerRadix* radix = malloc(sizeof(TimerRadix));
+    if (radix == NULL) abort();
+
+    radix->slots = malloc(sizeof(TimerRadixSlot) * capacity);
+    if (radix->slots == NULL) abort();
+
+    radix->capacity = capacity;
+    radix->floor = 0;
+
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        radix->buckets[i] = (Bucket){
+            .entries = NULL,
+            .size = 0,
+            .capacity = 0,
+            .minimum = NO_ENTRY,
+        };
+    }
+
+    radix->occupied = 0;
+
+    for (size_t i = 0; i < heap->size; i++) {
+        push_entry(radix, i, heap->data[i].deadline);
+    }
+
+    return radix;
+}
+
+void timer_radix_reallocate(TimerRadix* radix, size_t capacity) {
+    radix->slots = realloc(radix->slots, sizeof(TimerRadixSlot) * capacity);
+    if (radix->slots == NULL) abort();
+
+    radix->capacity = capacity;
+
+    // No bucket needs to hold more than every timer.
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        Bucket* bucket = &radix->buckets[i];
+
+        if (bucket->capacity > capacity) {
+            bucket->entries = realloc(bucket->entries, sizeof(BucketEntry) * capacity);
+            if (bucket->entries == NULL) abort();
+
+            bucket->capacity = capacity;
+        }
+    }
+}
+
+void timer_radix_push(TimerHeap* heap, size_t index) {
+    push_entry(heap->radix, index, get_key(heap->radix, &heap->data[index]));
+}
+
+size_t timer_radix_find(const TimerHeap* heap) {
+    const TimerRadix* radix = heap->radix;
+    const Bucket* bucket = &radix->buckets[0];
+
+    if (bucket->size == 0) {
+        assert(radix->occupied != 0);
+        bucket = &radix->buckets[__builtin_ctzll(radix->occupied) + 1];
+    }
+
+    return bucket->entries[bucket->minimum].index;
+}
+
+// Remove the timer at `index` from `data`, by moving the last timer into its place.
+static void remove_from_data(TimerHeap* heap, size_t index) {
+    size_t last = heap->size - 1;
+
+    if (index != last) {
+        heap->data[index] = heap->data[last];
+        move_timer(heap->radix, last, index);
+    }
+
+    heap->size -= 1;
+}
+
+void timer_radix_take(TimerHeap* heap, Timer* out) {
+    TimerRadix* radix = heap->radix;
+
+    size_t index = timer_radix_find(heap);
+    TimerRadixSlot slot = radix->slots[index];
+    *out = heap->data[index];
+
+    if (slot.bucket == 0) {
+        remove_entry(radix, index);
+        remove_from_data(heap, index);
+        return; // The floor is unchanged.
+    }
+
+    Bucket* bucket = &radix->buckets[slot.bucket];
+    radix->floor = bucket->entries[slot.position].key;
+
+    // Every other timer in the taken timer's bucket now first differs from the floor at a lower
+    // bit, so moves to an earlier bucket. Later buckets are unaffected, and earlier ones are empty.
+    size_t size = bucket->size;
+    bucket->size = 0;
+    bucket->minimum = NO_ENTRY;
+    radix->occupied &= ~((uint64_t)1 << (slot.bucket - 1));
+
+    for (size_t i = 0; i < size; i++) {
+        BucketEntry entry = bucket->entries[i];
+
+        if (entry.index != index) {
+            push_entry(radix, entry.index, entry.key);
+        }
+    }
+
+    remove_from_data(heap, index);
+}
+
+void timer_radix_remove(TimerHeap* heap, size_t index) {
+    remove_entry(heap->radix, index);
+    remove_from_data(heap, index);
+}
+
+void timer_radix_rebuild(TimerHeap* heap) {
+    TimerRadix* radix = heap->radix;
+    clear_buckets(radix);
+
+    for (size_t i = 0; i < heap->size; i++) {
+        push_entry(radix, i, get_key(radix, &heap->data[i]));
+    }
+}
+
+size_t timer_radix_entry_size(void) {
+    return sizeof(TimerRadixSlot) + sizeof(BucketEntry);
+}
+
+void timer_radix_prefault(TimerHeap* heap) {
+    TimerRadix* radix = heap->radix;
+    memset(&radix->slots[heap->size], 0, sizeof(TimerRadixSlot) * (radix->capacity - heap->size));
+}
+
+void timer_radix_free(TimerRadix* radix) {
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        free(radix->buckets[i].entries);
+    }
+
+    free(radix->slots);
+    free(radix);
+}
@@ -0,0 +1,38 @@
+#ifndef EVENTQUEUE_TIMER_RADIX_H
+#define EVENTQUEUE_TIMER_RADIX_H
+
+// The buckets of a radix heap, ordering the timers of a `TimerHeap` of kind
+// `timer_heap_kind_radix`. Timers stay in the heap's `data`; the buckets link their positions.
+
+#include "timer_heap.h"
+
+// Create buckets for `capacity` timers, holding every timer already in `heap`.
+TimerRadix* timer_radix_new(const TimerHeap* heap, size_t capacity);
+
+// Resize the buckets to fit `capacity` timers.
+void timer_radix_reallocate(TimerRadix* radix, size_t capacity);
+
+// Add the timer at `heap->data[index]`, which has just been appended, to the buckets.
+void timer_radix_push(TimerHeap* heap, size_t index);
+
+// Get the position of the timer with the earliest deadline, which must exist.
+size_t timer_radix_find(const TimerHeap* heap);
+
+// Take the timer with the earliest deadline, which must exist, and store it in `out`.
+void timer_radix_take(TimerHeap* heap, Timer* out);
+
+// Remove the timer at `heap->data[index]`. The last timer is moved into its place.
+void timer_radix_remove(TimerHeap* heap, size_t index);
+
+// Re-bucket every timer, after deadlines have been changed or timers removed in place.
+void timer_radix_rebuild(TimerHeap* heap);
+
+// The number of bytes used per timer by the buckets.
+size_t timer_radix_entry_size(void);
+
+// Write to the buckets' unused entries, so that they're backed by memory.
+void timer_radix_prefault(TimerHeap* heap);
+
+void timer_radix_free(TimerRadix* radix);
+
+#endif // EVENTQUEUE_TIMER_RADIX_H
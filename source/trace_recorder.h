@@ -0,0 +1,53 @@
+#ifndef EVENTQUEUE_TRACE_RECORDER_H
+#define EVENTQUEUE_TRACE_RECORDER_H
+
+// Writes the binary trace log of an event queue. See `event_trace.h`.
+
+#include "eventqueue.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// The kinds of record in a trace log. Values are part of the log format.
+typedef enum TraceRecordKind {
+    // Arguments: timer ID, delay, period plus one (so that `TIMER_APERIODIC` is stored as 0).
+    trace_record_add_timer = 1,
+    // Arguments: timer ID.
+    trace_record_remove_timer = 2,
+    // Arguments: event ID, coalescing mode (0: none, 1: collapsing, 2: batch).
+    trace_record_add_event = 3,
+    // Arguments: event ID.
+    trace_record_remove_event = 4,
+    // Arguments: event ID.
+    trace_record_trigger_event = 5,
+    // Arguments: I/O event ID, mask.
+    trace_record_add_io_event = 6,
+    // Arguments: I/O event ID.
+    trace_record_remove_io_event = 7,
+    // Arguments: timer ID.
+    trace_record_dispatch_timer = 8,
+    // Arguments: event ID.
+    trace_record_dispatch_event = 9,
+    // Arguments: I/O event ID.
+    trace_record_dispatch_io_event = 10,
+    // Arguments: timer ID, new delay, period plus one. Written for each timer in a rescheduled
+    // group. Removals of groups are written as `trace_record_remove_timer` for each timer.
+    trace_record_reschedule_timer = 11,
+} TraceRecordKind;
+
+// Start a log in `file`, writing its header. `start_us` is the time of the queue's clock.
+TraceRecorder* trace_recorder_new(FILE* file, uint64_t start_us);
+
+// Append a record to the log. Arguments which aren't used by `kind` are ignored.
+void trace_recorder_write(
+    TraceRecorder* recorder,
+    TraceRecordKind kind,
+    uint64_t time_us,
+    uint64_t a,
+    uint64_t b,
+    uint64_t c
+);
+
+// Flush the log's file, and free the recorder.
+void trace_recorder_free(TraceRecorder* recorder);
+
+#endif // EVENTQUEUE_TRACE_RECORDER_H
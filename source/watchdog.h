@@ -0,0 +1,22 @@
+#ifndef EVENTQUEUE_WATCHDOG_H
+#define EVENTQUEUE_WATCHDOG_H
+
+// The heartbeat shared between an event queue and its watchdog thread. See `event_watchdog.h`.
+
+#include "event_watchdog.h"
+
+// Publish that `function`, registered as `id`, is about to be called.
+void watchdog_enter(
+    Watchdog* watchdog,
+    EventCallbackKind kind,
+    EventGenericFunction function,
+    uint32_t id
+);
+
+// Publish that the function given to the matching `watchdog_enter` has returned.
+void watchdog_leave(Watchdog* watchdog);
+
+// Stop the watchdog thread, and free the watchdog.
+void watchdog_free(Watchdog* watchdog);
+
+#endif // EVENTQUEUE_WATCHDOG_H
@@ -0,0 +1,209 @@
+#include "work_pool.h"
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+typedef struct WorkItem WorkItem;
+
+struct WorkItem {
+    WorkItem* next;
+    WorkFunction work;
+    WorkDoneFunction done;
+    void* userdata;
+};
+
+// A singly-linked FIFO of work items.
+typedef struct WorkList {
+    WorkItem* head;
+    WorkItem* tail;
+} WorkList;
+
+struct WorkPool {
+    pthread_mutex_t mutex;
+
+    // Signalled when work is submitted, or the pool is stopping.
+    pthread_cond_t work_available;
+
+    bool is_stopping;
+
+    // Work which has not yet been picked up by a worker thread.
+    WorkList pending;
+
+    // Work which has finished, but whose `done` function has not been called.
+    WorkList completed;
+
+    // Work submitted, but whose `done` function has not been called. Only accessed on the loop
+    // thread.
+    size_t outstanding;
+
+    int completion_fd;
+
+    pthread_t* threads;
+    size_t thread_count;
+};
+
+static void work_list_push(WorkList* list, WorkItem* item) {
+    item->next = NULL;
+
+    if (list->tail == NULL) {
+        list->head = item;
+    } else {
+        list->tail->next = item;
+    }
+
+    list->tail = item;
+}
+
+static WorkItem* work_list_pop(WorkList* list) {
+    WorkItem* item = list->head;
+
+    if (item != NULL) {
+        list->head = item->next;
+        if (list->head == NULL) {
+            list->tail = NULL;
+        }
+    }
+
+    return item;
+}
+
+static void work_list_free(WorkList* list) {
+    WorkItem* item;
+    while ((item = work_list_pop(list)) != NULL) {
+        free(item);
+    }
+}
+
+static void* worker_thread(void* userdata) {
+    WorkPool* pool = userdata;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    while (true) {
+        while (!pool->is_stopping && pool->pending.head == NULL) {
+            pthread_cond_wait(&pool->work_available, &pool->mutex);
+        }
+
+        if (pool->is_stopping) {
+            break;
+        }
+
+        WorkItem* item = work_list_pop(&pool->pending);
+
+        pthread_mutex_unlock(&pool->mutex);
+        (*item->work)(item->userdata);
+        pthread_mutex_lock(&pool->mutex);
+
+        work_list_push(&pool->completed, item);
+
+        uint64_t one = 1;
+        ssize_t written = write(pool->completion_fd, &one, sizeof(one));
+        (void)written; // Only fails if the counter overflows, when it's readable anyway.
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+WorkPool* work_pool_new(size_t thread_count) {
+    WorkPool* pool = malloc(sizeof(WorkPool));
+    if (pool == NULL) abort();
+
+    pthread_t* threads = malloc(sizeof(pthread_t) * thread_count);
+    if (threads == NULL) abort();
+
+    int completion_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (completion_fd < 0) abort();
+
+    *pool = (WorkPool){
+        .is_stopping = false,
+        .pending = { .head = NULL, .tail = NULL },
+        .completed = { .head = NULL, .tail = NULL },
+        .outstanding = 0,
+        .completion_fd = completion_fd,
+        .threads = threads,
+        .thread_count = thread_count,
+    };
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work_available, NULL);
+
+    for (size_t i = 0; i < thread_count; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_thread, pool) != 0) abort();
+    }
+
+    return pool;
+}
+
+void work_pool_submit(WorkPool* pool, WorkFunction work, WorkDoneFunction done, void* userdata) {
+    WorkItem* item = malloc(sizeof(WorkItem));
+    if (item == NULL) abort();
+
+    *item = (WorkItem){
+        .next = NULL,
+        .work = work,
+        .done = done,
+        .userdata = userdata,
+    };
+
+    pool->outstanding += 1;
+
+    pthread_mutex_lock(&pool->mutex);
+    work_list_push(&pool->pending, item);
+    pthread_cond_signal(&pool->work_available);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+int work_pool_completion_fd(const WorkPool* pool) {
+    return pool->completion_fd;
+}
+
+void work_pool_run_completions(WorkPool* pool) {
+    uint64_t count;
+    ssize_t status = read(pool->completion_fd, &count, sizeof(count));
+    (void)status; // EAGAIN when there's nothing to read, which is fine.
+
+    // Take the whole list at once, so the lock isn't held while calling `done` functions.
+    pthread_mutex_lock(&pool->mutex);
+    WorkList completed = pool->completed;
+    pool->completed = (WorkList){ .head = NULL, .tail = NULL };
+    pthread_mutex_unlock(&pool->mutex);
+
+    WorkItem* item;
+    while ((item = work_list_pop(&completed)) != NULL) {
+        pool->outstanding -= 1;
+
+        if (item->done != NULL) {
+            (*item->done)(item->userdata);
+        }
+
+        free(item);
+    }
+}
+
+size_t work_pool_outstanding(const WorkPool* pool) {
+    return pool->outstanding;
+}
+
+void work_pool_free(WorkPool* pool) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->is_stopping = true;
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (size_t i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    work_list_free(&pool->pending);
+    work_list_free(&pool->completed);
+
+    pthread_cond_destroy(&pool->work_available);
+    pthread_mutex_destroy(&pool->mutex);
+    close(pool->completion_fd);
+    free(pool->threads);
+    free(pool);
+}
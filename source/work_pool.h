@@ -0,0 +1,31 @@
+#ifndef EVENTQUEUE_WORK_POOL_H
+#define EVENTQUEUE_WORK_POOL_H
+
+// A bounded pool of worker threads, which posts completions to an eventfd. Used to implement
+// `event_queue_submit_work`.
+
+#include "eventqueue.h"
+#include <stddef.h>
+
+typedef struct WorkPool WorkPool;
+
+WorkPool* work_pool_new(size_t thread_count);
+
+// Queue `work(userdata)` to be run on a worker thread. Once it returns, the completion fd becomes
+// readable and `done(userdata)` is called by the next `work_pool_run_completions`.
+void work_pool_submit(WorkPool* pool, WorkFunction work, WorkDoneFunction done, void* userdata);
+
+// An eventfd which is readable while there are completions to run.
+int work_pool_completion_fd(const WorkPool* pool);
+
+// Call `done` for every completed piece of work, in completion order, on the calling thread.
+void work_pool_run_completions(WorkPool* pool);
+
+// The number of submitted pieces of work whose `done` function has not been called yet.
+size_t work_pool_outstanding(const WorkPool* pool);
+
+// Stop all worker threads and free the pool. Work which has not started is discarded, and no
+// further `done` functions are called.
+void work_pool_free(WorkPool* pool);
+
+#endif // EVENTQUEUE_WORK_POOL_H
@@ -0,0 +1,263 @@
+#include "event_acceptor.h"
+#include "mock_time.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// --- Utility --- //
+
+#define CONNECTION_COUNT 32
+
+static size_t accept_call_count;
+static sa_family_t accepted_family;
+static void accept_function(
+    int fd,
+    const struct sockaddr* address,
+    socklen_t address_size,
+    void* userdata
+) {
+    assert(address_size == sizeof(struct sockaddr_in));
+    assert((fcntl(fd, F_GETFL) & O_NONBLOCK) != 0);
+
+    size_t* count = userdata;
+    *count += 1;
+
+    accept_call_count += 1;
+    accepted_family = address->sa_family;
+    close(fd);
+}
+
+static struct sockaddr_in loopback_address(uint16_t port) {
+    return (struct sockaddr_in){
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+}
+
+// Connect to `address`, returning -1 with `errno` set on failure.
+static int connect_to(const struct sockaddr_in* address) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    assert(fd >= 0);
+
+    if (connect(fd, (const struct sockaddr*)address, sizeof(*address)) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+
+    return fd;
+}
+
+// Removes the acceptor pointed to by `userdata` from `removing_queue`, then listens on a new
+// socket, which may reuse the acceptor's fd number, with a connection waiting.
+static EventQueue* removing_queue;
+static int other_listener;
+static int other_client;
+static void removing_accept_function(
+    int fd,
+    const struct sockaddr* address,
+    socklen_t address_size,
+    void* userdata
+) {
+    (void)address;
+    (void)address_size;
+
+    accept_call_count += 1;
+    close(fd);
+
+    event_queue_remove_io_event(removing_queue, *(IoEventId*)userdata);
+
+    struct sockaddr_in other = loopback_address(0);
+    socklen_t other_size = sizeof(other);
+
+    other_listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    assert(other_listener >= 0);
+    assert(bind(other_listener, (const struct sockaddr*)&other, sizeof(other)) == 0);
+    assert(getsockname(other_listener, (struct sockaddr*)&other, &other_size) == 0);
+    assert(listen(other_listener, 1) == 0);
+
+    other_client = connect_to(&other);
+    assert(other_client >= 0);
+}
+
+// --- Tests --- //
+
+static void connections_are_accepted_by_every_queue_listening(void) {
+    EventQueue first = event_queue_new();
+    EventQueue second = event_queue_new();
+
+    size_t first_count = 0;
+    size_t second_count = 0;
+
+    // Port 0 asks for any port, which is written back for the second acceptor to share.
+    struct sockaddr_in address = loopback_address(0);
+    IoEventId first_acceptor;
+    assert(event_queue_add_acceptor(&first, (struct sockaddr*)&address, sizeof(address),
+        accept_function, &first_count, &first_acceptor));
+    assert(address.sin_port != 0);
+
+    IoEventId second_acceptor;
+    assert(event_queue_add_acceptor(&second, (struct sockaddr*)&address, sizeof(address),
+        accept_function, &second_count, &second_acceptor));
+
+    // The handshake completes in the kernel, so connections wait to be accepted.
+    int clients[CONNECTION_COUNT];
+    for (size_t i = 0; i < CONNECTION_COUNT; i++) {
+        clients[i] = connect_to(&address);
+        assert(clients[i] >= 0);
+    }
+
+    // Each queue accepts the connections waiting in its own socket in one go.
+    event_queue_poll(&first);
+    event_queue_poll(&second);
+    assert(accept_call_count == CONNECTION_COUNT);
+    assert(first_count + second_count == CONNECTION_COUNT);
+    assert(accepted_family == AF_INET);
+
+    for (size_t i = 0; i < CONNECTION_COUNT; i++) {
+        close(clients[i]);
+    }
+
+    // Once every acceptor is removed, nothing listens on the port.
+    event_queue_remove_io_event(&first, first_acceptor);
+    event_queue_remove_io_event(&second, second_acceptor);
+    assert(connect_to(&address) < 0);
+    assert(errno == ECONNREFUSED);
+
+    event_queue_free(&first);
+    event_queue_free(&second);
+}
+
+static void acceptors_fail_on_an_address_in_use(void) {
+    EventQueue queue = event_queue_new();
+    size_t count = 0;
+
+    // A socket without `SO_REUSEPORT` holds the port.
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    assert(fd >= 0);
+
+    struct sockaddr_in address = loopback_address(0);
+    socklen_t address_size = sizeof(address);
+    assert(bind(fd, (const struct sockaddr*)&address, sizeof(address)) == 0);
+    assert(getsockname(fd, (struct sockaddr*)&address, &address_size) == 0);
+    assert(listen(fd, 1) == 0);
+
+    IoEventId acceptor;
+    assert(!event_queue_add_acceptor(&queue, (struct sockaddr*)&address, sizeof(address),
+        accept_function, &count, &acceptor));
+    assert(errno == EADDRINUSE);
+
+    // Nothing is left registered.
+    assert(!event_queue_poll(&queue));
+
+    close(fd);
+    event_queue_free(&queue);
+}
+
+static void acceptors_can_be_removed_from_their_function(void) {
+    EventQueue queue = event_queue_new();
+    removing_queue = &queue;
+
+    struct sockaddr_in address = loopback_address(0);
+    IoEventId acceptor;
+    assert(event_queue_add_acceptor(&queue, (struct sockaddr*)&address, sizeof(address),
+        removing_accept_function, &acceptor, &acceptor));
+
+    int clients[2];
+    for (size_t i = 0; i < 2; i++) {
+        clients[i] = connect_to(&address);
+        assert(clients[i] >= 0);
+    }
+
+    // Removed after the first connection, so nothing more is accepted, even from a socket which
+    // took its fd number.
+    event_queue_poll(&queue);
+    assert(accept_call_count == 1);
+
+    int other_connection = accept(other_listener, NULL, NULL);
+    assert(other_connection >= 0);
+    close(other_connection);
+    close(other_client);
+    close(other_listener);
+
+    assert(connect_to(&address) < 0);
+    assert(errno == ECONNREFUSED);
+
+    for (size_t i = 0; i < 2; i++) {
+        close(clients[i]);
+    }
+
+    assert(!event_queue_poll(&queue));
+    event_queue_free(&queue);
+}
+
+static void acceptors_back_off_when_out_of_fds(void) {
+    EventQueue queue = event_queue_new();
+    size_t count = 0;
+
+    struct sockaddr_in address = loopback_address(0);
+    IoEventId acceptor;
+    assert(event_queue_add_acceptor(&queue, (struct sockaddr*)&address, sizeof(address),
+        accept_function, &count, &acceptor));
+
+    int client = connect_to(&address);
+    assert(client >= 0);
+
+    // Leave no fd free for the connection.
+    struct rlimit limit;
+    assert(getrlimit(RLIMIT_NOFILE, &limit) == 0);
+    struct rlimit lowered = limit;
+    lowered.rlim_cur = (rlim_t)dup(client);
+    close((int)lowered.rlim_cur);
+    assert(setrlimit(RLIMIT_NOFILE, &lowered) == 0);
+
+    assert(event_queue_poll(&queue));
+    assert(count == 0);
+
+    // The socket is still readable, but isn't watched for now.
+    assert(!event_queue_poll(&queue));
+
+    assert(setrlimit(RLIMIT_NOFILE, &limit) == 0);
+    time_sleep_until(100000);
+    while (event_queue_poll(&queue)) {}
+    assert(count == 1);
+    close(client);
+
+    // Acceptors freed while backing off take their timer with them.
+    client = connect_to(&address);
+    assert(client >= 0);
+    assert(setrlimit(RLIMIT_NOFILE, &lowered) == 0);
+    assert(event_queue_poll(&queue));
+    assert(setrlimit(RLIMIT_NOFILE, &limit) == 0);
+
+    close(client);
+    event_queue_free(&queue);
+}
+
+static void setup(void) {
+    mock_time_reset();
+    accept_call_count = 0;
+    accepted_family = AF_UNSPEC;
+}
+
+int main(void) {
+    void (*tests[])(void) = {
+        connections_are_accepted_by_every_queue_listening,
+        acceptors_fail_on_an_address_in_use,
+        acceptors_can_be_removed_from_their_function,
+        acceptors_back_off_when_out_of_fds,
+    };
+
+    size_t test_count = sizeof(tests) / sizeof(tests[0]);
+    for (size_t i = 0; i < test_count; i++) {
+        setup();
+        tests[i]();
+    }
+}
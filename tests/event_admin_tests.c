@@ -0,0 +1,159 @@
+#include "event_admin.h"
+#include "mock_time.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// --- Utility --- //
+
+static char directory[] = "/tmp/eventqueue-admin-XXXXXX";
+static char socket_path[64];
+
+static void timer_function(void* userdata) {
+    (void)userdata;
+}
+
+static void event_function(void* userdata, void* eventdata) {
+    (void)userdata;
+    (void)eventdata;
+}
+
+static void io_function(int fd, EventIoFlag flag, void* userdata) {
+    (void)fd;
+    (void)flag;
+    (void)userdata;
+}
+
+static int connect_to_admin(void) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    assert(fd >= 0);
+
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    strcpy(address.sun_path, socket_path);
+    assert(connect(fd, (const struct sockaddr*)&address, sizeof(address)) == 0);
+
+    return fd;
+}
+
+// Read until the server closes the connection.
+static void read_all(int fd, char* buffer, size_t size) {
+    size_t length = 0;
+
+    while (length + 1 < size) {
+        ssize_t count = read(fd, &buffer[length], size - length - 1);
+        assert(count >= 0);
+
+        if (count == 0) {
+            break;
+        }
+
+        length += (size_t)count;
+    }
+
+    buffer[length] = '\0';
+}
+
+// --- Tests --- //
+
+static void stats_count_timers_events_and_io(void) {
+    EventQueue queue = event_queue_new();
+
+    int pipes[2];
+    assert(pipe(pipes) == 0);
+    event_queue_add_io_event(&queue, pipes[0], event_io_flag_read, io_function, NULL);
+
+    event_queue_add_timer(&queue, 1000, timer_function, NULL);
+    event_queue_add_timer(&queue, 2000, timer_function, NULL);
+    EventId event = event_queue_add_event(&queue, event_function, NULL);
+    assert(event_queue_trigger_event(&queue, event, NULL));
+
+    EventQueueStats stats;
+    event_queue_get_stats(&queue, &stats);
+    assert(stats.timer_count == 2);
+    assert(stats.pending_event_count == 1);
+    assert(stats.io_event_count == 1);
+    assert(stats.io_wakeup_count == 0);
+
+    // The event is dispatched first, then the queue blocks until the timer is due.
+    assert(event_queue_wait(&queue));
+    assert(event_queue_wait(&queue));
+
+    event_queue_get_stats(&queue, &stats);
+    assert(stats.timer_count == 1);
+    assert(stats.pending_event_count == 0);
+    assert(stats.elapsed_us == 1000);
+    assert(stats.blocked_us == 1000);
+
+    assert(write(pipes[1], "x", 1) == 1);
+    assert(event_queue_poll(&queue));
+
+    event_queue_get_stats(&queue, &stats);
+    assert(stats.io_wakeup_count == 1);
+    assert(stats.io_ready_count == 1);
+
+    event_queue_free(&queue);
+    close(pipes[0]);
+    close(pipes[1]);
+}
+
+static void admin_clients_are_sent_gauges(void) {
+    EventQueue queue = event_queue_new();
+    event_queue_add_timer(&queue, 1000, timer_function, NULL);
+
+    IoEventId admin;
+    assert(event_queue_serve_admin(&queue, socket_path, &admin));
+
+    // The path is in use.
+    IoEventId duplicate;
+    assert(!event_queue_serve_admin(&queue, socket_path, &duplicate));
+
+    int first = connect_to_admin();
+    int second = connect_to_admin();
+    assert(event_queue_poll(&queue));
+
+    char buffer[EVENT_ADMIN_MAX_STATS_SIZE];
+    read_all(first, buffer, sizeof(buffer));
+    assert(strstr(buffer, "# TYPE eventqueue_timers gauge\neventqueue_timers 1\n") != NULL);
+    assert(strstr(buffer, "\neventqueue_pending_events 0\n") != NULL);
+    assert(strstr(buffer, "\neventqueue_io_events 1\n") != NULL);
+    assert(strstr(buffer, "# TYPE eventqueue_blocked_seconds_total counter\n") != NULL);
+
+    char other_buffer[EVENT_ADMIN_MAX_STATS_SIZE];
+    read_all(second, other_buffer, sizeof(other_buffer));
+    assert(strcmp(buffer, other_buffer) == 0);
+
+    close(first);
+    close(second);
+
+    // Removing the endpoint closes the socket, and unlinks its path.
+    event_queue_remove_io_event(&queue, admin);
+    assert(access(socket_path, F_OK) != 0);
+
+    event_queue_free(&queue);
+}
+
+static void setup(void) {
+    mock_time_reset();
+}
+
+int main(void) {
+    assert(mkdtemp(directory) != NULL);
+    snprintf(socket_path, sizeof(socket_path), "%s/admin.sock", directory);
+
+    void (*tests[])(void) = {
+        stats_count_timers_events_and_io,
+        admin_clients_are_sent_gauges,
+    };
+
+    size_t test_count = sizeof(tests) / sizeof(tests[0]);
+    for (size_t i = 0; i < test_count; i++) {
+        setup();
+        tests[i]();
+    }
+
+    rmdir(directory);
+}
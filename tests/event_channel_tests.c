@@ -0,0 +1,170 @@
+#include "event_channel.h"
+#include "mock_time.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+
+// --- Utility --- //
+
+static size_t received_count;
+static size_t received_call_count;
+static uintptr_t next_expected_message;
+static void receive_messages(void* userdata, void** messages, size_t count) {
+    (void)userdata;
+
+    assert(count > 0);
+    assert(count <= EVENT_CHANNEL_BATCH_SIZE);
+
+    for (size_t i = 0; i < count; i++) {
+        // Messages arrive in send order.
+        assert((uintptr_t)messages[i] == next_expected_message);
+        next_expected_message += 1;
+    }
+
+    received_count += count;
+    received_call_count += 1;
+}
+
+// The channels freed by `free_channels`, in order, up to a NULL.
+static EventChannel* channels_to_free[4];
+static size_t free_call_count;
+static void free_channels(void* userdata, void** messages, size_t count) {
+    (void)userdata;
+    (void)messages;
+    (void)count;
+
+    for (size_t i = 0; channels_to_free[i] != NULL; i++) {
+        event_channel_free(channels_to_free[i]);
+    }
+
+    free_call_count += 1;
+}
+
+#define PRODUCED_MESSAGE_COUNT 100000
+
+static void* producer_thread(void* userdata) {
+    EventChannel* channel = userdata;
+
+    for (uintptr_t i = 0; i < PRODUCED_MESSAGE_COUNT; i++) {
+        while (!event_channel_send(channel, (void*)i)) {
+            // Full. Wait for the consumer to catch up.
+        }
+    }
+
+    return NULL;
+}
+
+// --- Tests --- //
+
+static void messages_sent_before_waiting_are_received_in_batches(void) {
+    EventQueue queue = event_queue_new();
+    EventChannel* channel = event_channel_new(&queue, 100, receive_messages, NULL);
+
+    for (uintptr_t i = 0; i < 100; i++) {
+        assert(event_channel_send(channel, (void*)i));
+    }
+
+    // Capacity is rounded up to 128.
+    for (uintptr_t i = 100; i < 128; i++) {
+        assert(event_channel_send(channel, (void*)i));
+    }
+    assert(!event_channel_send(channel, NULL));
+
+    assert(event_queue_wait(&queue));
+    assert(received_count == 128);
+    assert(received_call_count == 2);
+
+    event_channel_free(channel);
+
+    // No channels left, so nothing to wait for.
+    assert(!event_queue_wait(&queue));
+
+    event_queue_free(&queue);
+}
+
+static void messages_from_another_thread_are_all_received(void) {
+    EventQueue queue = event_queue_new();
+    EventChannel* channel = event_channel_new(&queue, 256, receive_messages, NULL);
+
+    pthread_t thread;
+    assert(pthread_create(&thread, NULL, producer_thread, channel) == 0);
+
+    while (received_count < PRODUCED_MESSAGE_COUNT) {
+        assert(event_queue_wait(&queue));
+    }
+
+    assert(pthread_join(thread, NULL) == 0);
+    assert(received_count == PRODUCED_MESSAGE_COUNT);
+
+    event_channel_free(channel);
+    event_queue_free(&queue);
+}
+
+static void channels_are_freed_with_their_destination(void) {
+    EventQueue queue = event_queue_new();
+    EventChannel* channel_a = event_channel_new(&queue, 4, receive_messages, NULL);
+    EventChannel* channel_b = event_channel_new(&queue, 4, receive_messages, NULL);
+
+    assert(event_channel_send(channel_a, (void*)0));
+    assert(event_channel_send(channel_b, (void*)1));
+
+    event_queue_free(&queue);
+}
+
+// --- Test runner -- //
+
+static void channels_can_be_freed_from_channel_functions(void) {
+    EventQueue queue = event_queue_new();
+    EventChannel* first = event_channel_new(&queue, 4, receive_messages, NULL);
+    EventChannel* second = event_channel_new(&queue, 4, free_channels, NULL);
+    EventChannel* third = event_channel_new(&queue, 4, receive_messages, NULL);
+
+    // The second channel's function frees the first, ahead of it.
+    channels_to_free[0] = first;
+    channels_to_free[1] = NULL;
+
+    assert(event_channel_send(second, NULL));
+    assert(event_channel_send(third, (void*)0));
+    assert(event_queue_poll(&queue));
+
+    // The third channel wasn't skipped.
+    assert(free_call_count == 1);
+    assert(received_count == 1);
+
+    // A function freeing every channel, including its own, frees the doorbell too.
+    channels_to_free[0] = third;
+    channels_to_free[1] = second;
+    channels_to_free[2] = NULL;
+
+    assert(event_channel_send(second, NULL));
+    assert(event_channel_send(second, NULL));
+    assert(event_queue_poll(&queue));
+    assert(free_call_count == 2);
+
+    assert(!event_queue_wait(&queue));
+
+    event_queue_free(&queue);
+}
+
+static void setup(void) {
+    received_count = 0;
+    received_call_count = 0;
+    next_expected_message = 0;
+    free_call_count = 0;
+    mock_time_reset();
+}
+
+int main(void) {
+    void (*tests[])(void) = {
+        messages_sent_before_waiting_are_received_in_batches,
+        messages_from_another_thread_are_all_received,
+        channels_are_freed_with_their_destination,
+        channels_can_be_freed_from_channel_functions,
+    };
+
+    size_t test_count = sizeof(tests) / sizeof(tests[0]);
+    for (size_t i = 0; i < test_count; i++) {
+        setup();
+        tests[i]();
+    }
+}
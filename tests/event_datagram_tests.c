@@ -0,0 +1,223 @@
+#include "event_datagram.h"
+#include "mock_time.h"
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// --- Utility --- //
+
+#define MAX_RECEIVED 32
+
+static size_t receive_call_count;
+static size_t received_count;
+static size_t batch_sizes[MAX_RECEIVED];
+static unsigned char received_first_bytes[MAX_RECEIVED];
+static size_t received_sizes[MAX_RECEIVED];
+static bool received_truncated[MAX_RECEIVED];
+static uint16_t received_port;
+
+static void datagram_function(
+    EventDatagramSocket* socket,
+    const EventDatagram* datagrams,
+    size_t count,
+    void* userdata
+) {
+    (void)socket;
+    (void)userdata;
+
+    batch_sizes[receive_call_count] = count;
+    receive_call_count += 1;
+
+    for (size_t i = 0; i < count; i++) {
+        assert(datagrams[i].address_size == sizeof(struct sockaddr_in));
+
+        received_first_bytes[received_count] = datagrams[i].data[0];
+        received_sizes[received_count] = datagrams[i].size;
+        received_truncated[received_count] = datagrams[i].is_truncated;
+        received_port = ((const struct sockaddr_in*)datagrams[i].address)->sin_port;
+        received_count += 1;
+    }
+}
+
+// Open a non-blocking UDP socket bound to a port on loopback, written to `address`.
+static int open_udp_socket(struct sockaddr_in* address) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    assert(fd >= 0);
+
+    *address = (struct sockaddr_in){
+        .sin_family = AF_INET,
+        .sin_port = 0,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+
+    socklen_t address_size = sizeof(*address);
+    assert(bind(fd, (const struct sockaddr*)address, sizeof(*address)) == 0);
+    assert(getsockname(fd, (struct sockaddr*)address, &address_size) == 0);
+
+    return fd;
+}
+
+// --- Tests --- //
+
+static void received_datagrams_are_delivered_in_batches(void) {
+    EventQueue queue = event_queue_new();
+
+    struct sockaddr_in receiver_address;
+    struct sockaddr_in sender_address;
+    int receiver = open_udp_socket(&receiver_address);
+    int sender = open_udp_socket(&sender_address);
+
+    EventDatagramSocket* socket =
+        event_datagram_socket_new(&queue, receiver, 4, 16, datagram_function, NULL);
+
+    for (unsigned char i = 0; i < 10; i++) {
+        unsigned char data[2] = { i, 0 };
+        ssize_t sent = sendto(sender, data, sizeof(data), 0,
+            (const struct sockaddr*)&receiver_address, sizeof(receiver_address));
+        assert(sent == sizeof(data));
+    }
+
+    // Drained in one wakeup, a full batch at a time.
+    assert(event_queue_poll(&queue));
+    assert(receive_call_count == 3);
+    assert(batch_sizes[0] == 4);
+    assert(batch_sizes[1] == 4);
+    assert(batch_sizes[2] == 2);
+
+    for (unsigned char i = 0; i < 10; i++) {
+        assert(received_first_bytes[i] == i);
+        assert(received_sizes[i] == 2);
+        assert(!received_truncated[i]);
+    }
+    assert(received_port == sender_address.sin_port);
+
+    // Datagrams larger than the buffer are cut short.
+    unsigned char large[32] = { 42 };
+    assert(sendto(sender, large, sizeof(large), 0,
+        (const struct sockaddr*)&receiver_address, sizeof(receiver_address)) == sizeof(large));
+
+    assert(event_queue_poll(&queue));
+    assert(received_count == 11);
+    assert(received_first_bytes[10] == 42);
+    assert(received_sizes[10] == 16);
+    assert(received_truncated[10]);
+
+    event_datagram_socket_free(socket);
+    event_queue_free(&queue);
+    close(receiver);
+    close(sender);
+}
+
+static void sent_datagrams_are_flushed_before_blocking(void) {
+    EventQueue queue = event_queue_new();
+
+    struct sockaddr_in receiver_address;
+    struct sockaddr_in sender_address;
+    int receiver = open_udp_socket(&receiver_address);
+    int sender = open_udp_socket(&sender_address);
+
+    EventDatagramSocket* socket =
+        event_datagram_socket_new(&queue, sender, 4, 16, datagram_function, NULL);
+
+    for (unsigned char i = 0; i < 3; i++) {
+        assert(event_datagram_socket_send(socket, &i, 1,
+            (const struct sockaddr*)&receiver_address, sizeof(receiver_address)));
+    }
+
+    unsigned char too_large[17] = {0};
+    assert(!event_datagram_socket_send(socket, too_large, sizeof(too_large),
+        (const struct sockaddr*)&receiver_address, sizeof(receiver_address)));
+
+    // Nothing is sent until the queue is about to block.
+    unsigned char data;
+    assert(event_datagram_socket_queued_count(socket) == 3);
+    assert(recv(receiver, &data, 1, MSG_DONTWAIT) < 0);
+    assert(errno == EAGAIN || errno == EWOULDBLOCK);
+
+    event_queue_poll(&queue);
+    assert(event_datagram_socket_queued_count(socket) == 0);
+
+    for (unsigned char i = 0; i < 3; i++) {
+        assert(recv(receiver, &data, 1, MSG_DONTWAIT) == 1);
+        assert(data == i);
+    }
+
+    // A full queue is sent early, to make room, and the ring wraps around.
+    for (unsigned char i = 0; i < 6; i++) {
+        assert(event_datagram_socket_send(socket, &i, 1,
+            (const struct sockaddr*)&receiver_address, sizeof(receiver_address)));
+    }
+    assert(event_datagram_socket_queued_count(socket) == 2);
+
+    event_datagram_socket_flush(socket);
+    assert(event_datagram_socket_queued_count(socket) == 0);
+
+    for (unsigned char i = 0; i < 6; i++) {
+        assert(recv(receiver, &data, 1, MSG_DONTWAIT) == 1);
+        assert(data == i);
+    }
+
+    event_datagram_socket_free(socket);
+    event_queue_free(&queue);
+    close(receiver);
+    close(sender);
+}
+
+static void free_datagram_socket_function(
+    EventDatagramSocket* socket,
+    const EventDatagram* datagrams,
+    size_t count,
+    void* userdata
+) {
+    datagram_function(socket, datagrams, count, userdata);
+    event_datagram_socket_free(socket);
+}
+
+static void datagram_sockets_can_be_freed_from_their_function(void) {
+    EventQueue queue = event_queue_new();
+
+    struct sockaddr_in receiver_address;
+    struct sockaddr_in sender_address;
+    int receiver = open_udp_socket(&receiver_address);
+    int sender = open_udp_socket(&sender_address);
+
+    event_datagram_socket_new(&queue, receiver, 1, 16, free_datagram_socket_function, NULL);
+
+    for (unsigned char i = 0; i < 2; i++) {
+        assert(sendto(sender, &i, 1, 0,
+            (const struct sockaddr*)&receiver_address, sizeof(receiver_address)) == 1);
+    }
+
+    // Freed after the first batch, so the second is left unread.
+    assert(event_queue_poll(&queue));
+    assert(receive_call_count == 1);
+    assert(!event_queue_poll(&queue));
+
+    event_queue_free(&queue);
+    close(receiver);
+    close(sender);
+}
+
+static void setup(void) {
+    mock_time_reset();
+    receive_call_count = 0;
+    received_count = 0;
+    received_port = 0;
+}
+
+int main(void) {
+    void (*tests[])(void) = {
+        received_datagrams_are_delivered_in_batches,
+        sent_datagrams_are_flushed_before_blocking,
+        datagram_sockets_can_be_freed_from_their_function,
+    };
+
+    size_t test_count = sizeof(tests) / sizeof(tests[0]);
+    for (size_t i = 0; i < test_count; i++) {
+        setup();
+        tests[i]();
+    }
+}
@@ -0,0 +1,409 @@
+#include "event_pipeline.h"
+#include "event_realtime.h"
+#include "mock_time.h"
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// --- Utility --- //
+
+#define MAX_BATCHES 64
+
+static size_t batch_sizes[MAX_BATCHES];
+static size_t batch_call_count;
+static uintptr_t next_expected_item;
+static atomic_size_t received_count;
+static size_t ready_call_count;
+
+// Emits each item doubled, stopping when the next stage is full.
+static size_t double_items(
+    EventPipeline* pipeline,
+    EventStageId stage,
+    void** items,
+    size_t count,
+    void* userdata
+) {
+    (void)userdata;
+
+    for (size_t i = 0; i < count; i++) {
+        if (!event_pipeline_emit(pipeline, stage, (void*)((uintptr_t)items[i] * 2))) {
+            return i;
+        }
+    }
+
+    return count;
+}
+
+// Emits each item plus one, stopping when the next stage is full.
+static size_t increment_items(
+    EventPipeline* pipeline,
+    EventStageId stage,
+    void** items,
+    size_t count,
+    void* userdata
+) {
+    (void)userdata;
+
+    for (size_t i = 0; i < count; i++) {
+        if (!event_pipeline_emit(pipeline, stage, (void*)((uintptr_t)items[i] + 1))) {
+            return i;
+        }
+    }
+
+    return count;
+}
+
+// Checks items arrive in order, each `2 * i + 1`.
+static size_t receive_items(
+    EventPipeline* pipeline,
+    EventStageId stage,
+    void** items,
+    size_t count,
+    void* userdata
+) {
+    (void)userdata;
+
+    assert(count > 0);
+
+    // The last stage has nowhere to emit to.
+    assert(!event_pipeline_emit(pipeline, stage, NULL));
+
+    if (batch_call_count < MAX_BATCHES) {
+        batch_sizes[batch_call_count] = count;
+    }
+    batch_call_count += 1;
+
+    for (size_t i = 0; i < count; i++) {
+        assert((uintptr_t)items[i] == next_expected_item * 2 + 1);
+        next_expected_item += 1;
+    }
+
+    atomic_fetch_add(&received_count, count);
+    return count;
+}
+
+// Checks items arrive in order, unchanged.
+static size_t receive_unchanged_items(
+    EventPipeline* pipeline,
+    EventStageId stage,
+    void** items,
+    size_t count,
+    void* userdata
+) {
+    (void)pipeline;
+    (void)stage;
+    (void)userdata;
+
+    for (size_t i = 0; i < count; i++) {
+        assert((uintptr_t)items[i] == next_expected_item);
+        next_expected_item += 1;
+    }
+
+    atomic_fetch_add(&received_count, count);
+    return count;
+}
+
+// Passes items on unchanged, stopping when the next stage is full.
+static size_t forward_items(
+    EventPipeline* pipeline,
+    EventStageId stage,
+    void** items,
+    size_t count,
+    void* userdata
+) {
+    (void)userdata;
+
+    for (size_t i = 0; i < count; i++) {
+        if (!event_pipeline_emit(pipeline, stage, items[i])) {
+            return i;
+        }
+    }
+
+    return count;
+}
+
+static void count_ready_call(void* userdata) {
+    (void)userdata;
+    ready_call_count += 1;
+}
+
+static void ignore_event(void* userdata, void* eventdata) {
+    (void)userdata;
+    (void)eventdata;
+}
+
+static void ignore_timer(void* userdata) {
+    (void)userdata;
+}
+
+static void poll_until_idle(EventQueue* queue) {
+    while (event_queue_poll(queue)) {}
+}
+
+#define THREADED_ITEM_COUNT 100000
+
+static void* run_sink_queue(void* userdata) {
+    EventQueue* queue = userdata;
+
+    while (atomic_load(&received_count) < THREADED_ITEM_COUNT) {
+        assert(event_queue_wait(queue));
+    }
+
+    return NULL;
+}
+
+// --- Tests --- //
+
+static void items_pass_through_stages_in_batches(void) {
+    EventQueue queue = event_queue_new();
+    EventPipeline* pipeline = event_pipeline_new(&queue, NULL, NULL);
+
+    EventStageId parse =
+        event_pipeline_add_stage(pipeline, &queue, "parse", 16, 4, double_items, NULL);
+    EventStageId enrich =
+        event_pipeline_add_stage(pipeline, &queue, "enrich", 16, 4, increment_items, NULL);
+    EventStageId emit =
+        event_pipeline_add_stage(pipeline, &queue, "emit", 16, 8, receive_items, NULL);
+
+    for (uintptr_t i = 0; i < 10; i++) {
+        assert(event_pipeline_push(pipeline, (void*)i));
+    }
+
+    EventStageStats stats;
+    event_pipeline_get_stage_stats(pipeline, parse, &stats);
+    assert(stats.depth == 10);
+    assert(stats.capacity == 16);
+
+    poll_until_idle(&queue);
+    assert(received_count == 10);
+
+    // Each stage runs once per batch, not once per item.
+    event_pipeline_get_stage_stats(pipeline, parse, &stats);
+    assert(stats.item_count == 10);
+    assert(stats.batch_count == 3);
+    assert(stats.depth == 0);
+
+    event_pipeline_get_stage_stats(pipeline, enrich, &stats);
+    assert(stats.item_count == 10);
+    assert(stats.batch_count <= 4);
+
+    event_pipeline_get_stage_stats(pipeline, emit, &stats);
+    assert(stats.item_count == 10);
+    assert(stats.batch_count == batch_call_count);
+    assert(stats.blocked_count == 0);
+
+    for (size_t i = 0; i < batch_call_count; i++) {
+        assert(batch_sizes[i] <= 8);
+    }
+
+    // Rings wrap around.
+    for (uintptr_t i = 10; i < 30; i++) {
+        assert(event_pipeline_push(pipeline, (void*)i));
+        poll_until_idle(&queue);
+    }
+    assert(received_count == 30);
+
+    event_pipeline_free(pipeline);
+    event_queue_free(&queue);
+}
+
+static void full_stages_hold_back_earlier_stages(void) {
+    EventQueue source = event_queue_new();
+    EventQueue sink = event_queue_new();
+    EventPipeline* pipeline = event_pipeline_new(&source, count_ready_call, NULL);
+
+    EventStageId forward =
+        event_pipeline_add_stage(pipeline, &source, "forward", 4, 4, forward_items, NULL);
+    EventStageId receive =
+        event_pipeline_add_stage(pipeline, &sink, "receive", 2, 4, receive_unchanged_items, NULL);
+
+    uintptr_t pushed = 0;
+    while (event_pipeline_push(pipeline, (void*)pushed)) {
+        pushed += 1;
+    }
+    assert(pushed == 4);
+
+    // The sink isn't processing, so the first stage can only hand on two items.
+    poll_until_idle(&source);
+
+    EventStageStats stats;
+    event_pipeline_get_stage_stats(pipeline, forward, &stats);
+    assert(stats.item_count == 2);
+    assert(stats.depth == 2);
+    assert(stats.blocked_count >= 1);
+
+    event_pipeline_get_stage_stats(pipeline, receive, &stats);
+    assert(stats.depth == 2);
+
+    // Room was made in the first stage, so the source is told it can push again.
+    assert(ready_call_count == 1);
+    assert(event_pipeline_push(pipeline, (void*)pushed));
+    pushed += 1;
+
+    // Processing the sink wakes the first stage, which fills it again, until everything is through.
+    while (received_count < pushed) {
+        poll_until_idle(&sink);
+        poll_until_idle(&source);
+    }
+    assert(received_count == 5);
+
+    event_pipeline_get_stage_stats(pipeline, forward, &stats);
+    assert(stats.item_count == 5);
+    assert(stats.depth == 0);
+
+    event_pipeline_free(pipeline);
+    event_queue_free(&sink);
+    event_queue_free(&source);
+}
+
+static void stages_on_other_threads_receive_every_item(void) {
+    EventQueue source = event_queue_new();
+    EventQueue sink = event_queue_new();
+    EventPipeline* pipeline = event_pipeline_new(&source, NULL, NULL);
+
+    event_pipeline_add_stage(pipeline, &source, "double", 64, 16, double_items, NULL);
+    event_pipeline_add_stage(pipeline, &source, "increment", 64, 16, increment_items, NULL);
+    event_pipeline_add_stage(pipeline, &sink, "receive", 64, 32, receive_items, NULL);
+
+    pthread_t thread;
+    assert(pthread_create(&thread, NULL, run_sink_queue, &sink) == 0);
+
+    uintptr_t pushed = 0;
+    while (pushed < THREADED_ITEM_COUNT) {
+        if (event_pipeline_push(pipeline, (void*)pushed)) {
+            pushed += 1;
+        } else {
+            // Full. Wait for the stages on this queue, or for room from the sink.
+            assert(event_queue_wait(&source));
+        }
+    }
+
+    // Hand on what's left. Once it's all with the sink, nothing may arrive here, so don't block.
+    while (atomic_load(&received_count) < THREADED_ITEM_COUNT) {
+        event_queue_poll(&source);
+    }
+
+    assert(pthread_join(thread, NULL) == 0);
+
+    event_pipeline_free(pipeline);
+    event_queue_free(&sink);
+    event_queue_free(&source);
+}
+
+static void stages_are_not_added_without_room_in_realtime_mode(void) {
+    EventQueue queue = event_queue_new();
+
+    // Without privileges tests don't have.
+    EventRealtimeConfig config = event_realtime_config_default();
+    config.lock_memory = false;
+    assert(event_queue_enter_realtime(&queue, &config));
+
+    // Use up the room for events.
+    while (event_queue_add_event(&queue, ignore_event, NULL).id != EVENT_QUEUE_INVALID_ID) {}
+
+    errno = 0;
+    assert(event_pipeline_new(&queue, count_ready_call, NULL) == NULL);
+    assert(errno == ENOMEM);
+
+    EventPipeline* pipeline = event_pipeline_new(&queue, NULL, NULL);
+    assert(pipeline != NULL);
+
+    errno = 0;
+    EventStageId stage =
+        event_pipeline_add_stage(pipeline, &queue, "stage", 4, 4, forward_items, NULL);
+    assert(stage.id == EVENT_QUEUE_INVALID_ID);
+    assert(errno == ENOMEM);
+
+    event_pipeline_free(pipeline);
+    event_queue_free(&queue);
+}
+
+static void pushes_fail_while_stages_cannot_run_in_realtime_mode(void) {
+    EventQueue queue = event_queue_new();
+    EventPipeline* pipeline = event_pipeline_new(&queue, NULL, NULL);
+    event_pipeline_add_stage(pipeline, &queue, "receive", 4, 4, receive_unchanged_items, NULL);
+
+    EventRealtimeConfig config = event_realtime_config_default();
+    config.lock_memory = false;
+    assert(event_queue_enter_realtime(&queue, &config));
+
+    // Use up the room for timers, which running the stage needs.
+    TimerId timer = { .id = EVENT_QUEUE_INVALID_ID };
+    while (true) {
+        TimerId added = event_queue_add_timer(&queue, 1000, ignore_timer, NULL);
+        if (added.id == EVENT_QUEUE_INVALID_ID) break;
+        timer = added;
+    }
+
+    errno = 0;
+    assert(!event_pipeline_push(pipeline, (void*)0));
+    assert(errno == ENOMEM);
+
+    EventStageStats stats;
+    event_pipeline_get_stage_stats(pipeline, (EventStageId){0}, &stats);
+    assert(stats.depth == 0);
+
+    // Once there's room, the stage is woken again.
+    event_queue_remove_timer(&queue, timer);
+    assert(event_pipeline_push(pipeline, (void*)0));
+    poll_until_idle(&queue);
+    assert(received_count == 1);
+
+    event_pipeline_free(pipeline);
+    event_queue_free(&queue);
+}
+
+static void stages_are_not_held_to_the_queue_pending_limit(void) {
+    EventQueue queue = event_queue_new();
+    EventPipeline* pipeline = event_pipeline_new(&queue, NULL, NULL);
+    event_pipeline_add_stage(pipeline, &queue, "receive", 4, 4, receive_unchanged_items, NULL);
+
+    // The application's event uses up the limit.
+    event_queue_set_pending_limit(&queue, 1, event_overflow_policy_reject);
+    EventId event = event_queue_add_event(&queue, ignore_event, NULL);
+    assert(event_queue_trigger_event(&queue, event, NULL));
+    assert(!event_queue_trigger_event(&queue, event, NULL));
+
+    assert(event_pipeline_push(pipeline, (void*)0));
+    assert(event_pipeline_push(pipeline, (void*)1));
+    poll_until_idle(&queue);
+    assert(received_count == 2);
+
+    // The stage's pending wake doesn't count towards the limit.
+    assert(event_pipeline_push(pipeline, (void*)2));
+    assert(event_queue_trigger_event(&queue, event, NULL));
+    poll_until_idle(&queue);
+    assert(received_count == 3);
+
+    event_pipeline_free(pipeline);
+    event_queue_free(&queue);
+}
+
+// --- Test runner -- //
+
+static void setup(void) {
+    batch_call_count = 0;
+    next_expected_item = 0;
+    atomic_store(&received_count, 0);
+    ready_call_count = 0;
+    mock_time_reset();
+}
+
+int main(void) {
+    void (*tests[])(void) = {
+        items_pass_through_stages_in_batches,
+        full_stages_hold_back_earlier_stages,
+        stages_on_other_threads_receive_every_item,
+        stages_are_not_added_without_room_in_realtime_mode,
+        pushes_fail_while_stages_cannot_run_in_realtime_mode,
+        stages_are_not_held_to_the_queue_pending_limit,
+    };
+
+    size_t test_count = sizeof(tests) / sizeof(tests[0]);
+    for (size_t i = 0; i < test_count; i++) {
+        setup();
+        tests[i]();
+    }
+}
@@ -0,0 +1,336 @@
+#include "event_realtime.h"
+#include "event_acceptor.h"
+#include "event_channel.h"
+#include "event_datagram.h"
+#include "fiber.h"
+#include "mock_time.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// --- Utility --- //
+
+static size_t timer_call_count;
+static void timer_function(void* userdata) {
+    (void)userdata;
+    timer_call_count += 1;
+}
+
+static void event_function(void* userdata, void* eventdata) {
+    (void)userdata;
+    (void)eventdata;
+}
+
+static void io_function(int fd, EventIoFlag flag, void* userdata) {
+    (void)fd;
+    (void)flag;
+    (void)userdata;
+}
+
+static void accept_function(
+    int fd,
+    const struct sockaddr* address,
+    socklen_t address_size,
+    void* userdata
+) {
+    (void)address;
+    (void)address_size;
+    (void)userdata;
+    close(fd);
+}
+
+static void channel_function(void* userdata, void** messages, size_t count) {
+    (void)userdata;
+    (void)messages;
+    (void)count;
+}
+
+static void datagram_function(
+    EventDatagramSocket* socket,
+    const EventDatagram* datagrams,
+    size_t count,
+    void* userdata
+) {
+    (void)socket;
+    (void)datagrams;
+    (void)count;
+    (void)userdata;
+}
+
+static void fiber_function(void* userdata) {
+    (void)userdata;
+}
+
+static EventQueue* batch_queue;
+static EventId batch_event;
+static size_t batch_call_count;
+static void retriggering_batch_function(void* userdata, void** eventdata, size_t count) {
+    (void)userdata;
+    (void)eventdata;
+    (void)count;
+
+    // Triggers made while the batch is delivered still fit.
+    if (batch_call_count == 0) {
+        assert(event_queue_trigger_event(batch_queue, batch_event, NULL));
+    }
+
+    batch_call_count += 1;
+}
+
+static EventId waited_event;
+static size_t event_wait_count;
+static void waiting_fiber(void* userdata) {
+    (void)userdata;
+
+    for (size_t i = 0; i < 3; i++) {
+        void* eventdata;
+        assert(fiber_wait_event(waited_event, &eventdata));
+        event_wait_count += 1;
+    }
+}
+
+// The lowest unused fd, which is higher if an fd has been leaked since last called.
+static int get_next_fd(void) {
+    int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    assert(fd >= 0);
+    close(fd);
+    return fd;
+}
+
+static void enter_realtime(EventQueue* queue) {
+    // Pinning, priorities and locking memory need privileges tests don't have.
+    EventRealtimeConfig config = event_realtime_config_default();
+    config.lock_memory = false;
+
+    assert(event_queue_enter_realtime(queue, &config));
+}
+
+// --- Tests --- //
+
+static void adds_fail_instead_of_growing_in_realtime_mode(void) {
+    EventQueue queue = event_queue_new();
+    event_queue_reserve(&queue, 3, 2, 0);
+
+    EventId first = event_queue_add_event(&queue, event_function, NULL);
+    EventId second = event_queue_add_event(&queue, event_function, NULL);
+
+    // Storage for pending triggers is reserved by limiting them.
+    event_queue_set_event_limit(&queue, first, 2, event_overflow_policy_reject);
+    event_queue_set_event_limit(&queue, second, 1, event_overflow_policy_reject);
+
+    enter_realtime(&queue);
+    assert(event_queue_add_event(&queue, event_function, NULL).id == EVENT_QUEUE_INVALID_ID);
+
+    assert(event_queue_add_timer(&queue, 100, timer_function, NULL).id != EVENT_QUEUE_INVALID_ID);
+    assert(event_queue_trigger_event(&queue, first, NULL));
+    assert(event_queue_trigger_event(&queue, first, NULL));
+    assert(event_queue_trigger_event(&queue, second, NULL));
+    assert(!event_queue_trigger_event(&queue, second, NULL));
+    assert(event_queue_add_timer(&queue, 100, timer_function, NULL).id == EVENT_QUEUE_INVALID_ID);
+    assert(event_queue_add_prepare_hook(&queue, NULL, NULL).id == EVENT_QUEUE_INVALID_ID);
+
+    // Dispatching frees capacity again.
+    while (event_queue_wait(&queue)) {}
+    assert(timer_call_count == 1);
+    assert(event_queue_trigger_event(&queue, second, NULL));
+    assert(event_queue_add_timer(&queue, 100, timer_function, NULL).id != EVENT_QUEUE_INVALID_ID);
+
+    while (event_queue_wait(&queue)) {}
+    assert(timer_call_count == 2);
+
+    // Tables grow again once out of real-time mode.
+    event_queue_leave_realtime(&queue);
+    assert(event_queue_add_event(&queue, event_function, NULL).id != EVENT_QUEUE_INVALID_ID);
+
+    event_queue_free(&queue);
+}
+
+static void io_events_need_reserved_fds_in_realtime_mode(void) {
+    int pipes[2];
+    assert(pipe(pipes) == 0);
+
+    EventQueue queue = event_queue_new();
+    event_queue_reserve(&queue, 0, 0, (size_t)pipes[0] + 1);
+    enter_realtime(&queue);
+
+    IoEventId id =
+        event_queue_add_io_event(&queue, pipes[0], event_io_flag_read, io_function, NULL);
+    assert(id.id != EVENT_QUEUE_INVALID_ID);
+
+    // Beyond the reserved fds.
+    int high_fd = 1000;
+    assert(dup2(pipes[1], high_fd) == high_fd);
+    IoEventId beyond =
+        event_queue_add_io_event(&queue, high_fd, event_io_flag_read, io_function, NULL);
+    assert(beyond.id == EVENT_QUEUE_INVALID_ID);
+
+    // Removing an invalid ID does nothing.
+    event_queue_remove_io_event(&queue, beyond);
+    event_queue_remove_io_event(&queue, id);
+    assert(!event_queue_wait(&queue));
+
+    event_queue_free(&queue);
+    close(high_fd);
+    close(pipes[0]);
+    close(pipes[1]);
+}
+
+static void helpers_fail_without_leaking_when_adds_fail(void) {
+    EventQueue queue = event_queue_new();
+    enter_realtime(&queue);
+
+    // No fds are reserved, so no I/O event can be added.
+    int next_fd = get_next_fd();
+
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = 0,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    IoEventId acceptor;
+    errno = 0;
+    assert(!event_queue_add_acceptor(&queue, (struct sockaddr*)&address, sizeof(address),
+        accept_function, NULL, &acceptor));
+    assert(errno == ENOMEM);
+    assert(get_next_fd() == next_fd);
+
+    errno = 0;
+    assert(event_channel_new(&queue, 4, channel_function, NULL) == NULL);
+    assert(errno == ENOMEM);
+    assert(get_next_fd() == next_fd);
+
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    assert(fd >= 0);
+    errno = 0;
+    assert(event_datagram_socket_new(&queue, fd, 4, 16, datagram_function, NULL) == NULL);
+    assert(errno == ENOMEM);
+    close(fd);
+
+    // Nothing was left registered.
+    assert(!event_queue_wait(&queue));
+
+    // Fibers need a timer to start.
+    while (event_queue_add_timer(&queue, 100, timer_function, NULL).id != EVENT_QUEUE_INVALID_ID) {}
+
+    errno = 0;
+    assert(!fiber_spawn(&queue, fiber_function, NULL));
+    assert(errno == ENOMEM);
+
+    event_queue_free(&queue);
+}
+
+static void event_waiters_keep_their_room_in_realtime_mode(void) {
+    EventQueue queue = event_queue_new();
+    waited_event = event_queue_add_event(&queue, event_function, NULL);
+    event_queue_set_event_limit(&queue, waited_event, 1, event_overflow_policy_reject);
+
+    // The fiber's first wait makes room for a waiter.
+    assert(fiber_spawn(&queue, waiting_fiber, NULL));
+    while (event_queue_poll(&queue)) {}
+
+    enter_realtime(&queue);
+
+    // Each dispatch resumes the fiber, which waits again from within it.
+    for (size_t i = 1; i <= 3; i++) {
+        assert(event_queue_trigger_event(&queue, waited_event, NULL));
+        while (event_queue_poll(&queue)) {}
+        assert(event_wait_count == i);
+    }
+
+    event_queue_free(&queue);
+}
+
+static void dropping_the_oldest_trigger_needs_room_for_the_new_one(void) {
+    EventQueue queue = event_queue_new();
+    EventId first = event_queue_add_event(&queue, event_function, NULL);
+    EventId second = event_queue_add_event(&queue, event_function, NULL);
+
+    // Reserve room for one trigger of each, without limiting them.
+    event_queue_set_event_limit(&queue, first, 1, event_overflow_policy_reject);
+    event_queue_set_event_limit(&queue, second, 1, event_overflow_policy_reject);
+    event_queue_set_event_limit(&queue, first, 0, event_overflow_policy_reject);
+    event_queue_set_event_limit(&queue, second, 0, event_overflow_policy_reject);
+    event_queue_set_pending_limit(&queue, 2, event_overflow_policy_drop_oldest);
+    event_queue_reserve(&queue, 2, 0, 0);
+
+    enter_realtime(&queue);
+    assert(event_queue_trigger_event(&queue, first, NULL));
+    assert(event_queue_trigger_event(&queue, second, NULL));
+
+    // The second event has no room for another trigger, so the first's isn't dropped for it.
+    assert(!event_queue_trigger_event(&queue, second, NULL));
+    assert(event_queue_get_event_drop_count(&queue, first) == 0);
+
+    EventQueueStats stats;
+    event_queue_get_stats(&queue, &stats);
+    assert(stats.pending_event_count == 2);
+
+    event_queue_free(&queue);
+}
+
+static void batches_have_room_for_triggers_during_delivery_in_realtime_mode(void) {
+    EventQueue queue = event_queue_new();
+    batch_queue = &queue;
+    batch_event = event_queue_add_batch_event(&queue, retriggering_batch_function, NULL);
+
+    // Makes room for a batch of one.
+    assert(event_queue_trigger_event(&queue, batch_event, NULL));
+
+    enter_realtime(&queue);
+    while (event_queue_poll(&queue)) {}
+    assert(batch_call_count == 2);
+
+    assert(event_queue_trigger_event(&queue, batch_event, NULL));
+    while (event_queue_poll(&queue)) {}
+    assert(batch_call_count == 3);
+
+    event_queue_free(&queue);
+}
+
+static void radix_timers_are_refused_in_realtime_mode(void) {
+    EventQueue queue = event_queue_new();
+    EventRealtimeConfig config = event_realtime_config_default();
+    config.lock_memory = false;
+
+    assert(event_queue_set_timer_kind(&queue, timer_heap_kind_radix));
+    errno = 0;
+    assert(!event_queue_enter_realtime(&queue, &config));
+    assert(errno == EINVAL);
+
+    assert(event_queue_set_timer_kind(&queue, timer_heap_kind_binary));
+    enter_realtime(&queue);
+
+    errno = 0;
+    assert(!event_queue_set_timer_kind(&queue, timer_heap_kind_radix));
+    assert(errno == EINVAL);
+
+    event_queue_free(&queue);
+}
+
+static void setup(void) {
+    timer_call_count = 0;
+    event_wait_count = 0;
+    batch_call_count = 0;
+    mock_time_reset();
+}
+
+int main(void) {
+    void (*tests[])(void) = {
+        adds_fail_instead_of_growing_in_realtime_mode,
+        io_events_need_reserved_fds_in_realtime_mode,
+        helpers_fail_without_leaking_when_adds_fail,
+        event_waiters_keep_their_room_in_realtime_mode,
+        dropping_the_oldest_trigger_needs_room_for_the_new_one,
+        batches_have_room_for_triggers_during_delivery_in_realtime_mode,
+        radix_timers_are_refused_in_realtime_mode,
+    };
+
+    size_t test_count = sizeof(tests) / sizeof(tests[0]);
+    for (size_t i = 0; i < test_count; i++) {
+        setup();
+        tests[i]();
+    }
+}
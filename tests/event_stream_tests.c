@@ -0,0 +1,250 @@
+#include "event_stream.h"
+#include "mock_time.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+// --- Utility --- //
+
+static char received[256];
+static size_t received_size;
+static size_t read_call_count;
+static size_t drain_count;
+static size_t close_count;
+static int close_error;
+static EventBuffer* retained_buffer;
+
+static void on_read(EventStream* stream, EventBuffer* buffer, void* userdata) {
+    (void)stream;
+    (void)userdata;
+
+    assert(received_size + buffer->size <= sizeof(received));
+    memcpy(&received[received_size], buffer->data, buffer->size);
+    received_size += buffer->size;
+    read_call_count += 1;
+}
+
+static void on_read_retain(EventStream* stream, EventBuffer* buffer, void* userdata) {
+    on_read(stream, buffer, userdata);
+
+    event_buffer_retain(buffer);
+    retained_buffer = buffer;
+}
+
+static void on_read_free(EventStream* stream, EventBuffer* buffer, void* userdata) {
+    on_read(stream, buffer, userdata);
+    event_stream_free(stream);
+}
+
+static void on_drain(EventStream* stream, void* userdata) {
+    (void)stream;
+    (void)userdata;
+
+    drain_count += 1;
+}
+
+static void on_close(EventStream* stream, int error, void* userdata) {
+    (void)stream;
+    (void)userdata;
+
+    close_count += 1;
+    close_error = error;
+}
+
+static const EventStreamCallbacks callbacks = {
+    .on_read = on_read,
+    .on_drain = on_drain,
+    .on_close = on_close,
+};
+
+static void make_socket_pair(int fds[2]) {
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    assert(fcntl(fds[0], F_SETFL, O_NONBLOCK) == 0);
+    assert(fcntl(fds[1], F_SETFL, O_NONBLOCK) == 0);
+}
+
+// --- Tests --- //
+
+static void stream_reads_until_end_of_stream(void) {
+    EventQueue queue = event_queue_new();
+    int fds[2];
+    make_socket_pair(fds);
+
+    EventStream* stream = event_stream_new(&queue, fds[0], &callbacks, NULL);
+
+    assert(write(fds[1], "hello", 5) == 5);
+    assert(event_queue_wait(&queue));
+    assert(received_size == 5);
+    assert(memcmp(received, "hello", 5) == 0);
+    assert(close_count == 0);
+
+    close(fds[1]);
+    assert(event_queue_wait(&queue));
+    assert(close_count == 1);
+    assert(close_error == 0);
+
+    // Closed streams stop reading, so there's nothing left to wait for.
+    assert(!event_queue_wait(&queue));
+
+    event_stream_free(stream);
+    close(fds[0]);
+    event_queue_free(&queue);
+}
+
+static void read_buffers_can_be_retained_and_are_reused(void) {
+    EventQueue queue = event_queue_new();
+    int fds[2];
+    make_socket_pair(fds);
+
+    EventStreamCallbacks retaining_callbacks = callbacks;
+    retaining_callbacks.on_read = on_read_retain;
+    EventStream* stream = event_stream_new(&queue, fds[0], &retaining_callbacks, NULL);
+
+    assert(write(fds[1], "abc", 3) == 3);
+    assert(event_queue_wait(&queue));
+
+    // The buffer outlives the callback.
+    EventBuffer* buffer = retained_buffer;
+    assert(buffer->size == 3);
+    assert(memcmp(buffer->data, "abc", 3) == 0);
+    event_buffer_release(buffer);
+
+    // Once released, the next read reuses it.
+    assert(write(fds[1], "de", 2) == 2);
+    assert(event_queue_wait(&queue));
+    assert(retained_buffer == buffer);
+
+    event_buffer_release(retained_buffer);
+    event_stream_free(stream);
+    close(fds[0]);
+    close(fds[1]);
+    event_queue_free(&queue);
+}
+
+static void queued_writes_are_flushed_in_order(void) {
+    EventQueue queue = event_queue_new();
+    int fds[2];
+    make_socket_pair(fds);
+
+    EventStream* stream = event_stream_new(&queue, fds[0], &callbacks, NULL);
+
+    EventBuffer* buffer = event_stream_get_buffer(stream);
+    memcpy(buffer->data, "zero-", 5);
+    buffer->size = 5;
+    assert(event_stream_write(stream, buffer));
+    event_buffer_release(buffer);
+
+    assert(event_stream_write_copy(stream, "copy", 4));
+
+    // Nothing is written until the queue waits.
+    assert(event_stream_queued_bytes(stream) == 9);
+    char data[16];
+    assert(read(fds[1], data, sizeof(data)) == -1);
+
+    assert(event_queue_wait(&queue));
+    assert(event_stream_queued_bytes(stream) == 0);
+    assert(read(fds[1], data, sizeof(data)) == 9);
+    assert(memcmp(data, "zero-copy", 9) == 0);
+
+    event_stream_free(stream);
+    close(fds[0]);
+    close(fds[1]);
+    event_queue_free(&queue);
+}
+
+static void writes_report_backpressure_until_drained(void) {
+    EventQueue queue = event_queue_new();
+    int fds[2];
+    make_socket_pair(fds);
+
+    EventStream* stream = event_stream_new(&queue, fds[0], &callbacks, NULL);
+    event_stream_set_watermarks(stream, 4, 8);
+
+    assert(event_stream_write_copy(stream, "1234", 4));
+    assert(!event_stream_write_copy(stream, "5678", 4));
+    assert(!event_stream_write_copy(stream, "9", 1));
+    assert(drain_count == 0);
+
+    assert(event_queue_wait(&queue));
+    assert(drain_count == 1);
+    assert(event_stream_write_copy(stream, "0", 1));
+
+    event_stream_free(stream);
+    close(fds[0]);
+    close(fds[1]);
+    event_queue_free(&queue);
+}
+
+static void stream_can_be_freed_from_its_callbacks(void) {
+    EventQueue queue = event_queue_new();
+    int fds[2];
+    make_socket_pair(fds);
+
+    EventStreamCallbacks freeing_callbacks = callbacks;
+    freeing_callbacks.on_read = on_read_free;
+    event_stream_new(&queue, fds[0], &freeing_callbacks, NULL);
+
+    assert(write(fds[1], "x", 1) == 1);
+    assert(event_queue_wait(&queue));
+    assert(read_call_count == 1);
+
+    // The stream removed its I/O event when freed.
+    assert(!event_queue_wait(&queue));
+
+    close(fds[0]);
+    close(fds[1]);
+    event_queue_free(&queue);
+}
+
+static void streams_are_refused_for_fds_with_an_io_event(void) {
+    EventQueue queue = event_queue_new();
+    int fds[2];
+    make_socket_pair(fds);
+
+    EventStream* stream = event_stream_new(&queue, fds[0], &callbacks, NULL);
+    assert(stream != NULL);
+
+    errno = 0;
+    assert(event_stream_new(&queue, fds[0], &callbacks, NULL) == NULL);
+    assert(errno == EEXIST);
+
+    // The first stream still reads.
+    assert(write(fds[1], "hello", 5) == 5);
+    assert(event_queue_wait(&queue));
+    assert(received_size == 5);
+
+    event_stream_free(stream);
+    close(fds[0]);
+    close(fds[1]);
+    event_queue_free(&queue);
+}
+
+static void setup(void) {
+    received_size = 0;
+    read_call_count = 0;
+    drain_count = 0;
+    close_count = 0;
+    close_error = -1;
+    retained_buffer = NULL;
+    mock_time_reset();
+}
+
+int main(void) {
+    void (*tests[])(void) = {
+        stream_reads_until_end_of_stream,
+        read_buffers_can_be_retained_and_are_reused,
+        queued_writes_are_flushed_in_order,
+        writes_report_backpressure_until_drained,
+        stream_can_be_freed_from_its_callbacks,
+        streams_are_refused_for_fds_with_an_io_event,
+    };
+
+    size_t test_count = sizeof(tests) / sizeof(tests[0]);
+    for (size_t i = 0; i < test_count; i++) {
+        setup();
+        tests[i]();
+    }
+}
@@ -0,0 +1,169 @@
+#include "event_trace.h"
+#include "mock_time.h"
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// --- Utility --- //
+
+static size_t dispatch_count;
+
+static void timer_function(void* userdata) {
+    (void)userdata;
+    dispatch_count += 1;
+}
+
+static void event_function(void* userdata, void* eventdata) {
+    (void)userdata;
+    (void)eventdata;
+    dispatch_count += 1;
+}
+
+static void io_function(int fd, EventIoFlag flag, void* userdata) {
+    (void)flag;
+    (void)userdata;
+    dispatch_count += 1;
+
+    char data;
+    while (read(fd, &data, 1) == 1) {}
+}
+
+// --- Tests --- //
+
+static void replay_reproduces_recorded_dispatches(void) {
+    FILE* file = tmpfile();
+    assert(file != NULL);
+
+    int pipes[2];
+    assert(pipe(pipes) == 0);
+    assert(fcntl(pipes[0], F_SETFL, O_NONBLOCK) == 0);
+
+    VirtualClock clock = virtual_clock_new(500);
+    EventQueue queue = event_queue_new();
+    event_queue_set_clock(&queue, event_clock_virtual(&clock));
+
+    // Created before recording, so calls referring to it are skipped by the replay.
+    EventId unrecorded_event = event_queue_add_event(&queue, event_function, NULL);
+
+    event_queue_start_recording(&queue, file);
+
+    event_queue_add_periodic_timer(&queue, 1000, 1000, timer_function, NULL);
+    TimerId one_shot = event_queue_add_timer(&queue, 5500, timer_function, NULL);
+    EventId event = event_queue_add_event(&queue, event_function, NULL);
+    event_queue_add_io_event(&queue, pipes[0], event_io_flag_read, io_function, NULL);
+
+    for (size_t i = 0; i < 10; i++) {
+        event_queue_trigger_event(&queue, event, NULL);
+        event_queue_trigger_event(&queue, unrecorded_event, NULL);
+
+        if (i % 3 == 0) {
+            assert(write(pipes[1], "x", 1) == 1);
+        }
+
+        if (i == 4) {
+            event_queue_remove_timer(&queue, one_shot);
+        }
+
+        assert(event_queue_wait(&queue));
+        assert(event_queue_wait(&queue));
+        assert(event_queue_wait(&queue));
+    }
+
+    event_queue_stop_recording(&queue);
+    size_t recorded_dispatch_count = dispatch_count;
+
+    event_queue_free(&queue);
+    close(pipes[0]);
+    close(pipes[1]);
+
+    rewind(file);
+
+    EventTraceReport report;
+    assert(event_trace_replay(file, &report));
+
+    // 4 adds, 20 triggers and 1 removal.
+    assert(report.call_count == 25);
+
+    // Dispatches of the unrecorded event are recorded, but not replayed.
+    assert(report.recorded_dispatch_count == recorded_dispatch_count);
+    assert(report.replayed_dispatch_count == recorded_dispatch_count - 10);
+    assert(report.record_count == report.call_count + report.recorded_dispatch_count);
+    assert(report.virtual_duration_us == clock.now_us - 500);
+
+    fclose(file);
+}
+
+static void replay_reproduces_group_cancels_and_reschedules(void) {
+    FILE* file = tmpfile();
+    assert(file != NULL);
+
+    VirtualClock clock = virtual_clock_new(0);
+    EventQueue queue = event_queue_new();
+    event_queue_set_clock(&queue, event_clock_virtual(&clock));
+    event_queue_start_recording(&queue, file);
+
+    TimerGroupId cancelled = event_queue_add_timer_group(&queue);
+    TimerGroupId rescheduled = event_queue_add_timer_group(&queue);
+
+    for (uint64_t i = 1; i <= 5; i++) {
+        event_queue_add_grouped_timer(
+            &queue, cancelled, i * 100, TIMER_APERIODIC, timer_function, NULL);
+        event_queue_add_grouped_timer(&queue, rescheduled, i * 100, 1000, timer_function, NULL);
+    }
+
+    assert(event_queue_wait(&queue));
+    assert(event_queue_wait(&queue));
+    event_queue_cancel_group(&queue, cancelled);
+    event_queue_reschedule_group(&queue, rescheduled, 5000);
+
+    while (clock.now_us < 20000) {
+        assert(event_queue_wait(&queue));
+    }
+
+    event_queue_stop_recording(&queue);
+    size_t recorded_dispatch_count = dispatch_count;
+    event_queue_free(&queue);
+
+    rewind(file);
+
+    EventTraceReport report;
+    assert(event_trace_replay(file, &report));
+    assert(report.recorded_dispatch_count == recorded_dispatch_count);
+    assert(report.replayed_dispatch_count == recorded_dispatch_count);
+
+    fclose(file);
+}
+
+static void replay_rejects_invalid_logs(void) {
+    FILE* file = tmpfile();
+    assert(file != NULL);
+
+    fputs("not a trace", file);
+    rewind(file);
+
+    EventTraceReport report;
+    assert(!event_trace_replay(file, &report));
+
+    fclose(file);
+}
+
+// --- Test runner -- //
+
+static void setup(void) {
+    dispatch_count = 0;
+    mock_time_reset();
+}
+
+int main(void) {
+    void (*tests[])(void) = {
+        replay_reproduces_recorded_dispatches,
+        replay_reproduces_group_cancels_and_reschedules,
+        replay_rejects_invalid_logs,
+    };
+
+    size_t test_count = sizeof(tests) / sizeof(tests[0]);
+    for (size_t i = 0; i < test_count; i++) {
+        setup();
+        tests[i]();
+    }
+}
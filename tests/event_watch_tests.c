@@ -0,0 +1,165 @@
+#include "event_watch.h"
+#include "mock_time.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// --- Utility --- //
+
+static char directory[] = "/tmp/eventqueue-watch-XXXXXX";
+static char file_path[64];
+
+static size_t watch_call_count;
+static uint32_t watch_changes;
+static const char* watch_path;
+static void watch_function(const char* path, uint32_t changes, void* userdata) {
+    (void)userdata;
+
+    watch_call_count += 1;
+    watch_changes |= changes;
+    watch_path = path;
+}
+
+static FileWatchId removed_watch;
+static void removing_watch_function(const char* path, uint32_t changes, void* userdata) {
+    watch_function(path, changes, userdata);
+    event_queue_remove_file_watch(userdata, removed_watch);
+}
+
+static void append_to_file(const char* data) {
+    int fd = open(file_path, O_WRONLY | O_APPEND);
+    assert(fd >= 0);
+    assert(write(fd, data, strlen(data)) == (ssize_t)strlen(data));
+    close(fd);
+}
+
+// --- Tests --- //
+
+static void bursts_of_changes_are_coalesced(void) {
+    EventQueue queue = event_queue_new();
+
+    FileWatchId id;
+    assert(event_queue_add_file_watch(&queue, file_path, watch_function, NULL, &id));
+
+    for (int i = 0; i < 10; i++) {
+        append_to_file("change\n");
+    }
+
+    assert(event_queue_wait(&queue));
+    assert(watch_call_count == 1);
+    assert(watch_changes == file_watch_flag_modified);
+    assert(strcmp(watch_path, file_path) == 0);
+
+    event_queue_remove_file_watch(&queue, id);
+
+    // No watches left, so nothing to wait for.
+    assert(!event_queue_wait(&queue));
+
+    event_queue_free(&queue);
+}
+
+static void directory_watches_report_replaced_files(void) {
+    EventQueue queue = event_queue_new();
+
+    FileWatchId id;
+    assert(event_queue_add_file_watch(&queue, directory, watch_function, NULL, &id));
+
+    // Replace the file atomically, as configuration tools tend to.
+    char temporary_path[80];
+    snprintf(temporary_path, sizeof(temporary_path), "%s/next", directory);
+    int fd = open(temporary_path, O_WRONLY | O_CREAT, 0600);
+    assert(fd >= 0);
+    close(fd);
+    assert(rename(temporary_path, file_path) == 0);
+
+    assert(event_queue_wait(&queue));
+    assert(watch_call_count == 1);
+    assert(watch_changes == file_watch_flag_modified);
+    assert(strcmp(watch_path, directory) == 0);
+
+    event_queue_free(&queue);
+}
+
+static void deleted_files_are_reported_as_removed(void) {
+    EventQueue queue = event_queue_new();
+
+    FileWatchId id;
+    assert(event_queue_add_file_watch(&queue, file_path, watch_function, NULL, &id));
+
+    assert(unlink(file_path) == 0);
+    assert(event_queue_wait(&queue));
+    assert(watch_call_count == 1);
+    assert((watch_changes & file_watch_flag_removed) != 0);
+
+    event_queue_remove_file_watch(&queue, id);
+    event_queue_free(&queue);
+}
+
+static void watches_can_be_removed_from_watch_functions(void) {
+    EventQueue queue = event_queue_new();
+
+    // Both watch the same file. Whichever is called first removes the other.
+    FileWatchId first;
+    assert(event_queue_add_file_watch(&queue, file_path, removing_watch_function, &queue, &first));
+    assert(event_queue_add_file_watch(
+        &queue, file_path, removing_watch_function, &queue, &removed_watch));
+
+    append_to_file("change\n");
+    assert(event_queue_wait(&queue));
+    assert(watch_call_count == 1);
+
+    // The remaining watch still works.
+    removed_watch = first;
+    append_to_file("change\n");
+    assert(event_queue_wait(&queue));
+    assert(watch_call_count == 2);
+    assert(!event_queue_wait(&queue));
+
+    event_queue_free(&queue);
+}
+
+static void unwatchable_paths_are_rejected(void) {
+    EventQueue queue = event_queue_new();
+
+    FileWatchId id;
+    assert(!event_queue_add_file_watch(&queue, "/nonexistent/path", watch_function, NULL, &id));
+    assert(!event_queue_wait(&queue));
+
+    event_queue_free(&queue);
+}
+
+static void setup(void) {
+    watch_call_count = 0;
+    watch_changes = 0;
+    watch_path = NULL;
+    mock_time_reset();
+
+    int fd = open(file_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    assert(fd >= 0);
+    close(fd);
+}
+
+int main(void) {
+    assert(mkdtemp(directory) != NULL);
+    snprintf(file_path, sizeof(file_path), "%s/config", directory);
+
+    void (*tests[])(void) = {
+        bursts_of_changes_are_coalesced,
+        directory_watches_report_replaced_files,
+        deleted_files_are_reported_as_removed,
+        watches_can_be_removed_from_watch_functions,
+        unwatchable_paths_are_rejected,
+    };
+
+    size_t test_count = sizeof(tests) / sizeof(tests[0]);
+    for (size_t i = 0; i < test_count; i++) {
+        setup();
+        tests[i]();
+    }
+
+    unlink(file_path);
+    rmdir(directory);
+}
@@ -0,0 +1,107 @@
+#include "event_watchdog.h"
+#include "mock_time.h"
+#include <assert.h>
+#include <time.h>
+
+// --- Utility --- //
+
+static size_t stall_count;
+static EventStall last_stall;
+static void stall_function(const EventStall* stall, void* userdata) {
+    (void)userdata;
+
+    stall_count += 1;
+    last_stall = *stall;
+}
+
+// Block the calling thread for real, unlike the mocked clock.
+static void block_for_ms(long milliseconds) {
+    struct timespec duration = {
+        .tv_sec = 0,
+        .tv_nsec = milliseconds * 1000000,
+    };
+
+    while (nanosleep(&duration, &duration) != 0) {}
+}
+
+static void slow_timer_function(void* userdata) {
+    (void)userdata;
+    block_for_ms(50);
+}
+
+static size_t fast_timer_call_count;
+static void fast_timer_function(void* userdata) {
+    (void)userdata;
+    fast_timer_call_count += 1;
+}
+
+static void slow_event_function(void* userdata, void* eventdata) {
+    (void)userdata;
+    (void)eventdata;
+    block_for_ms(50);
+}
+
+// --- Tests --- //
+
+static void slow_timers_are_reported_once(void) {
+    EventQueue queue = event_queue_new();
+    event_queue_start_watchdog(&queue, 10000, stall_function, NULL);
+
+    for (size_t i = 0; i < 100; i++) {
+        event_queue_add_timer(&queue, i, fast_timer_function, NULL);
+    }
+    TimerId slow = event_queue_add_timer(&queue, 1000, slow_timer_function, NULL);
+
+    while (event_queue_wait(&queue)) {}
+
+    // Stopping joins the thread, so its writes are visible.
+    event_queue_stop_watchdog(&queue);
+
+    assert(fast_timer_call_count == 100);
+    assert(stall_count == 1);
+    assert(last_stall.kind == event_callback_kind_timer);
+    assert(last_stall.function == (EventGenericFunction)slow_timer_function);
+    assert(last_stall.id == slow.id);
+    assert(last_stall.running_us >= 10000);
+
+    event_queue_free(&queue);
+}
+
+static void slow_events_are_reported(void) {
+    EventQueue queue = event_queue_new();
+    event_queue_start_watchdog(&queue, 10000, stall_function, NULL);
+
+    EventId event = event_queue_add_event(&queue, slow_event_function, NULL);
+    event_queue_trigger_event(&queue, event, NULL);
+    event_queue_trigger_event(&queue, event, NULL);
+
+    assert(event_queue_wait(&queue));
+    assert(event_queue_wait(&queue));
+
+    // Freeing the queue stops the watchdog.
+    event_queue_free(&queue);
+
+    assert(stall_count == 2);
+    assert(last_stall.kind == event_callback_kind_event);
+    assert(last_stall.function == (EventGenericFunction)slow_event_function);
+    assert(last_stall.id == event.id);
+}
+
+static void setup(void) {
+    stall_count = 0;
+    fast_timer_call_count = 0;
+    mock_time_reset();
+}
+
+int main(void) {
+    void (*tests[])(void) = {
+        slow_timers_are_reported_once,
+        slow_events_are_reported,
+    };
+
+    size_t test_count = sizeof(tests) / sizeof(tests[0]);
+    for (size_t i = 0; i < test_count; i++) {
+        setup();
+        tests[i]();
+    }
+}
@@ -1,8 +1,11 @@
 #include "eventqueue.h"
 #include "mock_time.h"
 #include <assert.h>
+#include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
 
 // --- Utility & mocks --- //
 
@@ -49,6 +52,124 @@ static void event_io_function_b(int fd, EventIoFlag flag, void* userdata) {
     while (read(fd, &data, 1) == 1) {}
 }
 
+static void work_function(void* userdata) {
+    // Runs on a worker thread. Only touches its own item.
+    int* value = userdata;
+    *value *= 2;
+}
+
+static size_t work_done_function_call_count;
+static void work_done_function(void* userdata) {
+    int* value = userdata;
+    assert(*value % 2 == 0); // Work has finished before its done function is called.
+    work_done_function_call_count += 1;
+}
+
+// Submits more work from `work_chaining_queue` until `work_chain_remaining` reaches 0.
+static EventQueue* work_chaining_queue;
+static size_t work_chain_remaining;
+static void work_chaining_done_function(void* userdata) {
+    work_done_function(userdata);
+
+    if (work_chain_remaining > 0) {
+        work_chain_remaining -= 1;
+        event_queue_submit_work(
+            work_chaining_queue, work_function, work_chaining_done_function, userdata);
+    }
+}
+
+// Removes the I/O event pointed to by `userdata` from `io_removing_queue` when called.
+static EventQueue* io_removing_queue;
+static size_t io_removing_function_call_count;
+static void io_removing_function(int fd, EventIoFlag flag, void* userdata) {
+    (void)flag;
+    io_removing_function_call_count += 1;
+
+    char data;
+    while (read(fd, &data, 1) == 1) {}
+
+    event_queue_remove_io_event(io_removing_queue, *(IoEventId*)userdata);
+}
+
+// Removes the timer pointed to by `userdata` from `timer_removing_queue` when called.
+static EventQueue* timer_removing_queue;
+static void timer_removing_function(int fd, EventIoFlag flag, void* userdata) {
+    (void)flag;
+
+    char data;
+    assert(read(fd, &data, 1) == 1);
+
+    event_queue_remove_timer(timer_removing_queue, *(TimerId*)userdata);
+}
+
+static uint64_t prepare_hook_time;
+static size_t prepare_hook_call_count;
+static void prepare_hook(void* userdata) {
+    (void)userdata;
+    prepare_hook_time = mock_time_get();
+    prepare_hook_call_count += 1;
+}
+
+static uint64_t check_hook_time;
+static size_t check_hook_call_count;
+static void check_hook(void* userdata) {
+    (void)userdata;
+    check_hook_time = mock_time_get();
+    check_hook_call_count += 1;
+}
+
+// Uses up the whole budget given, and records which callback ran.
+static int idle_trace[8];
+static size_t idle_trace_size;
+static uint64_t idle_budget;
+static void idle_callback(void* userdata, uint64_t budget_us) {
+    idle_budget = budget_us;
+    idle_trace[idle_trace_size] = *(int*)userdata;
+    idle_trace_size += 1;
+    time_sleep_until(mock_time_get() + budget_us);
+}
+
+// Uses up the whole budget given, and finishes after `*userdata` steps.
+static size_t task_step_count;
+static uint64_t task_budget;
+static EventTaskStatus task_function(void* userdata, uint64_t budget_us) {
+    task_budget = budget_us;
+    task_step_count += 1;
+    time_sleep_until(mock_time_get() + budget_us);
+
+    size_t* remaining_steps = userdata;
+    *remaining_steps -= 1;
+    return (*remaining_steps == 0) ? event_task_status_done : event_task_status_more;
+}
+
+#define CHILD_PROCESS_COUNT 16
+
+static size_t process_exit_call_count;
+static int process_exit_statuses[CHILD_PROCESS_COUNT];
+static void process_exit_function(pid_t pid, int status, void* userdata) {
+    (void)pid;
+
+    process_exit_statuses[(uintptr_t)userdata] = status;
+    process_exit_call_count += 1;
+}
+
+// Start a child process which exits with `code`, once `block_fd` is readable, if given.
+static pid_t spawn_child(int code, int block_fd) {
+    pid_t pid = fork();
+    assert(pid >= 0);
+
+    if (pid == 0) {
+        char byte;
+        if (block_fd >= 0) {
+            (void)read(block_fd, &byte, 1);
+        }
+
+        _exit(code);
+    }
+
+    return pid;
+}
+
 // --- Tests --- //
 
 static void added_timers_cause_delay_when_waiting(void) {
@@ -177,6 +298,237 @@ static void waiting_after_event_trigger_calls_related_callback(void) {
     event_queue_free(&queue);
 }
 
+static void collapsing_event_dispatches_once_with_latest_eventdata(void) {
+    EventQueue queue = event_queue_new();
+
+    int userdata = 0;
+    int values[3] = {0};
+
+    EventId event = event_queue_add_collapsing_event(&queue, event_callback, &userdata);
+
+    for (size_t i = 0; i < 3; i++) {
+        event_queue_trigger_event(&queue, event, &values[i]);
+    }
+
+    assert(event_queue_wait(&queue));
+    assert(event_callback_call_count == 1);
+    assert(event_callback_userdata == &userdata);
+    assert(event_callback_eventdata == &values[2]);
+
+    // All triggers were collapsed, so there is nothing left to process.
+    assert(!event_queue_wait(&queue));
+    assert(event_callback_call_count == 1);
+
+    // Triggering after a dispatch schedules a new one.
+    event_queue_trigger_event(&queue, event, &values[0]);
+    assert(event_queue_wait(&queue));
+    assert(event_callback_call_count == 2);
+    assert(event_callback_eventdata == &values[0]);
+
+    event_queue_free(&queue);
+}
+
+static size_t batch_callback_call_count;
+static size_t batch_callback_count;
+static void* batch_callback_eventdata[8];
+static void batch_callback(void* userdata, void** eventdata, size_t count) {
+    (void)userdata;
+    batch_callback_call_count += 1;
+    batch_callback_count = count;
+
+    for (size_t i = 0; i < count && i < 8; i++) {
+        batch_callback_eventdata[i] = eventdata[i];
+    }
+}
+
+static void batch_event_delivers_all_pending_eventdata_in_one_call(void) {
+    EventQueue queue = event_queue_new();
+
+    int values[5] = {0};
+
+    EventId event = event_queue_add_batch_event(&queue, batch_callback, NULL);
+
+    for (size_t i = 0; i < 5; i++) {
+        event_queue_trigger_event(&queue, event, &values[i]);
+    }
+
+    assert(event_queue_wait(&queue));
+    assert(batch_callback_call_count == 1);
+    assert(batch_callback_count == 5);
+    for (size_t i = 0; i < 5; i++) {
+        assert(batch_callback_eventdata[i] == &values[i]);
+    }
+
+    assert(!event_queue_wait(&queue));
+
+    event_queue_trigger_event(&queue, event, &values[3]);
+    assert(event_queue_wait(&queue));
+    assert(batch_callback_call_count == 2);
+    assert(batch_callback_count == 1);
+    assert(batch_callback_eventdata[0] == &values[3]);
+
+    // Removing an event drops its pending batch.
+    event_queue_trigger_event(&queue, event, &values[4]);
+    event_queue_remove_event(&queue, event);
+    assert(event_queue_wait(&queue));
+    assert(batch_callback_call_count == 2);
+
+    event_queue_free(&queue);
+}
+
+static void submitted_work_completes_on_the_queue_thread(void) {
+    EventQueue queue = event_queue_new();
+    event_queue_set_work_thread_count(&queue, 2);
+
+    int values[5] = {1, 2, 3, 4, 5};
+    for (size_t i = 0; i < 5; i++) {
+        event_queue_submit_work(&queue, work_function, work_done_function, &values[i]);
+    }
+
+    while (event_queue_wait(&queue)) {}
+
+    assert(work_done_function_call_count == 5);
+    for (size_t i = 0; i < 5; i++) {
+        assert(values[i] == (int)(2 * (i + 1)));
+    }
+
+    // The pool can be used again after it goes idle.
+    event_queue_submit_work(&queue, work_function, NULL, &values[0]);
+    while (event_queue_wait(&queue)) {}
+    assert(values[0] == 4);
+
+    event_queue_free(&queue);
+}
+
+static void work_can_be_submitted_from_done_functions(void) {
+    EventQueue queue = event_queue_new();
+    work_chaining_queue = &queue;
+    work_chain_remaining = 3;
+
+    int value = 1;
+    event_queue_submit_work(&queue, work_function, work_chaining_done_function, &value);
+
+    while (event_queue_wait(&queue)) {}
+
+    assert(work_done_function_call_count == 4);
+    assert(value == 16);
+
+    event_queue_free(&queue);
+}
+
+static void virtual_clock_jumps_to_timer_deadlines(void) {
+    const uint64_t hour_us = 3600ULL * 1000000ULL;
+
+    VirtualClock clock = virtual_clock_new(1000);
+    EventQueue queue = event_queue_new();
+    event_queue_set_clock(&queue, event_clock_virtual(&clock));
+    assert(event_queue_now_us(&queue) == 1000);
+
+    event_queue_add_periodic_timer(&queue, hour_us, hour_us, timer_a_callback, NULL);
+    event_queue_add_timer(&queue, 2 * hour_us + 1, timer_b_callback, NULL);
+
+    // Waiting with pipe I/O registered mustn't block on a virtual clock.
+    int pipes[2];
+    assert(pipe(pipes) == 0);
+    event_queue_add_io_event(&queue, pipes[0], event_io_flag_read, event_io_function_a, NULL);
+
+    for (size_t i = 0; i < 24; i++) {
+        assert(event_queue_wait(&queue));
+    }
+
+    assert(timer_a_callback_call_count == 23);
+    assert(timer_b_callback_call_count == 1);
+    assert(clock.now_us == 1000 + 23 * hour_us);
+
+    // The queue's own clock is used, not the global one.
+    assert(mock_time_get() == 0);
+
+    // Advancing the clock makes the timer due.
+    virtual_clock_advance(&clock, hour_us);
+    assert(event_queue_wait(&queue));
+    assert(clock.now_us == 1000 + 24 * hour_us);
+    assert(timer_a_callback_call_count == 24);
+
+    event_queue_free(&queue);
+    close(pipes[0]);
+    close(pipes[1]);
+}
+
+static void prepare_and_check_hooks_run_around_blocking(void) {
+    EventQueue queue = event_queue_new();
+
+    HookId prepare = event_queue_add_prepare_hook(&queue, prepare_hook, NULL);
+    HookId check = event_queue_add_check_hook(&queue, check_hook, NULL);
+
+    event_queue_add_timer(&queue, 1000, timer_a_callback, NULL);
+    assert(event_queue_wait(&queue));
+    assert(prepare_hook_call_count == 1);
+    assert(prepare_hook_time == 0);
+    assert(check_hook_call_count == 1);
+    assert(check_hook_time == 1000);
+
+    // Nothing blocks when events are ready, so hooks don't run.
+    EventId event = event_queue_add_event(&queue, event_callback, NULL);
+    event_queue_trigger_event(&queue, event, NULL);
+    assert(event_queue_wait(&queue));
+    assert(prepare_hook_call_count == 1);
+    assert(check_hook_call_count == 1);
+
+    // Hooks alone aren't something to wait for.
+    assert(!event_queue_wait(&queue));
+
+    event_queue_remove_hook(&queue, prepare);
+    event_queue_remove_hook(&queue, check);
+    event_queue_add_timer(&queue, 1000, timer_a_callback, NULL);
+    assert(event_queue_wait(&queue));
+    assert(prepare_hook_call_count == 1);
+    assert(check_hook_call_count == 1);
+
+    event_queue_free(&queue);
+}
+
+static void idle_callbacks_share_a_budget_when_nothing_is_ready(void) {
+    EventQueue queue = event_queue_new();
+    event_queue_set_idle_budget(&queue, 300);
+
+    int a = 1;
+    int b = 2;
+    event_queue_add_idle_callback(&queue, idle_callback, &a);
+    event_queue_add_idle_callback(&queue, idle_callback, &b);
+
+    // The first callback uses the whole budget, so the second must wait for the next idle period.
+    event_queue_add_timer(&queue, 1000, timer_a_callback, NULL);
+    assert(event_queue_wait(&queue));
+    assert(idle_trace_size == 1);
+    assert(idle_trace[0] == 1);
+    assert(idle_budget == 300);
+    assert(mock_time_get() == 1000);
+
+    // The budget is limited by the next deadline.
+    event_queue_add_timer(&queue, 100, timer_a_callback, NULL);
+    assert(event_queue_wait(&queue));
+    assert(idle_trace_size == 2);
+    assert(idle_trace[1] == 2);
+    assert(idle_budget == 100);
+    assert(timer_a_callback_call_count == 2);
+
+    // No idle time when I/O is ready.
+    int pipes[2];
+    assert(pipe(pipes) == 0);
+    assert(fcntl(pipes[0], F_SETFL, O_NONBLOCK) == 0);
+    event_queue_add_io_event(&queue, pipes[0], event_io_flag_read, event_io_function_a, NULL);
+    assert(write(pipes[1], "x", 1) == 1);
+
+    event_queue_add_timer(&queue, 1000, timer_a_callback, NULL);
+    assert(event_queue_wait(&queue));
+    assert(event_io_function_a_call_count == 1);
+    assert(idle_trace_size == 2);
+
+    event_queue_free(&queue);
+    close(pipes[0]);
+    close(pipes[1]);
+}
+
 static void io_events_trigger_callback_on_pipe_events(void) {
     // Set up pipes for testing instead of file descriptors of on-disk files.
     // The pipes are made non-blocking.
@@ -233,6 +585,155 @@ static void io_events_trigger_callback_on_pipe_events(void) {
     close(read_pipe_b);
 }
 
+static void io_events_are_refused_for_fds_which_have_one(void) {
+    int pipes[2];
+    assert(pipe(pipes) == 0);
+    assert(fcntl(pipes[0], F_SETFL, O_NONBLOCK) == 0);
+
+    EventQueue queue = event_queue_new();
+    IoEventId first =
+        event_queue_add_io_event(&queue, pipes[0], event_io_flag_read, event_io_function_a, NULL);
+    assert(first.id != EVENT_QUEUE_INVALID_ID);
+
+    errno = 0;
+    IoEventId second =
+        event_queue_add_io_event(&queue, pipes[0], event_io_flag_read, event_io_function_b, NULL);
+    assert(second.id == EVENT_QUEUE_INVALID_ID);
+    assert(errno == EEXIST);
+
+    // The first is still the one dispatched.
+    assert(write(pipes[1], "x", 1) == 1);
+    assert(event_queue_wait(&queue));
+    assert(event_io_function_a_call_count == 1);
+    assert(event_io_function_b_call_count == 0);
+
+    event_queue_remove_io_event(&queue, first);
+    assert(!event_queue_wait(&queue));
+
+    event_queue_free(&queue);
+    close(pipes[0]);
+    close(pipes[1]);
+}
+
+static void io_events_can_be_removed_from_io_callbacks(void) {
+    enum { pipe_count = 8 };
+
+    int read_fds[pipe_count];
+    int write_fds[pipe_count];
+    IoEventId ids[pipe_count];
+
+    EventQueue queue = event_queue_new();
+    io_removing_queue = &queue;
+
+    for (size_t i = 0; i < pipe_count; i++) {
+        int pipes[2];
+        assert(pipe(pipes) == 0);
+        assert(fcntl(pipes[0], F_SETFL, O_NONBLOCK) == 0);
+        read_fds[i] = pipes[0];
+        write_fds[i] = pipes[1];
+    }
+
+    // Each event removes the one registered after it, or itself for the last.
+    for (size_t i = 0; i < pipe_count; i++) {
+        IoEventId* target = &ids[(i == pipe_count - 1) ? i : (i + 1)];
+        ids[i] = event_queue_add_io_event(
+            &queue, read_fds[i], event_io_flag_read, io_removing_function, target);
+    }
+
+    for (size_t i = 0; i < pipe_count; i++) {
+        assert(write(write_fds[i], "x", 1) == 1);
+    }
+
+    // Events removed before they're dispatched are not called, and removals don't cause other
+    // ready events to be skipped.
+    assert(event_queue_wait(&queue));
+    assert(io_removing_function_call_count == pipe_count / 2);
+    assert(queue.io_events_size == pipe_count / 2);
+
+    for (size_t i = 0; i < pipe_count; i += 2) {
+        event_queue_remove_io_event(&queue, ids[i]);
+    }
+    assert(queue.io_events_size == 0);
+    assert(!event_queue_wait(&queue));
+
+    // The fd can be registered again, and stale IDs for it are ignored.
+    IoEventId new_id = event_queue_add_io_event(
+        &queue, read_fds[0], event_io_flag_read, event_io_function_a, NULL);
+    event_queue_remove_io_event(&queue, ids[0]);
+    assert(queue.io_events_size == 1);
+    event_queue_remove_io_event(&queue, new_id);
+    assert(queue.io_events_size == 0);
+
+    event_queue_free(&queue);
+
+    for (size_t i = 0; i < pipe_count; i++) {
+        close(read_fds[i]);
+        close(write_fds[i]);
+    }
+}
+
+static void timers_removed_while_blocked_are_not_dispatched(void) {
+    EventQueue queue = event_queue_new();
+    timer_removing_queue = &queue;
+
+    TimerId timer_a = event_queue_add_timer(&queue, 20000, timer_a_callback, NULL);
+    event_queue_add_timer(&queue, 3000000, timer_b_callback, NULL);
+
+    int pipes[2];
+    assert(pipe(pipes) == 0);
+    IoEventId io_event = event_queue_add_io_event(
+        &queue, pipes[0], event_io_flag_read, timer_removing_function, &timer_a);
+
+    // The I/O callback removes the timer being waited for, so the later timer isn't made early.
+    assert(write(pipes[1], "a", 1) == 1);
+    assert(event_queue_wait(&queue));
+    assert(timer_a_callback_call_count == 0);
+    assert(timer_b_callback_call_count == 0);
+    assert(mock_time_get() < 3000000);
+
+    event_queue_remove_io_event(&queue, io_event);
+    assert(event_queue_wait(&queue));
+    assert(timer_b_callback_call_count == 1);
+    assert(mock_time_get() == 3000000);
+
+    // Removing the only timer leaves nothing to dispatch.
+    TimerId timer_c = event_queue_add_timer(&queue, 20000, timer_a_callback, NULL);
+    event_queue_add_io_event(
+        &queue, pipes[0], event_io_flag_read, timer_removing_function, &timer_c);
+
+    assert(write(pipes[1], "a", 1) == 1);
+    assert(event_queue_wait(&queue));
+    assert(timer_a_callback_call_count == 0);
+
+    event_queue_free(&queue);
+    close(pipes[0]);
+    close(pipes[1]);
+}
+
+static void io_events_can_be_modified_to_wait_for_writability(void) {
+    int pipes[2];
+    assert(pipe(pipes) == 0);
+    assert(fcntl(pipes[0], F_SETFL, O_NONBLOCK) == 0);
+
+    EventQueue queue = event_queue_new();
+    IoEventId id = event_queue_add_io_event(
+        &queue, pipes[1], event_io_flag_read, event_io_function_a, NULL);
+
+    event_queue_modify_io_event(&queue, id, event_io_flag_write);
+
+    // An empty pipe can be written to immediately.
+    assert(event_queue_wait(&queue));
+    assert(event_io_function_a_call_count == 1);
+    assert(event_io_function_a_fd == pipes[1]);
+    assert(event_io_function_a_flag == event_io_flag_write);
+
+    event_queue_remove_io_event(&queue, id);
+    event_queue_free(&queue);
+
+    close(pipes[0]);
+    close(pipes[1]);
+}
+
 static void can_combine_timers_and_io_events(void) {
     int pipes[2];
     assert(pipe(pipes) == 0);
@@ -265,8 +766,558 @@ static void can_combine_timers_and_io_events(void) {
     close(read_pipe);
 }
 
+static void process_events_report_exit_status_of_children(void) {
+    EventQueue queue = event_queue_new();
+
+    for (uintptr_t i = 0; i < CHILD_PROCESS_COUNT; i++) {
+        pid_t pid = spawn_child((int)i, -1);
+
+        IoEventId id;
+        assert(event_queue_add_process_event(&queue, pid, process_exit_function, (void*)i, &id));
+    }
+
+    while (process_exit_call_count < CHILD_PROCESS_COUNT) {
+        assert(event_queue_wait(&queue));
+    }
+
+    for (int i = 0; i < CHILD_PROCESS_COUNT; i++) {
+        assert(WIFEXITED(process_exit_statuses[i]));
+        assert(WEXITSTATUS(process_exit_statuses[i]) == i);
+    }
+
+    // Every child was reaped, so there's nothing left to wait for.
+    assert(!event_queue_wait(&queue));
+    assert(waitpid(-1, NULL, WNOHANG) < 0);
+
+    event_queue_free(&queue);
+}
+
+static void removed_process_events_do_not_call_their_function(void) {
+    int pipes[2];
+    assert(pipe(pipes) == 0);
+
+    EventQueue queue = event_queue_new();
+    pid_t pid = spawn_child(0, pipes[0]);
+
+    IoEventId id;
+    assert(event_queue_add_process_event(&queue, pid, process_exit_function, NULL, &id));
+    event_queue_remove_io_event(&queue, id);
+
+    assert(write(pipes[1], "x", 1) == 1);
+    assert(!event_queue_wait(&queue));
+    assert(process_exit_call_count == 0);
+
+    // Left for the caller to reap.
+    assert(waitpid(pid, NULL, 0) == pid);
+
+    event_queue_free(&queue);
+    close(pipes[0]);
+    close(pipes[1]);
+}
+
+static void queue_tables_can_be_reserved_and_shrunk(void) {
+    EventQueue queue = event_queue_new();
+    event_queue_reserve(&queue, 128, 32, 0);
+
+    EventQueueMemoryUsage usage;
+    event_queue_get_memory_usage(&queue, &usage);
+    assert(usage.timers.capacity == 128);
+    assert(usage.events.capacity == 32);
+    assert(usage.timers.size == 0);
+    assert(usage.timers.bytes_used == 0);
+
+    EventId events[100];
+    for (size_t i = 0; i < 100; i++) {
+        events[i] = event_queue_add_event(&queue, event_callback, NULL);
+    }
+
+    event_queue_get_memory_usage(&queue, &usage);
+    assert(usage.events.size == 100);
+    assert(usage.events.capacity == 128);
+    assert(usage.events.bytes_used < usage.events.bytes_allocated);
+
+    for (size_t i = 0; i < 100; i++) {
+        event_queue_remove_event(&queue, events[i]);
+    }
+
+    // Shrinking stops at the reserved sizes.
+    event_queue_shrink_to_fit(&queue);
+    event_queue_get_memory_usage(&queue, &usage);
+    assert(usage.timers.capacity == 128);
+    assert(usage.events.capacity == 32);
+
+    event_queue_reserve(&queue, 0, 0, 0);
+    event_queue_shrink_to_fit(&queue);
+    event_queue_get_memory_usage(&queue, &usage);
+    assert(usage.timers.capacity == 1);
+    assert(usage.events.capacity == 1);
+    assert(usage.io_fd_indices.capacity == 0);
+    assert(usage.hooks.capacity == 0);
+
+    // Tables still grow afterwards.
+    EventId id = event_queue_add_event(&queue, event_callback, NULL);
+    event_queue_trigger_event(&queue, id, NULL);
+    event_queue_trigger_event(&queue, id, NULL);
+    assert(event_queue_wait(&queue));
+    assert(event_queue_wait(&queue));
+    assert(event_callback_call_count == 2);
+
+    event_queue_free(&queue);
+}
+
+static void sparse_tables_shrink_automatically(void) {
+    EventQueue queue = event_queue_new();
+    event_queue_set_auto_shrink(&queue, true);
+
+    for (size_t i = 0; i < 1024; i++) {
+        event_queue_add_timer(&queue, 100 + i, timer_a_callback, NULL);
+    }
+
+    EventQueueMemoryUsage usage;
+    event_queue_get_memory_usage(&queue, &usage);
+    assert(usage.timers.capacity == 1024);
+
+    // Capacity halves while at most a quarter is used, but the first three quarters are taken
+    // before it shrinks at all.
+    size_t previous_capacity = 1024;
+    for (size_t i = 0; i < 1024; i++) {
+        assert(event_queue_wait(&queue));
+
+        event_queue_get_memory_usage(&queue, &usage);
+        size_t remaining = 1023 - i;
+
+        if (remaining > 256) {
+            assert(usage.timers.capacity == 1024);
+        }
+
+        assert(usage.timers.capacity <= previous_capacity);
+        assert(usage.timers.capacity >= EVENT_QUEUE_AUTO_SHRINK_MIN_CAPACITY);
+        previous_capacity = usage.timers.capacity;
+    }
+
+    assert(usage.timers.capacity == EVENT_QUEUE_AUTO_SHRINK_MIN_CAPACITY);
+    assert(timer_a_callback_call_count == 1024);
+
+    event_queue_free(&queue);
+}
+
+static void timer_groups_are_cancelled_and_rescheduled_together(void) {
+    EventQueue queue = event_queue_new();
+
+    TimerGroupId connection_a = event_queue_add_timer_group(&queue);
+    TimerGroupId connection_b = event_queue_add_timer_group(&queue);
+
+    for (uint64_t i = 1; i <= 3; i++) {
+        event_queue_add_grouped_timer(
+            &queue, connection_a, i * 100, TIMER_APERIODIC, timer_a_callback, NULL);
+        event_queue_add_grouped_timer(
+            &queue, connection_b, i * 100, TIMER_APERIODIC, timer_b_callback, NULL);
+    }
+    event_queue_add_timer(&queue, 1000, timer_a_callback, NULL);
+
+    EventId event = event_queue_add_event(&queue, event_callback, NULL);
+    assert(event_queue_trigger_event(&queue, event, NULL));
+
+    event_queue_cancel_group(&queue, connection_a);
+    event_queue_reschedule_group(&queue, connection_b, 1000);
+
+    // Group 0 isn't a group, so leaves ungrouped timers and events alone.
+    event_queue_cancel_group(&queue, (TimerGroupId){0});
+    event_queue_reschedule_group(&queue, (TimerGroupId){0}, 5000);
+
+    EventQueueStats stats;
+    event_queue_get_stats(&queue, &stats);
+    assert(stats.timer_count == 4);
+
+    assert(event_queue_wait(&queue));
+    assert(event_callback_call_count == 1);
+    assert(mock_time_get() == 0);
+
+    // The ungrouped timer now comes first.
+    assert(event_queue_wait(&queue));
+    assert(mock_time_get() == 1000);
+    assert(timer_a_callback_call_count == 1);
+    assert(timer_b_callback_call_count == 0);
+
+    for (uint64_t i = 1; i <= 3; i++) {
+        assert(event_queue_wait(&queue));
+        assert(mock_time_get() == 1000 + (i * 100));
+        assert(timer_b_callback_call_count == i);
+    }
+
+    assert(!event_queue_wait(&queue));
+    assert(timer_a_callback_call_count == 1);
+
+    event_queue_free(&queue);
+}
+
+static bool is_readable_within(int fd, int timeout_ms) {
+    struct pollfd pollfd = { .fd = fd, .events = POLLIN, .revents = 0 };
+    return poll(&pollfd, 1, timeout_ms) == 1;
+}
+
+static void backend_fd_is_readable_when_work_is_ready(void) {
+    int pipes[2];
+    assert(pipe(pipes) == 0);
+    assert(fcntl(pipes[0], F_SETFL, O_NONBLOCK) == 0);
+
+    EventQueue queue = event_queue_new();
+    event_queue_add_io_event(&queue, pipes[0], event_io_flag_read, event_io_function_a, NULL);
+
+    int fd = event_queue_get_fd(&queue);
+    assert(fd >= 0);
+    assert(event_queue_get_fd(&queue) == fd);
+    assert(!is_readable_within(fd, 0));
+
+    // Due timers.
+    event_queue_add_timer(&queue, 0, timer_a_callback, NULL);
+    assert(is_readable_within(fd, 1000));
+    assert(event_queue_poll(&queue));
+    assert(timer_a_callback_call_count == 1);
+    assert(!is_readable_within(fd, 0));
+
+    // Triggered events.
+    EventId event = event_queue_add_event(&queue, event_callback, NULL);
+    event_queue_trigger_event(&queue, event, NULL);
+    assert(is_readable_within(fd, 1000));
+    assert(event_queue_poll(&queue));
+    assert(event_callback_call_count == 1);
+
+    // Ready I/O, including I/O events added after the fd was created.
+    int other_pipes[2];
+    assert(pipe(other_pipes) == 0);
+    assert(fcntl(other_pipes[0], F_SETFL, O_NONBLOCK) == 0);
+    event_queue_add_io_event(&queue, other_pipes[0], event_io_flag_read, event_io_function_b, NULL);
+
+    assert(write(other_pipes[1], "x", 1) == 1);
+    assert(is_readable_within(fd, 1000));
+    assert(event_queue_poll(&queue));
+    assert(event_io_function_b_call_count == 1);
+    assert(event_io_function_a_call_count == 0);
+
+    event_queue_free(&queue);
+    close(pipes[0]);
+    close(pipes[1]);
+    close(other_pipes[0]);
+    close(other_pipes[1]);
+}
+
+static void backend_fd_follows_removed_timers(void) {
+    EventQueue queue = event_queue_new();
+    int fd = event_queue_get_fd(&queue);
+
+    TimerId timer = event_queue_add_timer(&queue, 0, timer_a_callback, NULL);
+    assert(is_readable_within(fd, 1000));
+    event_queue_remove_timer(&queue, timer);
+    assert(!is_readable_within(fd, 0));
+
+    TimerGroupId group = event_queue_add_timer_group(&queue);
+    event_queue_add_grouped_timer(&queue, group, 0, TIMER_APERIODIC, timer_a_callback, NULL);
+    assert(is_readable_within(fd, 1000));
+    event_queue_cancel_group(&queue, group);
+    assert(!is_readable_within(fd, 0));
+
+    EventId event = event_queue_add_event(&queue, event_callback, NULL);
+    event_queue_trigger_event_at(&queue, event, NULL, 1, EVENT_QUEUE_NO_EXPIRY);
+    assert(is_readable_within(fd, 1000));
+    event_queue_remove_event(&queue, event);
+    assert(!is_readable_within(fd, 0));
+
+    event_queue_free(&queue);
+}
+
+static void backend_fd_ignores_virtual_timers_until_due(void) {
+    VirtualClock clock = virtual_clock_new(0);
+    EventQueue queue = event_queue_new();
+    event_queue_set_clock(&queue, event_clock_virtual(&clock));
+    int fd = event_queue_get_fd(&queue);
+
+    // A virtual millisecond has nothing to do with a real one.
+    event_queue_add_timer(&queue, 1000, timer_a_callback, NULL);
+    assert(!is_readable_within(fd, 20));
+
+    virtual_clock_advance(&clock, 1000);
+    assert(event_queue_poll(&queue));
+    assert(timer_a_callback_call_count == 1);
+
+    event_queue_free(&queue);
+}
+
+static void polling_only_processes_what_is_due(void) {
+    EventQueue queue = event_queue_new();
+    event_queue_add_timer(&queue, 500, timer_a_callback, NULL);
+
+    assert(!event_queue_poll(&queue));
+    assert(timer_a_callback_call_count == 0);
+    assert(mock_time_get() == 0);
+
+    time_sleep_until(500); // Advances the mocked clock.
+    assert(event_queue_poll(&queue));
+    assert(timer_a_callback_call_count == 1);
+
+    event_queue_free(&queue);
+}
+
+static void waiting_with_a_timeout_returns_by_the_timeout(void) {
+    EventQueue queue = event_queue_new();
+    assert(!event_queue_wait_timeout(&queue, 100));
+
+    event_queue_add_timer(&queue, 1000, timer_a_callback, NULL);
+
+    assert(!event_queue_wait_timeout(&queue, 100));
+    assert(mock_time_get() == 100);
+    assert(timer_a_callback_call_count == 0);
+
+    assert(event_queue_wait_timeout(&queue, 10000));
+    assert(mock_time_get() == 1000);
+    assert(timer_a_callback_call_count == 1);
+
+    event_queue_free(&queue);
+}
+
 // --- Test runner -- //
 
+static void tasks_run_in_steps_between_timers(void) {
+    EventQueue queue = event_queue_new();
+    event_queue_set_task_budget(&queue, 300, 50);
+
+    size_t remaining_steps = 10;
+    event_queue_add_task(&queue, task_function, &remaining_steps);
+    event_queue_add_timer(&queue, 1000, timer_a_callback, NULL);
+
+    // Steps are given the task budget, instead of blocking for the timer.
+    assert(event_queue_wait(&queue));
+    assert(task_step_count == 1);
+    assert(task_budget == 300);
+    assert(mock_time_get() == 300);
+
+    assert(event_queue_wait(&queue));
+    assert(event_queue_wait(&queue));
+    assert(mock_time_get() == 900);
+
+    // The last step before the timer may make it late by at most the configured lateness.
+    assert(event_queue_wait(&queue));
+    assert(task_budget == 150);
+    assert(mock_time_get() == 1050);
+    assert(timer_a_callback_call_count == 0);
+
+    assert(event_queue_wait(&queue));
+    assert(timer_a_callback_call_count == 1);
+    assert(task_step_count == 4);
+
+    // Tasks keep the queue busy until they're done, then are removed.
+    while (event_queue_wait(&queue)) {}
+    assert(task_step_count == 10);
+    assert(remaining_steps == 0);
+
+    event_queue_free(&queue);
+}
+
+static void event_limits_apply_overflow_policies(void) {
+    EventQueue queue = event_queue_new();
+    int values[3] = {0};
+
+    EventId rejecting = event_queue_add_event(&queue, event_callback, NULL);
+    event_queue_set_event_limit(&queue, rejecting, 2, event_overflow_policy_reject);
+    assert(event_queue_trigger_event(&queue, rejecting, &values[0]));
+    assert(event_queue_trigger_event(&queue, rejecting, &values[1]));
+    assert(!event_queue_trigger_event(&queue, rejecting, &values[2]));
+    assert(event_queue_get_event_drop_count(&queue, rejecting) == 1);
+
+    while (event_queue_wait(&queue)) {}
+    assert(event_callback_call_count == 2);
+    assert(event_callback_eventdata == &values[1]);
+
+    // Dropping the oldest keeps the latest triggers.
+    EventId dropping_oldest = event_queue_add_event(&queue, event_callback, NULL);
+    event_queue_set_event_limit(&queue, dropping_oldest, 2, event_overflow_policy_drop_oldest);
+    for (size_t i = 0; i < 3; i++) {
+        assert(event_queue_trigger_event(&queue, dropping_oldest, &values[i]));
+    }
+
+    assert(event_queue_wait(&queue));
+    assert(event_callback_eventdata == &values[1]);
+    assert(event_queue_wait(&queue));
+    assert(event_callback_eventdata == &values[2]);
+    assert(!event_queue_wait(&queue));
+
+    // Dropping the newest keeps the earliest triggers.
+    EventId dropping_newest = event_queue_add_event(&queue, event_callback, NULL);
+    event_queue_set_event_limit(&queue, dropping_newest, 2, event_overflow_policy_drop_newest);
+    for (size_t i = 0; i < 3; i++) {
+        assert(event_queue_trigger_event(&queue, dropping_newest, &values[i]));
+    }
+
+    assert(event_queue_wait(&queue));
+    assert(event_callback_eventdata == &values[0]);
+    assert(event_queue_wait(&queue));
+    assert(event_callback_eventdata == &values[1]);
+    assert(!event_queue_wait(&queue));
+
+    EventQueueStats stats;
+    event_queue_get_stats(&queue, &stats);
+    assert(stats.rejected_event_count == 1);
+    assert(stats.dropped_event_count == 2);
+
+    event_queue_free(&queue);
+}
+
+static void pending_limit_drops_the_oldest_trigger_of_any_event(void) {
+    EventQueue queue = event_queue_new();
+    event_queue_set_pending_limit(&queue, 2, event_overflow_policy_drop_oldest);
+    int values[3] = {0};
+
+    EventId first = event_queue_add_event(&queue, event_callback, NULL);
+    EventId second = event_queue_add_event(&queue, event_callback, NULL);
+
+    assert(event_queue_trigger_event(&queue, first, &values[0]));
+    time_sleep_until(10);
+    assert(event_queue_trigger_event(&queue, second, &values[1]));
+    time_sleep_until(20);
+    assert(event_queue_trigger_event(&queue, first, &values[2]));
+
+    assert(event_queue_get_event_drop_count(&queue, first) == 1);
+    assert(event_queue_get_event_drop_count(&queue, second) == 0);
+
+    assert(event_queue_wait(&queue));
+    assert(event_queue_wait(&queue));
+    assert(!event_queue_wait(&queue));
+    assert(event_callback_call_count == 2);
+
+    EventQueueStats stats;
+    event_queue_get_stats(&queue, &stats);
+    assert(stats.dropped_event_count == 1);
+    assert(stats.pending_event_count == 0);
+
+    event_queue_free(&queue);
+}
+
+static size_t overload_call_count;
+static bool overload_is_overloaded;
+static uint64_t overload_lag_us;
+static void overload_function(bool is_overloaded, uint64_t lag_us, void* userdata) {
+    (void)userdata;
+    overload_call_count += 1;
+    overload_is_overloaded = is_overloaded;
+    overload_lag_us = lag_us;
+}
+
+static void overload_function_reports_lag_past_the_threshold(void) {
+    EventQueue queue = event_queue_new();
+    event_queue_set_overload_function(&queue, 200, overload_function, NULL);
+
+    EventId event = event_queue_add_event(&queue, event_callback, NULL);
+
+    // Dispatched 500us after being triggered.
+    assert(event_queue_trigger_event(&queue, event, NULL));
+    time_sleep_until(500);
+    assert(event_queue_wait(&queue));
+    assert(overload_call_count == 1);
+    assert(overload_is_overloaded);
+    assert(overload_lag_us == 500);
+
+    // Still above half the threshold, so still overloaded.
+    assert(event_queue_trigger_event(&queue, event, NULL));
+    time_sleep_until(650);
+    assert(event_queue_wait(&queue));
+    assert(overload_call_count == 1);
+
+    assert(event_queue_trigger_event(&queue, event, NULL));
+    assert(event_queue_wait(&queue));
+    assert(overload_call_count == 2);
+    assert(!overload_is_overloaded);
+    assert(overload_lag_us == 0);
+
+    EventQueueStats stats;
+    event_queue_get_stats(&queue, &stats);
+    assert(stats.lag_us == 0);
+
+    event_queue_free(&queue);
+}
+
+static void delayed_triggers_are_dispatched_once_due(void) {
+    EventQueue queue = event_queue_new();
+    int values[2] = {0};
+
+    EventId event = event_queue_add_event(&queue, event_callback, NULL);
+    assert(event_queue_trigger_event_at(&queue, event, &values[0], 500, EVENT_QUEUE_NO_EXPIRY));
+    assert(event_queue_trigger_event_at(&queue, event, &values[1], 200, EVENT_QUEUE_NO_EXPIRY));
+
+    EventQueueStats stats;
+    event_queue_get_stats(&queue, &stats);
+    assert(stats.timer_count == 0);
+    assert(stats.pending_event_count == 2);
+
+    while (event_callback_call_count == 0) {
+        assert(event_queue_wait(&queue));
+    }
+    assert(mock_time_get() == 200);
+    assert(event_callback_eventdata == &values[1]);
+
+    while (event_queue_wait(&queue)) {}
+    assert(mock_time_get() == 500);
+    assert(event_callback_call_count == 2);
+    assert(event_callback_eventdata == &values[0]);
+
+    event_queue_free(&queue);
+}
+
+static size_t destroy_call_count;
+static void* destroy_eventdata;
+static void destroy_function(void* userdata, void* eventdata) {
+    (void)userdata;
+    destroy_call_count += 1;
+    destroy_eventdata = eventdata;
+}
+
+static void expired_triggers_are_destroyed_instead_of_dispatched(void) {
+    EventQueue queue = event_queue_new();
+    int values[4] = {0};
+
+    EventId event = event_queue_add_event(&queue, event_callback, NULL);
+    event_queue_set_event_destroy_function(&queue, event, destroy_function);
+
+    // Both expire while the queue is busy elsewhere.
+    assert(event_queue_trigger_event_at(&queue, event, &values[0], 0, 100));
+    assert(event_queue_trigger_event_at(&queue, event, &values[1], 0, 100));
+    time_sleep_until(200);
+    assert(event_queue_trigger_event(&queue, event, &values[2]));
+
+    while (event_queue_wait(&queue)) {}
+    assert(event_callback_call_count == 1);
+    assert(event_callback_eventdata == &values[2]);
+    assert(destroy_call_count == 2);
+
+    // A delayed trigger can expire before it's due.
+    assert(event_queue_trigger_event_at(&queue, event, &values[3], 400, 300));
+    while (event_queue_wait(&queue)) {}
+    assert(event_callback_call_count == 1);
+    assert(destroy_call_count == 3);
+    assert(destroy_eventdata == &values[3]);
+
+    EventQueueStats stats;
+    event_queue_get_stats(&queue, &stats);
+    assert(stats.expired_event_count == 3);
+
+    // Collapsing events release the eventdata they replace.
+    EventId collapsing = event_queue_add_collapsing_event(&queue, event_callback, NULL);
+    event_queue_set_event_destroy_function(&queue, collapsing, destroy_function);
+    assert(event_queue_trigger_event(&queue, collapsing, &values[0]));
+    assert(event_queue_trigger_event(&queue, collapsing, &values[1]));
+    assert(destroy_call_count == 4);
+    assert(destroy_eventdata == &values[0]);
+
+    // Removing an event releases its pending and delayed triggers.
+    assert(event_queue_trigger_event_at(&queue, event, &values[2], 1000, EVENT_QUEUE_NO_EXPIRY));
+    event_queue_remove_event(&queue, event);
+    assert(destroy_call_count == 5);
+    assert(destroy_eventdata == &values[2]);
+
+    event_queue_free(&queue);
+    assert(destroy_call_count == 6);
+    assert(destroy_eventdata == &values[1]);
+}
+
 static void setup(void) {
     timer_a_callback_call_count = 0;
     timer_b_callback_call_count = 0;
@@ -274,6 +1325,20 @@ static void setup(void) {
     event_callback_call_count = 0;
     event_callback_userdata = NULL;
     event_callback_eventdata = NULL;
+    batch_callback_call_count = 0;
+    overload_call_count = 0;
+    destroy_call_count = 0;
+    batch_callback_count = 0;
+    work_done_function_call_count = 0;
+    io_removing_function_call_count = 0;
+    prepare_hook_time = 0;
+    prepare_hook_call_count = 0;
+    check_hook_time = 0;
+    check_hook_call_count = 0;
+    idle_trace_size = 0;
+    idle_budget = 0;
+    task_step_count = 0;
+    task_budget = 0;
     event_io_function_a_fd = 0;
     event_io_function_a_flag = 0;
     event_io_function_a_userdata = NULL;
@@ -282,6 +1347,7 @@ static void setup(void) {
     event_io_function_b_flag = 0;
     event_io_function_b_userdata = NULL;
     event_io_function_b_call_count = 0;
+    process_exit_call_count = 0;
     mock_time_reset();
 }
 
@@ -291,8 +1357,35 @@ int main(void) {
         periodic_timers_trigger_callbacks_repeatedly_at_given_intervals,
         removed_timers_do_not_trigger_callbacks,
         waiting_after_event_trigger_calls_related_callback,
+        collapsing_event_dispatches_once_with_latest_eventdata,
+        batch_event_delivers_all_pending_eventdata_in_one_call,
+        submitted_work_completes_on_the_queue_thread,
+        work_can_be_submitted_from_done_functions,
+        virtual_clock_jumps_to_timer_deadlines,
+        prepare_and_check_hooks_run_around_blocking,
+        idle_callbacks_share_a_budget_when_nothing_is_ready,
+        tasks_run_in_steps_between_timers,
         io_events_trigger_callback_on_pipe_events,
+        io_events_are_refused_for_fds_which_have_one,
+        io_events_can_be_removed_from_io_callbacks,
+        timers_removed_while_blocked_are_not_dispatched,
+        io_events_can_be_modified_to_wait_for_writability,
         can_combine_timers_and_io_events,
+        process_events_report_exit_status_of_children,
+        removed_process_events_do_not_call_their_function,
+        queue_tables_can_be_reserved_and_shrunk,
+        sparse_tables_shrink_automatically,
+        timer_groups_are_cancelled_and_rescheduled_together,
+        backend_fd_is_readable_when_work_is_ready,
+        backend_fd_follows_removed_timers,
+        backend_fd_ignores_virtual_timers_until_due,
+        polling_only_processes_what_is_due,
+        waiting_with_a_timeout_returns_by_the_timeout,
+        event_limits_apply_overflow_policies,
+        pending_limit_drops_the_oldest_trigger_of_any_event,
+        overload_function_reports_lag_past_the_threshold,
+        delayed_triggers_are_dispatched_once_due,
+        expired_triggers_are_destroyed_instead_of_dispatched,
     };
 
     size_t test_count = sizeof(tests) / sizeof(tests[0]);
@@ -0,0 +1,209 @@
+#include "fiber.h"
+#include "mock_time.h"
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// --- Utility --- //
+
+// Records the order in which fibers reach certain points.
+static int trace[16];
+static size_t trace_size;
+
+static void record(int value) {
+    assert(trace_size < 16);
+    trace[trace_size] = value;
+    trace_size += 1;
+}
+
+static void sleeping_fiber(void* userdata) {
+    int* value = userdata;
+
+    record(*value);
+    fiber_sleep_us(1000 * (uint64_t)*value);
+    record(*value);
+    assert(mock_time_get() == 1000 * (uint64_t)*value);
+}
+
+static void yielding_fiber(void* userdata) {
+    int* value = userdata;
+
+    for (int i = 0; i < 3; i++) {
+        record(*value);
+        fiber_yield();
+    }
+}
+
+static int readable_fd;
+static void reading_fiber(void* userdata) {
+    (void)userdata;
+
+    record(1);
+    fiber_wait_readable(readable_fd);
+
+    char data;
+    assert(read(readable_fd, &data, 1) == 1);
+    record(data);
+}
+
+static EventId waited_event;
+static void event_waiting_fiber(void* userdata) {
+    (void)userdata;
+
+    void* eventdata = NULL;
+    assert(fiber_wait_event(waited_event, &eventdata));
+    record(*(int*)eventdata);
+
+    assert(!fiber_wait_event((EventId){ .id = 12345 }, &eventdata));
+}
+
+static void event_function(void* userdata, void* eventdata) {
+    (void)userdata;
+    (void)eventdata;
+    record(0);
+}
+
+static size_t finished_fiber_count;
+static void counting_fiber(void* userdata) {
+    (void)userdata;
+    finished_fiber_count += 1;
+}
+
+// --- Tests --- //
+
+static void sleeping_fibers_resume_after_their_delay(void) {
+    EventQueue queue = event_queue_new();
+
+    int a = 3;
+    int b = 2;
+    fiber_spawn(&queue, sleeping_fiber, &a);
+    fiber_spawn(&queue, sleeping_fiber, &b);
+
+    while (event_queue_wait(&queue)) {}
+
+    assert(trace_size == 4);
+    assert(trace[2] == 2);
+    assert(trace[3] == 3);
+    assert(mock_time_get() == 3000);
+
+    event_queue_free(&queue);
+}
+
+static void yielding_fibers_interleave(void) {
+    EventQueue queue = event_queue_new();
+
+    int a = 1;
+    int b = 2;
+    fiber_spawn(&queue, yielding_fiber, &a);
+    fiber_spawn(&queue, yielding_fiber, &b);
+
+    while (event_queue_wait(&queue)) {}
+
+    assert(trace_size == 6);
+
+    // Neither fiber can run twice in a row while the other has work left.
+    size_t a_count = 0;
+    for (size_t i = 0; i < trace_size; i++) {
+        if (trace[i] == 1) {
+            a_count += 1;
+        }
+    }
+    assert(a_count == 3);
+    assert(trace[0] != trace[1]);
+
+    event_queue_free(&queue);
+}
+
+static void fiber_waiting_for_readable_fd_resumes_when_data_arrives(void) {
+    int pipes[2];
+    assert(pipe(pipes) == 0);
+    readable_fd = pipes[0];
+
+    EventQueue queue = event_queue_new();
+    fiber_spawn(&queue, reading_fiber, NULL);
+
+    assert(event_queue_wait(&queue));
+    assert(trace_size == 1);
+
+    assert(write(pipes[1], "x", 1) == 1);
+
+    assert(event_queue_wait(&queue));
+    assert(trace_size == 2);
+    assert(trace[1] == 'x');
+
+    // The fiber's I/O event was removed when it resumed.
+    assert(!event_queue_wait(&queue));
+
+    event_queue_free(&queue);
+    close(pipes[0]);
+    close(pipes[1]);
+}
+
+static void fiber_waiting_for_event_resumes_with_eventdata(void) {
+    EventQueue queue = event_queue_new();
+    waited_event = event_queue_add_event(&queue, event_function, NULL);
+
+    fiber_spawn(&queue, event_waiting_fiber, NULL);
+    assert(event_queue_wait(&queue));
+    assert(trace_size == 0);
+
+    int value = 7;
+    event_queue_trigger_event(&queue, waited_event, &value);
+    assert(event_queue_wait(&queue));
+
+    // The event's own function runs before the fiber resumes.
+    assert(trace_size == 2);
+    assert(trace[0] == 0);
+    assert(trace[1] == 7);
+
+    event_queue_free(&queue);
+}
+
+static void many_fibers_reuse_pooled_stacks(void) {
+    EventQueue queue = event_queue_new();
+
+    for (size_t i = 0; i < 1000; i++) {
+        fiber_spawn(&queue, counting_fiber, NULL);
+        assert(event_queue_wait(&queue));
+    }
+
+    assert(finished_fiber_count == 1000);
+
+    event_queue_free(&queue);
+}
+
+static void unfinished_fibers_are_discarded_when_queue_is_freed(void) {
+    EventQueue queue = event_queue_new();
+
+    int value = 5;
+    fiber_spawn(&queue, sleeping_fiber, &value);
+    assert(event_queue_wait(&queue));
+    assert(trace_size == 1);
+
+    event_queue_free(&queue);
+}
+
+// --- Test runner -- //
+
+static void setup(void) {
+    trace_size = 0;
+    finished_fiber_count = 0;
+    mock_time_reset();
+}
+
+int main(void) {
+    void (*tests[])(void) = {
+        sleeping_fibers_resume_after_their_delay,
+        yielding_fibers_interleave,
+        fiber_waiting_for_readable_fd_resumes_when_data_arrives,
+        fiber_waiting_for_event_resumes_with_eventdata,
+        many_fibers_reuse_pooled_stacks,
+        unfinished_fibers_are_discarded_when_queue_is_freed,
+    };
+
+    size_t test_count = sizeof(tests) / sizeof(tests[0]);
+    for (size_t i = 0; i < test_count; i++) {
+        setup();
+        tests[i]();
+    }
+}
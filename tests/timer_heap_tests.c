@@ -132,6 +132,141 @@ static void removing_a_timer_id_removes_timer_from_heap(void) {
     timer_heap_free(&heap);
 }
 
+static void reserving_and_shrinking_keeps_timers(void) {
+    TimerHeap heap = timer_heap_new();
+
+    timer_heap_reserve(&heap, 64);
+    assert(heap.capacity == 64);
+
+    for (uint32_t i = 0; i < 64; i++) {
+        timer_heap_insert(&heap, (Timer){ .deadline = 64 - i, .id = i });
+    }
+    assert(heap.capacity == 64); // No growth needed.
+
+    for (uint32_t i = 0; i < 60; i++) {
+        timer_heap_remove_id(&heap, (TimerId){i});
+    }
+
+    // Never shrinks below the number of timers.
+    timer_heap_shrink(&heap, 0);
+    assert(heap.capacity == 4);
+
+    for (uint32_t i = 60; i < 64; i++) {
+        timer_heap_remove_id(&heap, (TimerId){i});
+    }
+
+    // Nor below 1, so that it can still grow by doubling.
+    timer_heap_shrink(&heap, 0);
+    assert(heap.capacity == 1);
+    timer_heap_insert(&heap, (Timer){ .deadline = 1, .id = 1 });
+    timer_heap_insert(&heap, (Timer){ .deadline = 2, .id = 2 });
+    assert(timer_heap_find(&heap)->id == 1);
+
+    timer_heap_free(&heap);
+}
+
+static void removing_a_group_keeps_other_timers_ordered(void) {
+    TimerHeap heap = timer_heap_new();
+
+    for (uint32_t i = 0; i < 1000; i++) {
+        uint64_t deadline = hash64(i) % 10000;
+        timer_heap_insert(&heap, (Timer){ .deadline = deadline, .id = i, .group = i % 3 });
+    }
+
+    assert(timer_heap_remove_group(&heap, (TimerGroupId){1}) == 333);
+    assert(timer_heap_remove_group(&heap, (TimerGroupId){1}) == 0);
+
+    timer_heap_shift_group(&heap, (TimerGroupId){2}, -20000);
+
+    uint64_t last_deadline = 0;
+    size_t count = 0;
+
+    Timer timer;
+    while (timer_heap_take(&heap, &timer)) {
+        assert(timer.group != 1);
+        assert(timer.deadline >= last_deadline);
+
+        // Shifted timers saturate at 0, so come before all others.
+        if (timer.group == 2) {
+            assert(timer.deadline == 0);
+        }
+
+        last_deadline = timer.deadline;
+        count += 1;
+    }
+
+    assert(count == 667);
+
+    timer_heap_free(&heap);
+}
+
+static void radix_heap_takes_timers_in_deadline_order(void) {
+    TimerHeap heap = timer_heap_new();
+    timer_heap_set_kind(&heap, timer_heap_kind_radix);
+
+    const size_t element_count = 10000;
+
+    for (size_t i = 0; i < element_count; i++) {
+        timer_heap_insert(&heap, (Timer){ .deadline = hash64(i + 1) >> 20, .id = (uint32_t)i });
+    }
+
+    // Remove every third timer, some of which are the earliest in their bucket.
+    for (size_t i = 0; i < element_count; i += 3) {
+        timer_heap_remove_id(&heap, (TimerId){(uint32_t)i});
+    }
+
+    // Keep inserting timers no earlier than the last one taken, as the event queue does.
+    uint64_t last_deadline = 0;
+    size_t count = 0;
+    size_t inserted_count = 0;
+
+    Timer timer = {0};
+    while (timer_heap_take(&heap, &timer)) {
+        assert(timer.deadline >= last_deadline);
+        assert(timer.id >= element_count || timer.id % 3 != 0);
+        last_deadline = timer.deadline;
+        count += 1;
+
+        if (inserted_count < element_count) {
+            uint64_t delay = hash64(element_count + inserted_count) >> 40;
+            uint32_t id = (uint32_t)(element_count + inserted_count);
+            timer_heap_insert(&heap, (Timer){ .deadline = last_deadline + delay, .id = id });
+            inserted_count += 1;
+        }
+    }
+
+    assert(count == (element_count - (element_count + 2) / 3) + element_count);
+
+    timer_heap_free(&heap);
+}
+
+static void switching_kind_keeps_timers_ordered(void) {
+    TimerHeap heap = timer_heap_new();
+
+    for (size_t i = 0; i < 1000; i++) {
+        timer_heap_insert(&heap, (Timer){ .deadline = hash64(i + 1) >> 32, .group = i % 2 });
+    }
+
+    timer_heap_set_kind(&heap, timer_heap_kind_radix);
+    timer_heap_remove_group(&heap, (TimerGroupId){1});
+    timer_heap_set_kind(&heap, timer_heap_kind_binary);
+
+    uint64_t last_deadline = 0;
+    size_t count = 0;
+
+    Timer timer = {0};
+    while (timer_heap_take(&heap, &timer)) {
+        assert(timer.group == 0);
+        assert(timer.deadline >= last_deadline);
+        last_deadline = timer.deadline;
+        count += 1;
+    }
+
+    assert(count == 500);
+
+    timer_heap_free(&heap);
+}
+
 int main(void) {
     void (*tests[])(void) = {
         new_timer_heap_is_empty,
@@ -139,6 +274,10 @@ int main(void) {
         insertion_of_multiple_timers_maintains_ordering,
         large_number_of_timers_are_well_ordered_in_heap,
         removing_a_timer_id_removes_timer_from_heap,
+        reserving_and_shrinking_keeps_timers,
+        removing_a_group_keeps_other_timers_ordered,
+        radix_heap_takes_timers_in_deadline_order,
+        switching_kind_keeps_timers_ordered,
     };
 
     size_t test_count = sizeof(tests) / sizeof(tests[0]);